@@ -72,7 +72,8 @@ static void *newstack_tmp;
 static spinlock_t sync_lock;
 static u32 sync_id;
 static volatile u32 sync_count;
-static spinlock_t *apinitlock;
+/* apinit_lock is taken by xchg in entry.s, not by spinlock_lock */
+static ulong *apinitlock;
 
 /* this function is called after starting AP and switching a stack */
 /* unlock the spinlock because the stack is switched */
@@ -84,7 +85,7 @@ apinitproc1 (void)
 	void *newstack;
 
 	newstack = newstack_tmp;
-	spinlock_unlock (apinitlock);
+	asm_lock_ulong_swap (apinitlock, 0);
 	spinlock_lock (&ap_lock);
 	num_of_processors++;
 	n = num_of_processors;
@@ -218,9 +219,9 @@ ap_start (void)
 	ASSERT (apinit);
 	memcpy (apinit, cpuinit_start, APINIT_SIZE);
 	num = (volatile u32 *)APINIT_POINTER (apinit_procs);
-	apinitlock = (spinlock_t *)APINIT_POINTER (apinit_lock);
+	apinitlock = (ulong *)APINIT_POINTER (apinit_lock);
 	*num = 0;
-	spinlock_init (apinitlock);
+	asm_lock_ulong_swap (apinitlock, 0);
 	i = 0;
 	ap_start_addr (APINIT_ADDR >> 12, ap_start_loopcond, &i);
 	for (;;) {
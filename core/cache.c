@@ -500,6 +500,46 @@ get_gmtrr_type (phys_t gphys)
 	return c->gmtrr_def_type & MSR_IA32_MTRR_DEF_TYPE_TYPE_MASK;
 }
 
+/* mask must be 2^n-1. returns true if the guest MTRR type of all */
+/* addresses from (gphys & ~mask) to (gphys | mask) is the same */
+static bool
+gmtrr_type_equal (phys_t gphys, u64 mask)
+{
+	unsigned int i;
+	struct cache_data *c;
+	u64 physmask, base, tom2;
+	phys_t start, end;
+
+	c = &current->cache;
+	if (!(c->gmtrr_def_type & MSR_IA32_MTRR_DEF_TYPE_E_BIT))
+		return true;
+	start = gphys & ~mask;
+	end = gphys | mask;
+	/* do not care about fixed range MTRRs */
+	if ((c->gmtrr_def_type & MSR_IA32_MTRR_DEF_TYPE_FE_BIT) &&
+	    start <= 0xFFFFF)
+		return false;
+	for (i = 0; i < GMTRR_VCNT; i++) {
+		physmask = c->gmtrr_physmask[i];
+		if (!(physmask & MSR_IA32_MTRR_PHYSMASK0_V_BIT))
+			continue;
+		physmask &= MSR_IA32_MTRR_PHYSMASK0_PHYSMASK_MASK;
+		/* the range matches entirely or does not match at all */
+		if (!(physmask & mask))
+			continue;
+		/* some addresses in the range match and the others not */
+		base = c->gmtrr_physbase[i];
+		if (!((base ^ start) & physmask & ~mask))
+			return false;
+	}
+	if (c->gsyscfg & MSR_AMD_SYSCFG_TOM2FORCEMEMTYPEWB_BIT) {
+		tom2 = c->gtop_mem2 & MSR_AMD_TOP_MEM2_ADDR_MASK;
+		if (start < tom2 && end >= tom2)
+			return false;
+	}
+	return true;
+}
+
 static u32
 attr_from_type (u8 type)
 {
@@ -589,6 +629,12 @@ cache_get_gmtrr_type (u64 gphys)
 	return get_gmtrr_type (gphys);
 }
 
+bool
+cache_gmtrr_type_equal (u64 gphys, u64 mask)
+{
+	return gmtrr_type_equal (gphys, mask);
+}
+
 u32
 cache_get_gmtrr_attr (u64 gphys)
 {
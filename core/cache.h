@@ -56,6 +56,7 @@ bool cache_get_gpat (u64 *pat);
 bool cache_set_gpat (u64 pat);
 u32 cache_get_attr (u64 gphys, u32 gattr);
 u8 cache_get_gmtrr_type (u64 gphys);
+bool cache_gmtrr_type_equal (u64 gphys, u64 mask);
 u32 cache_get_gmtrr_attr (u64 gphys);
 u64 cache_get_gmtrrcap (void);
 bool cache_get_gmtrr (ulong msr_num, u64 *value);
@@ -47,12 +47,14 @@
 #define CPUID_EXT_0			0x80000000
 #define CPUID_EXT_1			0x80000001
 #define CPUID_EXT_1_ECX_SVM_BIT		0x4
+#define CPUID_EXT_1_EDX_PAGE1GB_BIT	0x4000000
 #define CPUID_EXT_8			0x80000008
 #define CPUID_EXT_8_EAX_PHYSADDRSIZE_MASK	0xFF
 #define CPUID_EXT_A			0x8000000A
 #define CPUID_EXT_A_EDX_NP_BIT		0x1
 #define CPUID_EXT_A_EDX_SVM_LOCK_BIT	0x4
 #define CPUID_EXT_A_EDX_FLUSH_BY_ASID_BIT	0x40
+#define CPUID_EXT_A_EDX_DECODE_ASSISTS_BIT	0x80
 #define MSR_IA32_TIME_STAMP_COUNTER	0x10
 #define MSR_IA32_APIC_BASE_MSR		0x1B
 #define MSR_IA32_APIC_BASE_MSR_APIC_GLOBAL_ENABLE_BIT	0x800
@@ -121,7 +123,10 @@
 #define MSR_IA32_VMX_EPT_VPID_CAP	0x48C
 #define MSR_IA32_VMX_EPT_VPID_CAP_PAGEWALK_LENGTH_4_BIT	0x40
 #define MSR_IA32_VMX_EPT_VPID_CAP_EPTSTRUCT_WB_BIT	0x4000
+#define MSR_IA32_VMX_EPT_VPID_CAP_2MB_PAGE_BIT	0x10000
+#define MSR_IA32_VMX_EPT_VPID_CAP_1GB_PAGE_BIT	0x20000
 #define MSR_IA32_VMX_EPT_VPID_CAP_INVEPT_BIT	0x100000
+#define MSR_IA32_VMX_EPT_VPID_CAP_AD_BIT	0x200000
 #define MSR_IA32_VMX_EPT_VPID_CAP_INVEPT_ALL_CONTEXT_BIT	0x4000000
 #define MSR_IA32_VMX_EPT_VPID_CAP_INVVPID_BIT	0x100000000ULL
 #define MSR_IA32_VMX_EPT_VPID_CAP_INVVPID_SINGLE_CONTEXT_BIT 0x20000000000ULL
@@ -363,6 +368,7 @@
 #define VMCS_GUEST_ACTIVITY_STATE_SHUTDOWN	0x2
 #define VMCS_GUEST_ACTIVITY_STATE_WAIT_FOR_SIPI	0x3
 #define VMCS_EPT_POINTER_EPT_WB		0x6
+#define VMCS_EPT_POINTER_AD_BIT		0x40
 #define VMCS_EPT_PAGEWALK_LENGTH_4	0x18
 
 #define VMXON_REGION_SIZE		0x1000
@@ -36,9 +36,14 @@
 #include "cpu_seg.h"
 #include "cpu_stack.h"
 #include "current.h"
+#include "gmm_access.h"
+#include "initfunc.h"
 #include "io_io.h"
+#include "mm.h"
 #include "panic.h"
 #include "printf.h"		/* DEBUG */
+#include "string.h"
+#include "vmmcall_status.h"
 
 #define PREFIX_LOCK		0xF0
 #define PREFIX_REPNE		0xF2
@@ -268,6 +273,8 @@ struct op {
 	i32 disp;		/* maximum size of a displacement is 32bit */
 	u64 imm;
 	enum reg modrm_brm, modrm_rreg;
+	enum reg modrm_index, modrm_base;
+	unsigned int modrm_scale;
 	enum sreg modrm_seg;
 	u64 modrm_addr;
 	enum cpumode mode;
@@ -279,6 +286,8 @@ struct op {
 	struct realmode_sysregs *rsr;
 	bool longmode;
 	bool modrm_ripflag;
+	bool modrm_regaddr;	/* modrm_addr is computed from registers */
+	u8 code[15];
 };
 
 struct modrm_info {
@@ -311,6 +320,38 @@ struct idata {
 	enum idata_function func : 16;
 };
 
+/* Decoded instructions are cached per vcpu so that an instruction */
+/* which accesses MMIO repeatedly is not decoded every time.  An */
+/* entry is found by the linear address of the instruction and is */
+/* used only if CR3, the CPU mode and the code bytes are the same. */
+/* Since the code bytes are always compared, writes to a cached code */
+/* page are detected without write-protecting the page. */
+#define NUM_OF_CACHE		64
+
+enum cache_kind {
+	CACHE_IDATA,
+	CACHE_MOVZX_RM8_TO_R,
+	CACHE_MOVZX_RM16_TO_R,
+	CACHE_MOVSB,
+	CACHE_MOVS,
+	CACHE_STOSB,
+	CACHE_STOS,
+};
+
+struct cpu_interpreter_cache_entry {
+	u32 gen;
+	enum cache_kind kind;
+	ulong cr3;
+	ulong linear;
+	ulong modekey;
+	struct idata idat;
+	struct op op;
+};
+
+struct cpu_interpreter_cache {
+	struct cpu_interpreter_cache_entry entry[NUM_OF_CACHE];
+};
+
 static struct modrm_info modrmmatrix16[3][8] = { /* [mod][rm] */
 	/* displen, reg1, reg2, defseg, sibflag, ripflag */
 	{
@@ -894,13 +935,23 @@ static enum vmmerr idata_wr (struct op *op, enum idata_operand operand,
 static enum vmmerr read_modrm16 (struct op *op, u8 o, u16 *d16);
 static enum vmmerr read_modrm32 (struct op *op, u8 o, u32 *d);
 
+static u32 stat_hitcnt = 0;
+static u32 stat_misscnt = 0;
+static u32 stat_flushcnt = 0;
+static u32 stat_movcnt = 0;
+static u32 stat_movfallbackcnt = 0;
+
 static enum vmmerr
 read_next_b (struct op *op, u8 *data)
 {
+	enum vmmerr err;
+
 	if (op->ip_off >= 15)
 		return VMMERR_INSTRUCTION_TOO_LONG;
-	return cpu_seg_read_b (SREG_CS, op->ip + op->ip_off++,
-			       data);
+	err = cpu_seg_read_b (SREG_CS, op->ip + op->ip_off, data);
+	if (!err)
+		op->code[op->ip_off++] = *data;
+	return err;
 }
 
 static ulong
@@ -1030,6 +1081,13 @@ read_modrm_b (struct op *op)
 	return VMMERR_SUCCESS;
 }
 
+static void
+calc_modrm_addr (struct op *op)
+{
+	op->modrm_addr = (get_reg (op, op->modrm_index) << op->modrm_scale)
+		+ get_reg (op, op->modrm_base) + op->disp;
+}
+
 static enum vmmerr
 get_modrm (struct op *op)
 {
@@ -1038,7 +1096,6 @@ get_modrm (struct op *op)
 	struct sibscale_info *ss;
 	int displen;
 	enum sreg defseg;
-	u64 addr;
 	i8 tmp1;
 	i16 tmp2;
 
@@ -1059,10 +1116,13 @@ get_modrm (struct op *op)
 		ss = &sib_scale[op->prefix.rex.b.x][op->sib.index];
 		displen = sb->displen;
 		defseg = sb->defseg;
-		addr = (get_reg (op, ss->reg) << op->sib.scale)
-			+ get_reg (op, sb->reg);
+		op->modrm_index = ss->reg;
+		op->modrm_scale = op->sib.scale;
+		op->modrm_base = sb->reg;
 	} else {
-		addr = get_reg (op, m->reg1) + get_reg (op, m->reg2);
+		op->modrm_index = m->reg1;
+		op->modrm_scale = 0;
+		op->modrm_base = m->reg2;
 	}
 	switch (displen) {
 	case 1:
@@ -1079,8 +1139,8 @@ get_modrm (struct op *op)
 	default:
 		op->disp = 0;
 	}
-	addr += op->disp;
-	op->modrm_addr = addr;
+	op->modrm_regaddr = true;
+	calc_modrm_addr (op);
 	op->modrm_ripflag = (op->longmode && m->ripflag);
 	if (op->prefix.seg != SREG_DEFAULT)
 		op->modrm_seg = op->prefix.seg;
@@ -2576,6 +2636,245 @@ grp_special:
 	return VMMERR_SUCCESS;
 }
 
+static struct cpu_interpreter_cache_entry *
+cache_get (ulong linear)
+{
+	struct cpu_interpreter_cache *c;
+
+	c = current->interp.cache;
+	if (!c) {
+		c = alloc (sizeof *c);
+		memset (c, 0, sizeof *c);
+		current->interp.cache = c;
+		current->interp.gen = 1;
+	}
+	return &c->entry[(linear ^ (linear >> 6)) % NUM_OF_CACHE];
+}
+
+static bool
+cache_hit (struct cpu_interpreter_cache_entry *e, ulong cr3, ulong linear,
+	   ulong modekey)
+{
+	u8 code[15];
+	uint i, len;
+
+	if (e->gen != current->interp.gen || e->cr3 != cr3 ||
+	    e->linear != linear || e->modekey != modekey)
+		return false;
+	len = e->op.ip_off;
+	for (i = 0; i + 8 <= len; i += 8)
+		if (read_linearaddr_q (linear + i, &code[i]))
+			return false;
+	if (i + 4 <= len) {
+		if (read_linearaddr_l (linear + i, &code[i]))
+			return false;
+		i += 4;
+	}
+	for (; i < len; i++)
+		if (read_linearaddr_b (linear + i, &code[i]))
+			return false;
+	return !memcmp (code, e->op.code, len);
+}
+
+static enum vmmerr
+cache_exec (struct op *op, enum cache_kind kind, struct idata idat)
+{
+	switch (kind) {
+	case CACHE_IDATA:
+		return opcode_idata (op, idat);
+	case CACHE_MOVZX_RM8_TO_R:
+		return opcode_movzx_rm8_to_r (op);
+	case CACHE_MOVZX_RM16_TO_R:
+		return opcode_movzx_rm16_to_r (op);
+	case CACHE_MOVSB:
+		return opcode_movsb (op);
+	case CACHE_MOVS:
+		return opcode_movs (op);
+	case CACHE_STOSB:
+		return opcode_stosb (op);
+	case CACHE_STOS:
+		return opcode_stos (op);
+	}
+	return VMMERR_UNSUPPORTED_OPCODE;
+}
+
+/* The entry has already been keyed and invalidated by the caller. */
+/* The decoded op is saved before execution because handlers may */
+/* modify it. */
+static enum vmmerr
+cache_add_exec (struct cpu_interpreter_cache_entry *e, struct op *op,
+		enum cache_kind kind, struct idata idat)
+{
+	e->kind = kind;
+	e->idat = idat;
+	e->op = *op;
+	e->gen = current->interp.gen;
+	return cache_exec (op, kind, idat);
+}
+
+static enum vmmerr
+mov_mmio (u64 gphys, bool wr, u8 *code, uint codelen)
+{
+	u8 buf[8];
+	ulong cr0, acr, ip, base, tmp;
+	u64 efer, ea, linear;
+	u32 tmp32;
+	bool longmode;
+	uint i, len, mod, reg, rm, sib, displen;
+	u8 rex, opcode, modrm;
+	enum sreg seg;
+	i32 disp;
+	bool ripflag;
+
+	current->vmctl.read_control_reg (CONTROL_REG_CR0, &cr0);
+	current->vmctl.read_msr (MSR_IA32_EFER, &efer);
+	current->vmctl.read_sreg_acr (SREG_CS, &acr);
+	if (!(cr0 & CR0_PE_BIT))
+		return VMMERR_UNSUPPORTED_OPCODE;
+	longmode = (efer & MSR_IA32_EFER_LMA_BIT) && (acr & ACCESS_RIGHTS_L_BIT);
+	if (!longmode && !(acr & ACCESS_RIGHTS_D_B_BIT))
+		return VMMERR_UNSUPPORTED_OPCODE;
+	current->vmctl.read_ip (&ip);
+	if (!code || !codelen) {
+		/* the longest instruction handled here is 8 bytes */
+		current->vmctl.read_sreg_base (SREG_CS, &base);
+		if (read_linearaddr_q (base + ip, buf))
+			return VMMERR_UNSUPPORTED_OPCODE;
+		code = buf;
+		codelen = sizeof buf;
+	} else if (codelen > 8) {
+		codelen = 8;
+	}
+	i = 0;
+	rex = 0;
+	if (longmode && code[i] >= PREFIX_REX_MIN && code[i] <= PREFIX_REX_MAX)
+		rex = code[i++];
+	if (i >= codelen)
+		return VMMERR_UNSUPPORTED_OPCODE;
+	opcode = code[i++];
+	if (opcode != 0x89 && opcode != 0x8B)
+		return VMMERR_UNSUPPORTED_OPCODE;
+	if (wr != (opcode == 0x89))
+		return VMMERR_UNSUPPORTED_OPCODE;
+	if (i >= codelen)
+		return VMMERR_UNSUPPORTED_OPCODE;
+	modrm = code[i++];
+	mod = modrm >> 6;
+	reg = ((modrm >> 3) & 7) | ((rex & 4) ? 8 : 0);
+	rm = modrm & 7;
+	if (mod == 3)
+		return VMMERR_UNSUPPORTED_OPCODE;
+	len = (rex & 8) ? 8 : 4;
+	ea = 0;
+	seg = SREG_DS;
+	ripflag = false;
+	displen = mod == 1 ? 1 : mod == 2 ? 4 : 0;
+	if (rm == 4) {
+		if (i >= codelen)
+			return VMMERR_UNSUPPORTED_OPCODE;
+		sib = code[i++];
+		if ((((sib >> 3) & 7) | ((rex & 2) ? 8 : 0)) != 4) {
+			current->vmctl.read_general_reg
+				(((sib >> 3) & 7) | ((rex & 2) ? 8 : 0), &tmp);
+			ea = (u64)tmp << (sib >> 6);
+		}
+		if ((sib & 7) == 5 && mod == 0) {
+			displen = 4;
+		} else {
+			current->vmctl.read_general_reg
+				((sib & 7) | ((rex & 1) ? 8 : 0), &tmp);
+			ea += tmp;
+			if ((sib & 7) == 4 || (sib & 7) == 5)
+				seg = SREG_SS;
+		}
+	} else if (rm == 5 && mod == 0) {
+		ripflag = longmode;
+		displen = 4;
+	} else {
+		current->vmctl.read_general_reg (rm | ((rex & 1) ? 8 : 0),
+						 &tmp);
+		ea = tmp;
+		if (rm == 5)
+			seg = SREG_SS;
+	}
+	if (i + displen > codelen)
+		return VMMERR_UNSUPPORTED_OPCODE;
+	if (displen == 1)
+		disp = (i8)code[i];
+	else if (displen == 4)
+		disp = code[i] | code[i + 1] << 8 | code[i + 2] << 16 |
+			(u32)code[i + 3] << 24;
+	else
+		disp = 0;
+	i += displen;
+	ea += disp;
+	if (ripflag)
+		ea += ip + i;
+	if (longmode) {
+		linear = ea;
+	} else {
+		current->vmctl.read_sreg_base (seg, &base);
+		linear = (base + ea) & 0xFFFFFFFF;
+	}
+	/* make sure that the access is exactly the one which caused */
+	/* the exit, and that it does not cross a page boundary */
+	if ((linear & PAGESIZE_MASK) != (gphys & PAGESIZE_MASK) ||
+	    (gphys & PAGESIZE_MASK) + len > PAGESIZE)
+		return VMMERR_UNSUPPORTED_OPCODE;
+	if (wr) {
+		current->vmctl.read_general_reg (reg, &tmp);
+		if (len == 8)
+			write_gphys_q (gphys, tmp, 0);
+		else
+			write_gphys_l (gphys, tmp, 0);
+	} else {
+		if (len == 8) {
+			read_gphys_q (gphys, &tmp, 0);
+		} else {
+			read_gphys_l (gphys, &tmp32, 0);
+			tmp = tmp32;
+		}
+		current->vmctl.write_general_reg (reg, tmp);
+	}
+	current->vmctl.write_ip (ip + i);
+	return VMMERR_SUCCESS;
+}
+
+/* Emulate a 32-bit or 64-bit MOV between a general register and */
+/* memory (opcode 89h or 8Bh with an optional REX prefix) which */
+/* caused a nested page fault at gphys.  The instruction bytes given */
+/* by the processor are used if available, otherwise they are */
+/* fetched from CS:RIP.  VMMERR_UNSUPPORTED_OPCODE is returned */
+/* without side effects for any other instruction, and the caller */
+/* should use cpu_interpreter() instead. */
+enum vmmerr
+cpu_interpreter_mov_mmio (u64 gphys, bool wr, u8 *code, uint codelen)
+{
+	enum vmmerr err;
+
+	err = mov_mmio (gphys, wr, code, codelen);
+	if (err == VMMERR_SUCCESS)
+		STATUS_UPDATE (asm_lock_incl (&stat_movcnt));
+	else
+		STATUS_UPDATE (asm_lock_incl (&stat_movfallbackcnt));
+	return err;
+}
+
+void
+cpu_interpreter_flush_cache (void)
+{
+	struct cpu_interpreter_data *d;
+
+	d = &current->interp;
+	if (!d->cache)
+		return;
+	if (!++d->gen) {
+		memset (d->cache, 0, sizeof *d->cache);
+		d->gen = 1;
+	}
+	STATUS_UPDATE (asm_lock_incl (&stat_flushcnt));
+}
+
 enum vmmerr
 cpu_interpreter (void)
 {
@@ -2585,16 +2884,41 @@ cpu_interpreter (void)
 	struct idata idat;
 	ulong cr0;
 	u64 efer;
+	ulong ip, base, cr3, linear, modekey;
+	struct cpu_interpreter_cache_entry *e;
 
 	op = &op1;
 	current->vmctl.read_control_reg (CONTROL_REG_CR0, &cr0);
+	current->vmctl.read_control_reg (CONTROL_REG_CR3, &cr3);
 	current->vmctl.read_msr (MSR_IA32_EFER, &efer);
+	current->vmctl.read_sreg_acr (SREG_CS, &acr);
+	current->vmctl.read_sreg_base (SREG_CS, &base);
+	current->vmctl.read_ip (&ip);
+	linear = base + ip;
+	modekey = (cr0 & CR0_PE_BIT) | (efer & MSR_IA32_EFER_LMA_BIT) |
+		(acr & (ACCESS_RIGHTS_P_BIT | ACCESS_RIGHTS_L_BIT |
+			ACCESS_RIGHTS_D_B_BIT | ACCESS_RIGHTS_UNUSABLE_BIT));
+	e = cache_get (linear);
+	if (cache_hit (e, cr3, linear, modekey)) {
+		STATUS_UPDATE (asm_lock_incl (&stat_hitcnt));
+		*op = e->op;
+		op->ip = ip;
+		if (op->modrm_regaddr)
+			calc_modrm_addr (op);
+		return cache_exec (op, e->kind, e->idat);
+	}
+	STATUS_UPDATE (asm_lock_incl (&stat_misscnt));
+	e->gen = 0;
+	e->cr3 = cr3;
+	e->linear = linear;
+	e->modekey = modekey;
 	if (cr0 & CR0_PE_BIT)
 		op->mode = CPUMODE_PROTECTED;
 	else
 		op->mode = CPUMODE_REAL;
 	op->longmode = false;
-	current->vmctl.read_ip (&op->ip);
+	op->modrm_regaddr = false;
+	op->ip = ip;
 	op->ip_off = 0;
 	READ_NEXT_B (op, &code);
 	clear_prefix (&op->prefix);
@@ -2640,7 +2964,6 @@ cpu_interpreter (void)
 		READ_NEXT_B (op, &code);
 	}
 parse_opcode:
-	current->vmctl.read_sreg_acr (SREG_CS, &acr);
 	if ((efer & MSR_IA32_EFER_LMA_BIT) && (acr & ACCESS_RIGHTS_L_BIT)) {
 		op->longmode = true;
 		if (code >= PREFIX_REX_MIN && code <= PREFIX_REX_MAX) {
@@ -2665,6 +2988,7 @@ parse_opcode:
 		op->addrtype =
 			!op->prefix.addrsize ? ADDRTYPE_16BIT : ADDRTYPE_32BIT;
 	}
+	idat = idata[code];
 	switch (code) {
 	case OPCODE_0x0F:
 		READ_NEXT_B (op, &code);
@@ -2751,21 +3075,20 @@ parse_opcode:
 	case OPCODE_RETF:
 		return opcode_retf (op);
 	case OPCODE_MOVSB:
-		return opcode_movsb (op);
+		return cache_add_exec (e, op, CACHE_MOVSB, idat);
 	case OPCODE_MOVS:
-		return opcode_movs (op);
+		return cache_add_exec (e, op, CACHE_MOVS, idat);
 	case OPCODE_STOSB:
-		return opcode_stosb (op);
+		return cache_add_exec (e, op, CACHE_STOSB, idat);
 	case OPCODE_STOS:
-		return opcode_stos (op);
+		return cache_add_exec (e, op, CACHE_STOS, idat);
 	}
-	idat = idata[code];
 grp_special:
 	switch (idat.type) {
 	case I_MODRM:
 		READ_MODRM_B (op);
 		GET_MODRM (op);
-		return opcode_idata (op, idat);
+		return cache_add_exec (e, op, CACHE_IDATA, idat);
 	case I_MIMM1:
 		READ_MODRM_B (op);
 		GET_MODRM (op);
@@ -2776,7 +3099,7 @@ grp_special:
 		READ_NEXT_B (op, &op->imm);
 		if (idat.len == 2 && (op->imm & 0x80))
 			op->imm |= 0xFFFFFFFFFFFFFF00ULL;
-		return opcode_idata (op, idat);
+		return cache_add_exec (e, op, CACHE_IDATA, idat);
 	case I_MIMM2:
 		READ_MODRM_B (op);
 		GET_MODRM (op);
@@ -2790,10 +3113,10 @@ grp_special:
 			READ_NEXT_L (op, &op->imm);
 		if (op->optype == OPTYPE_64BIT && (op->imm & 0x80000000))
 			op->imm |= 0xFFFFFFFF00000000ULL;
-		return opcode_idata (op, idat);
+		return cache_add_exec (e, op, CACHE_IDATA, idat);
 	case I_MOFFS:
 		RIE (read_moffs (op));
-		return opcode_idata (op, idat);
+		return cache_add_exec (e, op, CACHE_IDATA, idat);
 	case I_MGRP3:
 		READ_MODRM_B (op);
 		GET_MODRM (op);
@@ -2809,7 +3132,7 @@ grp_special:
 			goto grp_imme2;
 		break;
 	case I_NOMOR:
-		return opcode_idata (op, idat);
+		return cache_add_exec (e, op, CACHE_IDATA, idat);
 	case I_ZERO:
 	default:
 		break;
@@ -2849,11 +3172,11 @@ parse_opcode_0x0f:
 	case OPCODE_0x0F_MOVZX_RM8_TO_R:
 		READ_MODRM_B (op);
 		GET_MODRM (op);
-		return opcode_movzx_rm8_to_r (op);
+		return cache_add_exec (e, op, CACHE_MOVZX_RM8_TO_R, idat);
 	case OPCODE_0x0F_MOVZX_RM16_TO_R:
 		READ_MODRM_B (op);
 		GET_MODRM (op);
-		return opcode_movzx_rm16_to_r (op);
+		return cache_add_exec (e, op, CACHE_MOVZX_RM16_TO_R, idat);
 	}
 	if (op->longmode)
 		panic ("64bit instructions begin with 0x0F not supported");
@@ -2918,3 +3241,26 @@ parse_opcode_0x8f:
 	op->ip_off += 16;
 	return VMMERR_UNSUPPORTED_OPCODE;
 }
+
+static char *
+cpu_interpreter_status (void)
+{
+	static char buf[1024];
+
+	snprintf (buf, 1024,
+		  "Interpreter cache:\n"
+		  " Hit: %u Miss: %u Flush: %u\n"
+		  "MMIO MOV fast path:\n"
+		  " Done: %u Fallback: %u\n"
+		  , stat_hitcnt, stat_misscnt, stat_flushcnt
+		  , stat_movcnt, stat_movfallbackcnt);
+	return buf;
+}
+
+static void
+cpu_interpreter_register_status_callback (void)
+{
+	register_status_callback (cpu_interpreter_status);
+}
+
+INITFUNC ("paral01", cpu_interpreter_register_status_callback);
@@ -30,6 +30,7 @@
 #ifndef _CORE_CPU_INTERPRETER_H
 #define _CORE_CPU_INTERPRETER_H
 
+#include "types.h"
 #include "vmmerr.h"
 
 enum cpumode {
@@ -43,6 +44,16 @@ enum optype {
 	OPTYPE_64BIT,
 };
 
+struct cpu_interpreter_cache;
+
+struct cpu_interpreter_data {
+	struct cpu_interpreter_cache *cache;
+	u32 gen;
+};
+
 enum vmmerr cpu_interpreter (void);
+enum vmmerr cpu_interpreter_mov_mmio (u64 gphys, bool wr, u8 *code,
+				      uint codelen);
+void cpu_interpreter_flush_cache (void);
 
 #endif
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2007, 2008 University of Tsukuba
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the University of Tsukuba nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Per-CPU statistics of VM exits.  The time from a VM exit to the */
+/* next VM entry is measured with the TSC and accounted to the reason */
+/* of the exit with a histogram of log2 buckets.  The statistics are */
+/* read by get_status and cleared by the reset_exitstat VMM call. */
+
+#include "asm.h"
+#include "convert.h"
+#include "initfunc.h"
+#include "pcpu.h"
+#include "printf.h"
+#include "stdarg.h"
+#include "string.h"
+#include "vmmcall.h"
+#include "vmmcall_status.h"
+
+struct exitstat_sum {
+	struct exitstat_reason reason[NUM_OF_EXITSTAT];
+	char *buf;
+	int len, size;
+};
+
+static char *exitstat_name[NUM_OF_EXITSTAT] = {
+	"I/O", "MSR", "CPUID", "NPF", "CR", "Exception", "HLT", "Interrupt",
+	"Other",
+};
+
+static u32 exitstat_gen = 0;
+
+#ifdef VMMCALL_STATUS_ENABLE
+static u64
+exitstat_rdtsc (void)
+{
+	u32 tsc_l, tsc_h;
+	u64 tsc;
+
+	asm_rdtsc (&tsc_l, &tsc_h);
+	conv32to64 (tsc_l, tsc_h, &tsc);
+	return tsc;
+}
+#endif
+
+void
+exitstat_vmexit (void)
+{
+#ifdef VMMCALL_STATUS_ENABLE
+	struct exitstat_pcpu_data *d;
+
+	d = &currentcpu->exitstat;
+	d->exit_tsc = exitstat_rdtsc ();
+	d->type = EXITSTAT_OTHER;
+	d->exited = true;
+#endif
+}
+
+void
+exitstat_set_type (enum exitstat_type type)
+{
+#ifdef VMMCALL_STATUS_ENABLE
+	currentcpu->exitstat.type = type;
+#endif
+}
+
+void
+exitstat_vmentry (void)
+{
+#ifdef VMMCALL_STATUS_ENABLE
+	struct exitstat_pcpu_data *d;
+	struct exitstat_reason *r;
+	u64 cycles, tmp;
+	int i;
+
+	d = &currentcpu->exitstat;
+	if (!d->exited)
+		return;
+	d->exited = false;
+	cycles = exitstat_rdtsc () - d->exit_tsc;
+	if (d->gen != exitstat_gen) {
+		memset (d->reason, 0, sizeof d->reason);
+		d->gen = exitstat_gen;
+	}
+	r = &d->reason[d->type];
+	r->count++;
+	r->cycles += cycles;
+	for (i = 0, tmp = cycles; tmp > 1 && i < NUM_OF_EXITSTAT_HIST - 1;
+	     i++)
+		tmp >>= 1;
+	r->hist[i]++;
+#endif
+}
+
+static void
+exitstat_printf (struct exitstat_sum *s, const char *format, ...)
+{
+	va_list ap;
+
+	if (s->len >= s->size)
+		return;
+	va_start (ap, format);
+	s->len += vsnprintf (s->buf + s->len, s->size - s->len, format, ap);
+	va_end (ap);
+}
+
+static bool
+exitstat_sum_pcpu (struct pcpu *p, void *q)
+{
+	struct exitstat_sum *s;
+	struct exitstat_reason *r;
+	int i, j;
+
+	s = q;
+	if (p->exitstat.gen != exitstat_gen)
+		return false;
+	exitstat_printf (s, " CPU%d:", p->cpunum);
+	for (i = 0; i < NUM_OF_EXITSTAT; i++) {
+		r = &p->exitstat.reason[i];
+		if (!r->count)
+			continue;
+		exitstat_printf (s, " %s %llu", exitstat_name[i], r->count);
+		s->reason[i].count += r->count;
+		s->reason[i].cycles += r->cycles;
+		for (j = 0; j < NUM_OF_EXITSTAT_HIST; j++)
+			s->reason[i].hist[j] += r->hist[j];
+	}
+	exitstat_printf (s, "\n");
+	return false;
+}
+
+static char *
+exitstat_status (void)
+{
+	static char buf[4096];
+	static struct exitstat_sum s;
+	struct exitstat_reason *r;
+	int i, j;
+
+	memset (&s, 0, sizeof s);
+	s.buf = buf;
+	s.size = sizeof buf;
+	exitstat_printf (&s, "VM exits:\n");
+	pcpu_list_foreach (exitstat_sum_pcpu, &s);
+	for (i = 0; i < NUM_OF_EXITSTAT; i++) {
+		r = &s.reason[i];
+		if (!r->count)
+			continue;
+		exitstat_printf (&s, " %s: count %llu cycles %llu\n ",
+				 exitstat_name[i], r->count, r->cycles);
+		for (j = 0; j < NUM_OF_EXITSTAT_HIST; j++)
+			if (r->hist[j])
+				exitstat_printf (&s, " 2^%d:%u", j,
+						 r->hist[j]);
+		exitstat_printf (&s, "\n");
+	}
+	return buf;
+}
+
+static void
+reset_exitstat (void)
+{
+	asm_lock_incl (&exitstat_gen);
+}
+
+static void
+exitstat_register_status_callback (void)
+{
+	register_status_callback (exitstat_status);
+}
+
+static void
+exitstat_init_vmmcall (void)
+{
+#ifdef VMMCALL_STATUS_ENABLE
+	vmmcall_register ("reset_exitstat", reset_exitstat);
+#else
+	if (0)
+		reset_exitstat ();	/* supress warnings */
+#endif
+}
+
+INITFUNC ("paral01", exitstat_register_status_callback);
+INITFUNC ("vmmcal0", exitstat_init_vmmcall);
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2007, 2008 University of Tsukuba
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the University of Tsukuba nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _CORE_EXITSTAT_H
+#define _CORE_EXITSTAT_H
+
+#include "types.h"
+
+#define NUM_OF_EXITSTAT_HIST	32
+
+enum exitstat_type {
+	EXITSTAT_IO,
+	EXITSTAT_MSR,
+	EXITSTAT_CPUID,
+	EXITSTAT_NPF,
+	EXITSTAT_CR,
+	EXITSTAT_EXCEPTION,
+	EXITSTAT_HLT,
+	EXITSTAT_INTR,
+	EXITSTAT_OTHER,
+	NUM_OF_EXITSTAT,
+};
+
+struct exitstat_reason {
+	u64 count;
+	u64 cycles;
+	u32 hist[NUM_OF_EXITSTAT_HIST]; /* [log2 (cycles)] */
+};
+
+struct exitstat_pcpu_data {
+	u32 gen;
+	bool exited;
+	enum exitstat_type type;
+	u64 exit_tsc;
+	struct exitstat_reason reason[NUM_OF_EXITSTAT];
+};
+
+void exitstat_vmexit (void);
+void exitstat_set_type (enum exitstat_type type);
+void exitstat_vmentry (void);
+
+#endif
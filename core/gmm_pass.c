@@ -48,6 +48,7 @@ static u64 phys_blank;
 
 static struct gmm_func func = {
 	gmm_pass_gp2hp,
+	gmm_pass_gp2hp_large,
 };
 
 /* translate a guest-physical address to a host-physical address */
@@ -74,6 +75,22 @@ gmm_pass_gp2hp (u64 gp, bool *fakerom)
 	return r;
 }
 
+/* translate a naturally aligned guest-physical range to a host-physical */
+/* address for mapping it with a single large page (for pass-through) */
+/* return value: Host-physical address of the beginning of the range */
+/*   GMM_GP2HP_LARGE_FAIL: the range overlaps the VMM */
+u64
+gmm_pass_gp2hp_large (u64 gp, u64 len)
+{
+	u64 p;
+
+	/* phys_in_vmm() works in 4MiB units */
+	for (p = gp & ~PAGESIZE4M_MASK; p < gp + len; p += PAGESIZE4M)
+		if (phys_in_vmm (p))
+			return GMM_GP2HP_LARGE_FAIL;
+	return gp;
+}
+
 static void
 install_int0x15_hook (void)
 {
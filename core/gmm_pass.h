@@ -33,5 +33,6 @@
 #include "types.h"
 
 u64 gmm_pass_gp2hp (u64 gp, bool *fakerom);
+u64 gmm_pass_gp2hp_large (u64 gp, u64 len);
 
 #endif
@@ -45,19 +45,30 @@
 #include "printf.h"
 #include "spinlock.h"
 #include "string.h"
+#include "vmmcall_status.h"
 
 #define VMMSIZE_ALL		(128 * 1024 * 1024)
 #define NUM_OF_PAGES		(VMMSIZE_ALL >> PAGESIZE_SHIFT)
 #define NUM_OF_ALLOCSIZE	13
 #define MAPMEM_ADDR_START	0xF0000000
 #define MAPMEM_ADDR_END		0xFF000000
-#define NUM_OF_ALLOCLIST	7
+#define MAPWIN_ADDR_START	0xFE000000
+#define MAPWIN_SLOTS		32
+#define MAPWIN_MAXPAGES		4
+#define MAPWIN_SIZE		(MAPWIN_SLOTS * PAGESIZE)
+#define NUM_OF_MAPWIN		((MAPMEM_ADDR_END - MAPWIN_ADDR_START) / \
+				 MAPWIN_SIZE)
+#define MAPMEM_PTE_MASK		(PTE_P_BIT | PTE_RW_BIT | PTE_US_BIT | \
+				 PTE_PWT_BIT | PTE_PCD_BIT | PTE_PAT_BIT)
+#define NUM_OF_ALLOCLIST	MM_NUM_OF_ALLOCLIST
 #define ALLOCLIST_SIZE(n)	((1 << (n)) * 16)
 #define ALLOCLIST_DATABIT(n)	(PAGESIZE / ALLOCLIST_SIZE (n))
 #define ALLOCLIST_DATASIZE(n)	((ALLOCLIST_DATABIT (n) + 7) / 8)
 #define ALLOCLIST_HEADERSIZE(n)	(sizeof (struct allocdata) + \
 				 ALLOCLIST_DATASIZE(n) - 1)
 #define MAXNUM_OF_SYSMEMMAP	256
+#define MAGAZINE_PAGE		NUM_OF_ALLOCLIST
+#define MAGAZINE_BATCH		(MM_MAGAZINE_SIZE / 2)
 
 #ifdef __x86_64__
 #	define PDPE_ATTR		(PDE_P_BIT | PDE_RW_BIT | PDE_US_BIT)
@@ -90,6 +101,19 @@ struct allocdata {
 	u8 n, data[1];
 };
 
+/* A mapping window is a range of MAPWIN_SLOTS pages used by mapmem() */
+/* with MAPMEM_TEMP on one CPU.  unmapmem() only marks the slots free and leaves the */
+/* PTEs, so a buffer mapped again hits the cached PTEs and costs */
+/* neither a PTE write nor an INVLPG. */
+struct mapwin {
+	spinlock_t lock;
+	virt_t base;
+	u32 free;		/* bitmap of free slots */
+	int hand;
+	u64 pte[MAPWIN_SLOTS];	/* PTEs currently written, 0 if none */
+	u32 hit, miss;
+};
+
 struct sysmemmapdata {
 	u32 n, nn;
 	struct sysmemmap m;
@@ -133,10 +157,14 @@ static spinlock_t mm_lock, mm_lock2;
 static spinlock_t mm_lock_process_virt_to_phys;
 static LIST1_DEFINE_HEAD (struct page, list1_freepage[NUM_OF_ALLOCSIZE]);
 static LIST1_DEFINE_HEAD (struct allocdata, alloclist[NUM_OF_ALLOCLIST]);
+static u32 alloclist_pages[NUM_OF_ALLOCLIST];
+static u32 alloclist_used[NUM_OF_ALLOCLIST];
 static int allocsize[NUM_OF_ALLOCSIZE];
 static struct page pagestruct[NUM_OF_PAGES];
 static spinlock_t mapmem_lock;
 static virt_t mapmem_lastvirt;
+static struct mapwin *mapwin_table[NUM_OF_MAPWIN];
+static int mapwin_num;
 static struct sysmemmapdata sysmemmap[MAXNUM_OF_SYSMEMMAP];
 static int sysmemmaplen;
 static u32 realmodemem_base, realmodemem_limit, realmodemem_fakelimit;
@@ -390,8 +418,24 @@ u32 vmm_term_inf()
         return vmm_start_phys+VMMSIZE_ALL ;
 }
 
+/* The magazines are used only by the CPU owning them.  They are */
+/* enabled after the pcpu structure of the CPU is set up. */
+static struct mm_pcpu_data *
+mm_pcpu_data (void)
+{
+	struct mm_pcpu_data *d;
+
+	if (!currentcpu_available ())
+		return NULL;
+	d = &currentcpu->mm;
+	if (!d->enabled)
+		return NULL;
+	return d;
+}
+
+/* call with mm_lock held */
 static struct page *
-mm_page_alloc (int n)
+mm_page_alloc_sub (int n)
 {
 	int s;
 	virt_t virt;
@@ -399,11 +443,8 @@ mm_page_alloc (int n)
 
 	ASSERT (n < NUM_OF_ALLOCSIZE);
 	s = allocsize[n];
-	spinlock_lock (&mm_lock);
 	while ((p = LIST1_POP (list1_freepage[n])) == NULL) {
-		spinlock_unlock (&mm_lock);
-		p = mm_page_alloc (n + 1);
-		spinlock_lock (&mm_lock);
+		p = mm_page_alloc_sub (n + 1);
 		virt = page_to_virt (p);
 		q = virt_to_page (virt ^ s);
 		p->allocsize = n;
@@ -412,19 +453,18 @@ mm_page_alloc (int n)
 		LIST1_ADD (list1_freepage[n], p);
 		LIST1_ADD (list1_freepage[n], q);
 	}
-	spinlock_unlock (&mm_lock);
 	p->type = PAGE_TYPE_ALLOCATED;
 	return p;
 }
 
+/* call with mm_lock held */
 static void
-mm_page_free (struct page *p)
+mm_page_free_sub (struct page *p)
 {
 	int s, n;
 	struct page *q, *tmp;
 	virt_t virt;
 
-	spinlock_lock (&mm_lock);
 	n = p->allocsize;
 	p->type = PAGE_TYPE_FREE;
 	LIST1_ADD (list1_freepage[n], p);
@@ -446,18 +486,82 @@ mm_page_free (struct page *p)
 		s = allocsize[n];
 		virt = page_to_virt (p);
 	}
+}
+
+/* Single pages are served from the per-CPU magazine, which is */
+/* refilled and drained by MAGAZINE_BATCH pages with one lock. */
+/* Pages in a magazine stay PAGE_TYPE_ALLOCATED so that they are not */
+/* merged by the buddy allocator. */
+static struct page *
+mm_page_alloc (int n)
+{
+	struct mm_pcpu_data *d;
+	struct mm_magazine *m;
+	struct page *p;
+
+	if (!n && (d = mm_pcpu_data ())) {
+		m = &d->magazine[MAGAZINE_PAGE];
+		if (!m->count) {
+			spinlock_lock (&mm_lock);
+			while (m->count < MAGAZINE_BATCH)
+				m->obj[m->count++] = mm_page_alloc_sub (0);
+			spinlock_unlock (&mm_lock);
+			d->refill++;
+		}
+		return m->obj[--m->count];
+	}
+	spinlock_lock (&mm_lock);
+	p = mm_page_alloc_sub (n);
 	spinlock_unlock (&mm_lock);
+	return p;
 }
 
-/* returns number of available pages */
+static void
+mm_page_free (struct page *p)
+{
+	struct mm_pcpu_data *d;
+	struct mm_magazine *m;
+
+	if (!p->allocsize && (d = mm_pcpu_data ())) {
+		m = &d->magazine[MAGAZINE_PAGE];
+		if (m->count == MM_MAGAZINE_SIZE) {
+			spinlock_lock (&mm_lock);
+			while (m->count > MM_MAGAZINE_SIZE - MAGAZINE_BATCH)
+				mm_page_free_sub (m->obj[--m->count]);
+			spinlock_unlock (&mm_lock);
+			d->drain++;
+		}
+		m->obj[m->count++] = p;
+		return;
+	}
+	spinlock_lock (&mm_lock);
+	mm_page_free_sub (p);
+	spinlock_unlock (&mm_lock);
+}
+
+static bool
+num_of_available_pages_pcpu (struct pcpu *p, void *q)
+{
+	int *r;
+
+	r = q;
+	if (p->mm.enabled)
+		*r += p->mm.magazine[MAGAZINE_PAGE].count;
+	return false;
+}
+
+/* returns number of available pages, including single pages cached */
+/* in the per-CPU magazines.  The magazines of other CPUs are read */
+/* without locks, so the number is approximate while they are in use. */
 int
 num_of_available_pages (void)
 {
 	int i, r, n;
 	struct page *p;
 
-	spinlock_lock (&mm_lock);
 	r = 0;
+	pcpu_list_foreach (num_of_available_pages_pcpu, &r);
+	spinlock_lock (&mm_lock);
 	for (i = 0; i < NUM_OF_ALLOCSIZE; i++) {
 		n = 0;
 		LIST1_FOREACH (list1_freepage[i], p)
@@ -585,8 +689,11 @@ mm_init_global (void)
 	printf ("VMM will use 0x%08X-0x%08X (%d MiB).\n", vmm_start_phys,
 		vmm_start_phys + VMMSIZE_ALL, VMMSIZE_ALL >> 20);
 	move_vmm ();
-	for (i = 0; i < NUM_OF_ALLOCLIST; i++)
+	for (i = 0; i < NUM_OF_ALLOCLIST; i++) {
 		LIST1_HEAD_INIT (alloclist[i]);
+		alloclist_pages[i] = 0;
+		alloclist_used[i] = 0;
+	}
 	for (i = 0; i < NUM_OF_ALLOCSIZE; i++) {
 		allocsize[i] = 4096 << i;
 		LIST1_HEAD_INIT (list1_freepage[i]);
@@ -612,6 +719,7 @@ mm_init_global (void)
 		mm_page_free (&pagestruct[i]);
 	}
 	mapmem_lastvirt = MAPMEM_ADDR_START;
+	mapwin_num = 0;
 	map_hphys ();
 	unmap_user_area ();	/* for detecting null pointer */
 }
@@ -659,6 +767,7 @@ alloclist_new (int n)
 	r->n = n;
 	for (i = 0; i * ALLOCLIST_SIZE (n) < headlen; i++)
 		r->data[i / 8] |= 1 << (i % 8);
+	alloclist_pages[n]++;
 	return r;
 }
 
@@ -685,6 +794,7 @@ found:
 	ASSERT (offset != 0);
 	ASSERT (offset < PAGESIZE);
 	*r = (u8 *)p + offset;
+	alloclist_used[n]++;
 	return true;
 }
 
@@ -698,16 +808,53 @@ alloclist_free (struct allocdata *p, int n, uint offset)
 	j = bit % 8;
 	ASSERT (p->data[i] & (1 << j));	/* double free check */
 	p->data[i] &= ~(1 << j);
+	alloclist_used[n]--;
+}
+
+/* call with mm_lock2 held */
+static void *
+alloclist_get (int n)
+{
+	struct allocdata *p;
+	void *r;
+
+	for (;;) {
+		p = LIST1_POP (alloclist[n]);
+		if (p == NULL)
+			p = alloclist_new (n);
+		if (alloclist_alloc (p, n, &r))
+			break;
+		p->n |= 0x80;
+	}
+	LIST1_PUSH (alloclist[n], p);
+	return r;
+}
+
+/* call with mm_lock2 held */
+static void
+alloclist_put (void *virt)
+{
+	struct allocdata *p;
+
+	p = (struct allocdata *)((virt_t)virt & ~PAGESIZE_MASK);
+	if (p->n & 0x80) {
+		p->n &= ~0x80;
+		LIST1_PUSH (alloclist[p->n], p);
+	}
+	alloclist_free (p, p->n, (virt_t)virt & PAGESIZE_MASK);
 }
 
 /* allocate n bytes */
-/* FIXME: bad implementation */
+/* Small objects are served from the per-CPU magazine of the size */
+/* class, which is refilled and drained by MAGAZINE_BATCH objects with */
+/* one lock. */
 void *
 alloc (uint len)
 {
 	void *r;
 	int i;
-	struct allocdata *p;
+	struct mm_pcpu_data *d;
+	struct mm_magazine *m;
 
 	for (i = 0; i < NUM_OF_ALLOCLIST; i++) {
 		if (len <= ALLOCLIST_SIZE (i))
@@ -717,16 +864,20 @@ alloc (uint len)
 	alloc_pages (&r, NULL, (len + 4095) / 4096);
 	return r;
 found:
-	spinlock_lock (&mm_lock2);
-	for (;;) {
-		p = LIST1_POP (alloclist[i]);
-		if (p == NULL)
-			p = alloclist_new (i);
-		if (alloclist_alloc (p, i, &r))
-			break;
-		p->n |= 0x80;
+	d = mm_pcpu_data ();
+	if (d) {
+		m = &d->magazine[i];
+		if (!m->count) {
+			spinlock_lock (&mm_lock2);
+			while (m->count < MAGAZINE_BATCH)
+				m->obj[m->count++] = alloclist_get (i);
+			spinlock_unlock (&mm_lock2);
+			d->refill++;
+		}
+		return m->obj[--m->count];
 	}
-	LIST1_PUSH (alloclist[i], p);
+	spinlock_lock (&mm_lock2);
+	r = alloclist_get (i);
 	spinlock_unlock (&mm_lock2);
 	return r;
 }
@@ -753,6 +904,8 @@ void
 free (void *virt)
 {
 	struct allocdata *p;
+	struct mm_pcpu_data *d;
+	struct mm_magazine *m;
 	uint offset;
 
 	offset = (virt_t)virt & PAGESIZE_MASK;
@@ -760,13 +913,22 @@ free (void *virt)
 		mm_page_free (virt_to_page ((virt_t)virt));
 		return;
 	}
-	spinlock_lock (&mm_lock2);
-	p = (struct allocdata *)((virt_t)virt & ~PAGESIZE_MASK);
-	if (p->n & 0x80) {
-		p->n &= ~0x80;
-		LIST1_PUSH (alloclist[p->n], p);
+	d = mm_pcpu_data ();
+	if (d) {
+		p = (struct allocdata *)((virt_t)virt & ~PAGESIZE_MASK);
+		m = &d->magazine[p->n & ~0x80];
+		if (m->count == MM_MAGAZINE_SIZE) {
+			spinlock_lock (&mm_lock2);
+			while (m->count > MM_MAGAZINE_SIZE - MAGAZINE_BATCH)
+				alloclist_put (m->obj[--m->count]);
+			spinlock_unlock (&mm_lock2);
+			d->drain++;
+		}
+		m->obj[m->count++] = virt;
+		return;
 	}
-	alloclist_free (p, p->n, offset);
+	spinlock_lock (&mm_lock2);
+	alloclist_put (virt);
 	spinlock_unlock (&mm_lock2);
 }
 
@@ -1017,10 +1179,10 @@ phys_in_vmm (u64 phys)
 void
 mm_force_unlock (void)
 {
-	spinlock_unlock (&mm_lock);
-	spinlock_unlock (&mm_lock2);
-	spinlock_unlock (&mm_lock_process_virt_to_phys);
-	spinlock_unlock (&mapmem_lock);
+	spinlock_init (&mm_lock);
+	spinlock_init (&mm_lock2);
+	spinlock_init (&mm_lock_process_virt_to_phys);
+	spinlock_init (&mapmem_lock);
 }
 
 /*** process ***/
@@ -1931,7 +2093,7 @@ mapmem_alloc (pmap_t *m, uint offset, uint len)
 	v = mapmem_lastvirt;
 retry:
 	for (i = 0; i < n; i++) {
-		if (v + (i << PAGESIZE_SHIFT) >= MAPMEM_ADDR_END) {
+		if (v + (i << PAGESIZE_SHIFT) >= MAPWIN_ADDR_START) {
 			v = MAPMEM_ADDR_START;
 			loopcount++;
 			ASSERT (loopcount == 1);
@@ -1954,12 +2116,40 @@ retry:
 	return (void *)(v + offset);
 }
 
+/* make a PTE for the page at p */
+static bool
+mapmem_pte (int flags, u64 p, u64 *r)
+{
+	u64 pte;
+	bool fakerom;
+
+	if (flags & MAPMEM_HPHYS) {
+		pte = p | PTE_P_BIT;
+	} else if (flags & MAPMEM_GPHYS) {
+		pte = current->gmm.gp2hp (p, &fakerom);
+		if (fakerom && (flags & MAPMEM_WRITE))
+			return true;
+		pte = (pte & ~PAGESIZE_MASK) | PTE_P_BIT;
+	} else {
+		return true;
+	}
+	if (flags & MAPMEM_WRITE)
+		pte |= PTE_RW_BIT;
+	if (flags & MAPMEM_PWT)
+		pte |= PTE_PWT_BIT;
+	if (flags & MAPMEM_PCD)
+		pte |= PTE_PCD_BIT;
+	if (flags & MAPMEM_PAT)
+		pte |= PTE_PAT_BIT;
+	*r = pte;
+	return false;
+}
+
 static bool
 mapmem_domap (pmap_t *m, void *virt, int flags, u64 physaddr, uint len)
 {
 	virt_t v;
 	u64 p, pte;
-	bool fakerom;
 	uint n, i, offset;
 
 	offset = physaddr & PAGESIZE_MASK;
@@ -1968,33 +2158,180 @@ mapmem_domap (pmap_t *m, void *virt, int flags, u64 physaddr, uint len)
 	p = physaddr & ~PAGESIZE_MASK;
 	for (i = 0; i < n; i++) {
 		pmap_seek (m, v + (i << PAGESIZE_SHIFT), 1);
-		if (flags & MAPMEM_HPHYS) {
-			pte = (p + (i << PAGESIZE_SHIFT)) | PTE_P_BIT;
-		} else if (flags & MAPMEM_GPHYS) {
-			pte = current->gmm.gp2hp (p + (i << PAGESIZE_SHIFT),
-						  &fakerom);
-			if (fakerom && (flags & MAPMEM_WRITE))
-				return true;
-			pte = (pte & ~PAGESIZE_MASK) | PTE_P_BIT;
-		} else {
+		if (mapmem_pte (flags, p + (i << PAGESIZE_SHIFT), &pte))
 			return true;
-		}
-		if (flags & MAPMEM_WRITE)
-			pte |= PTE_RW_BIT;
-		if (flags & MAPMEM_PWT)
-			pte |= PTE_PWT_BIT;
-		if (flags & MAPMEM_PCD)
-			pte |= PTE_PCD_BIT;
-		if (flags & MAPMEM_PAT)
-			pte |= PTE_PAT_BIT;
 		ASSERT (pmap_read (m) & PTE_P_BIT);
-		pmap_write (m, pte, PTE_P_BIT | PTE_RW_BIT | PTE_US_BIT |
-			    PTE_PWT_BIT | PTE_PCD_BIT | PTE_PAT_BIT);
+		pmap_write (m, pte, MAPMEM_PTE_MASK);
 		asm_invlpg ((void *)(v + (i << PAGESIZE_SHIFT)));
 	}
 	return false;
 }
 
+static struct mapwin *
+mapwin_new (void)
+{
+	struct mapwin *w;
+	pmap_t m;
+	ulong hostcr3;
+	int i;
+
+	spinlock_lock (&mapmem_lock);
+	if (mapwin_num >= NUM_OF_MAPWIN) {
+		spinlock_unlock (&mapmem_lock);
+		return NULL;
+	}
+	w = alloc (sizeof *w);
+	spinlock_init (&w->lock);
+	w->base = MAPWIN_ADDR_START + mapwin_num * MAPWIN_SIZE;
+	w->free = ~0U;
+	w->hand = 0;
+	w->hit = 0;
+	w->miss = 0;
+	asm_rdcr3 (&hostcr3);
+	pmap_open_vmm (&m, hostcr3, PMAP_LEVELS);
+	for (i = 0; i < MAPWIN_SLOTS; i++) {
+		w->pte[i] = 0;
+		pmap_seek (&m, w->base + (i << PAGESIZE_SHIFT), 1);
+		pmap_autoalloc (&m);
+	}
+	pmap_close (&m);
+	mapwin_table[mapwin_num++] = w;
+	spinlock_unlock (&mapmem_lock);
+	return w;
+}
+
+/* Look for n free slots already mapping the PTEs first, and then for */
+/* n free slots starting from the hand so that recently used slots */
+/* stay cached as long as possible. */
+static int
+mapwin_find (struct mapwin *w, uint n, u64 *pte)
+{
+	u32 mask;
+	uint i, j, k;
+
+	mask = (1U << n) - 1;
+	for (i = 0; i + n <= MAPWIN_SLOTS; i++) {
+		if ((w->free & (mask << i)) != (mask << i))
+			continue;
+		for (j = 0; j < n; j++)
+			if (w->pte[i + j] != pte[j])
+				break;
+		if (j == n) {
+			w->hit++;
+			return i;
+		}
+	}
+	w->miss++;
+	for (k = 0; k < MAPWIN_SLOTS; k++) {
+		i = (w->hand + k) % MAPWIN_SLOTS;
+		if (i + n > MAPWIN_SLOTS)
+			continue;
+		if ((w->free & (mask << i)) == (mask << i)) {
+			w->hand = (i + n) % MAPWIN_SLOTS;
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* The PTEs of a window are written only by the CPU owning it. */
+/* Threads moving to another CPU flush the TLB with */
+/* mapmem_thread_migrated(). */
+static void *
+mapwin_map (int flags, u64 physaddr, uint len)
+{
+	struct mm_pcpu_data *d;
+	struct mapwin *w;
+	u64 pte[MAPWIN_MAXPAGES], p;
+	virt_t v;
+	pmap_t m;
+	ulong hostcr3;
+	uint n, i, offset;
+	int slot;
+
+	d = mm_pcpu_data ();
+	if (!d || !d->mapwin)
+		return NULL;
+	w = d->mapwin;
+	offset = physaddr & PAGESIZE_MASK;
+	n = (offset + len + PAGESIZE_MASK) >> PAGESIZE_SHIFT;
+	if (n > MAPWIN_MAXPAGES)
+		return NULL;
+	p = physaddr & ~PAGESIZE_MASK;
+	for (i = 0; i < n; i++) {
+		if (mapmem_pte (flags, p + (i << PAGESIZE_SHIFT), &pte[i]))
+			return NULL;
+		/* pmap_write() sets the A and D bits */
+		pte[i] |= PTE_A_BIT | PTE_D_BIT;
+	}
+	spinlock_lock (&w->lock);
+	slot = mapwin_find (w, n, pte);
+	if (slot < 0) {
+		spinlock_unlock (&w->lock);
+		return NULL;
+	}
+	w->free &= ~(((1U << n) - 1) << slot);
+	spinlock_unlock (&w->lock);
+	v = w->base + (slot << PAGESIZE_SHIFT);
+	for (i = 0; i < n; i++)
+		if (w->pte[slot + i] != pte[i])
+			goto write;
+	return (void *)(v + offset);
+write:
+	asm_rdcr3 (&hostcr3);
+	pmap_open_vmm (&m, hostcr3, PMAP_LEVELS);
+	for (i = 0; i < n; i++) {
+		if (w->pte[slot + i] == pte[i])
+			continue;
+		pmap_seek (&m, v + (i << PAGESIZE_SHIFT), 1);
+		pmap_write (&m, pte[i], MAPMEM_PTE_MASK);
+		if (w->pte[slot + i])
+			asm_invlpg ((void *)(v + (i << PAGESIZE_SHIFT)));
+		w->pte[slot + i] = pte[i];
+	}
+	pmap_close (&m);
+	return (void *)(v + offset);
+}
+
+static void
+mapwin_unmap (void *virt, uint len)
+{
+	struct mm_pcpu_data *d;
+	struct mapwin *w;
+	virt_t v;
+	uint n, i, offset, slot;
+
+	v = (virt_t)virt - MAPWIN_ADDR_START;
+	w = mapwin_table[v / MAPWIN_SIZE];
+	ASSERT (w);
+	slot = (v % MAPWIN_SIZE) >> PAGESIZE_SHIFT;
+	offset = (virt_t)virt & PAGESIZE_MASK;
+	n = (offset + len + PAGESIZE_MASK) >> PAGESIZE_SHIFT;
+	ASSERT (slot + n <= MAPWIN_SLOTS);
+	d = mm_pcpu_data ();
+	if (!d || d->mapwin != w)
+		for (i = 0; i < n; i++)
+			asm_invlpg ((void *)(w->base +
+					     ((slot + i) << PAGESIZE_SHIFT)));
+	spinlock_lock (&w->lock);
+	w->free |= ((1U << n) - 1) << slot;
+	spinlock_unlock (&w->lock);
+}
+
+/* A thread may use mappings of windows of other CPUs which it made */
+/* before moving.  Their PTEs may have been changed since this CPU */
+/* used them last time, so flush the TLB. */
+void
+mapmem_thread_migrated (void)
+{
+	ulong cr3;
+
+	if (!mapwin_num)
+		return;
+	asm_rdcr3 (&cr3);
+	asm_wrcr3 (cr3);
+}
+
 void
 unmapmem (void *virt, uint len)
 {
@@ -2006,6 +2343,10 @@ unmapmem (void *virt, uint len)
 	if ((virt_t)virt < MAPMEM_ADDR_START ||
 	    (virt_t)virt >= MAPMEM_ADDR_END)
 		return;
+	if ((virt_t)virt >= MAPWIN_ADDR_START) {
+		mapwin_unmap (virt, len);
+		return;
+	}
 	spinlock_lock (&mapmem_lock);
 	asm_rdcr3 (&hostcr3);
 	pmap_open_vmm (&m, hostcr3, PMAP_LEVELS);
@@ -2044,6 +2385,15 @@ mapmem (int flags, u64 physaddr, uint len)
 	}
 	return NULL;
 skip:
+	/* The windows are only for short-lived mappings.  A mapping */
+	/* kept for a long time may be used by threads on other CPUs, */
+	/* which never flush the TLB entries of the window. */
+	if ((flags & MAPMEM_TEMP) &&
+	    !(flags & (MAPMEM_PWT | MAPMEM_PCD | MAPMEM_PAT))) {
+		r = mapwin_map (flags, physaddr, len);
+		if (r)
+			return r;
+	}
 	asm_rdcr3 (&hostcr3);
 	pmap_open_vmm (&m, hostcr3, PMAP_LEVELS);
 	r = mapmem_alloc (&m, physaddr & PAGESIZE_MASK, len);
@@ -2083,5 +2433,107 @@ mm_flush_wb_cache (void)
 	asm_wbinvd ();		/* write back all caches */
 }
 
+static void
+mm_init_pcpu (void)
+{
+	struct mm_pcpu_data *d;
+	int i;
+
+	d = &currentcpu->mm;
+	for (i = 0; i < MM_NUM_OF_MAGAZINE; i++)
+		d->magazine[i].count = 0;
+	d->refill = 0;
+	d->drain = 0;
+	d->enabled = true;
+	d->mapwin = mapwin_new ();
+}
+
+#ifdef VMMCALL_STATUS_ENABLE
+struct mm_status_sum {
+	u32 cached[MM_NUM_OF_MAGAZINE];
+	u32 refill, drain;
+};
+
+static bool
+mm_status_sum_pcpu (struct pcpu *p, void *q)
+{
+	struct mm_status_sum *s;
+	int i;
+
+	s = q;
+	for (i = 0; i < MM_NUM_OF_MAGAZINE; i++)
+		s->cached[i] += p->mm.magazine[i].count;
+	s->refill += p->mm.refill;
+	s->drain += p->mm.drain;
+	return false;
+}
+
+/* Occupancy of each size class is the number of objects handed out, */
+/* including objects cached in the magazines, against the capacity of */
+/* the pages of the class.  Fragmentation of the buddy allocator is */
+/* shown by free blocks per order and the largest free block. */
+static char *
+mm_status (void)
+{
+	static char buf[1024];
+	struct mm_status_sum sum;
+	struct page *p;
+	int i, n, len, freepages, largest;
+	u32 hit, miss;
+
+	memset (&sum, 0, sizeof sum);
+	pcpu_list_foreach (mm_status_sum_pcpu, &sum);
+	len = snprintf (buf, sizeof buf, "Heap: refill %u drain %u\n",
+			sum.refill, sum.drain);
+	spinlock_lock (&mm_lock2);
+	for (i = 0; i < NUM_OF_ALLOCLIST; i++) {
+		n = ALLOCLIST_DATABIT (i) - (ALLOCLIST_HEADERSIZE (i) +
+					     ALLOCLIST_SIZE (i) - 1) /
+			ALLOCLIST_SIZE (i);
+		len += snprintf (buf + len, sizeof buf - len,
+				 " %4d: pages %u used %u/%u cached %u\n",
+				 ALLOCLIST_SIZE (i), alloclist_pages[i],
+				 alloclist_used[i], alloclist_pages[i] * n,
+				 sum.cached[i]);
+	}
+	spinlock_unlock (&mm_lock2);
+	len += snprintf (buf + len, sizeof buf - len,
+			 " page: cached %u\nFree blocks:",
+			 sum.cached[MAGAZINE_PAGE]);
+	freepages = 0;
+	largest = 0;
+	spinlock_lock (&mm_lock);
+	for (i = 0; i < NUM_OF_ALLOCSIZE; i++) {
+		n = 0;
+		LIST1_FOREACH (list1_freepage[i], p)
+			n++;
+		if (n)
+			largest = allocsize[i] >> PAGESIZE_SHIFT;
+		freepages += n * (allocsize[i] >> PAGESIZE_SHIFT);
+		len += snprintf (buf + len, sizeof buf - len, " %d", n);
+	}
+	spinlock_unlock (&mm_lock);
+	len += snprintf (buf + len, sizeof buf - len,
+			 "\n free pages %d largest %d\n", freepages, largest);
+	hit = miss = 0;
+	for (i = 0; i < mapwin_num; i++) {
+		hit += mapwin_table[i]->hit;
+		miss += mapwin_table[i]->miss;
+	}
+	snprintf (buf + len, sizeof buf - len,
+		  "Mapping windows: %d hit %u miss %u\n", mapwin_num, hit,
+		  miss);
+	return buf;
+}
+
+static void
+mm_register_status_callback (void)
+{
+	register_status_callback (mm_status);
+}
+
+INITFUNC ("paral01", mm_register_status_callback);
+#endif
 INITFUNC ("global2", mm_init_global);
+INITFUNC ("pcpu0", mm_init_pcpu);
 INITFUNC ("ap0", unmap_user_area);
@@ -46,6 +46,12 @@
 
 #define VMM_START_VIRT			0x40000000
 
+/* Per-CPU caches of free objects for each alloc() size class, and one */
+/* for single pages */
+#define MM_NUM_OF_ALLOCLIST		7
+#define MM_MAGAZINE_SIZE		32
+#define MM_NUM_OF_MAGAZINE		(MM_NUM_OF_ALLOCLIST + 1)
+
 enum pmap_type {
 	PMAP_TYPE_VMM,
 	PMAP_TYPE_GUEST,
@@ -62,6 +68,20 @@ typedef struct {
 	enum pmap_type type;
 } pmap_t;
 
+struct mapwin;
+
+struct mm_magazine {
+	int count;
+	void *obj[MM_MAGAZINE_SIZE];
+};
+
+struct mm_pcpu_data {
+	bool enabled;
+	struct mm_magazine magazine[MM_NUM_OF_MAGAZINE];
+	u32 refill, drain;
+	struct mapwin *mapwin;
+};
+
 extern u16 e801_fake_ax, e801_fake_bx;
 extern bool use_pae;
 extern u64 memorysize, vmmsize;
@@ -74,6 +94,7 @@ u32 getsysmemmap (u32 n, u64 *base, u64 *len, u32 *type);
 u32 getfakesysmemmap (u32 n, u64 *base, u64 *len, u32 *type);
 void mm_flush_wb_cache (void);
 void mm_force_unlock (void);
+void mapmem_thread_migrated (void);
 
 /* process */
 int mm_process_alloc (phys_t *phys);
@@ -42,6 +42,8 @@
 #include "string.h"
 #include "vmmerr.h"
 
+#define NUM_OF_BMPPAGES		(0x100000000ULL >> PAGESIZE_SHIFT)
+
 struct call_flush_tlb_data {
 	struct vcpu *vcpu0;
 	phys_t start;
@@ -102,39 +104,104 @@ mmio_gphys_access (phys_t gphysaddr, bool wr, void *buf, uint len, u32 flags)
 	unmapmem (p, len);
 }
 
+/* returns the index of the first handle which ends at or after gphys */
+static int
+search (struct mmio_data *m, phys_t gphys)
+{
+	int lo, hi, mid;
+	struct mmio_handle *h;
+
+	lo = 0;
+	hi = m->n;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		h = m->handle[mid];
+		if (h->gphys + (h->len - 1) < gphys)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* returns false if no handlers are registered in the page */
+static bool
+page_maybe_handled (struct mmio_data *m, phys_t gphys)
+{
+	u64 pfn;
+
+	pfn = gphys >> PAGESIZE_SHIFT;
+	if (pfn >= NUM_OF_BMPPAGES)
+		return true;
+	return !!(m->pagebmp[pfn >> 3] & (1 << (pfn & 7)));
+}
+
+static bool
+range_maybe_handled (struct mmio_data *m, phys_t gphys, uint len)
+{
+	phys_t end;
+
+	end = gphys + len - 1;
+	for (gphys &= ~PAGESIZE_MASK; gphys <= end; gphys += PAGESIZE)
+		if (page_maybe_handled (m, gphys))
+			return true;
+	return false;
+}
+
+static void
+update_pagebmp (struct mmio_data *m, phys_t gphys, uint len, bool set)
+{
+	phys_t end;
+	u64 pfn;
+	int i;
+
+	end = gphys + len - 1;
+	for (gphys &= ~PAGESIZE_MASK; gphys <= end; gphys += PAGESIZE) {
+		pfn = gphys >> PAGESIZE_SHIFT;
+		if (pfn >= NUM_OF_BMPPAGES)
+			break;
+		if (set) {
+			m->pagebmp[pfn >> 3] |= 1 << (pfn & 7);
+			continue;
+		}
+		/* another handler may be in the same page */
+		i = search (m, gphys);
+		if (i < m->n && m->handle[i]->gphys <= (gphys | PAGESIZE_MASK))
+			continue;
+		m->pagebmp[pfn >> 3] &= ~(1 << (pfn & 7));
+	}
+}
+
 int
 mmio_access_memory (phys_t gphysaddr, bool wr, void *buf, uint len, u32 f)
 {
-	struct mmio_list *p;
+	struct mmio_data *m;
 	struct mmio_handle *h;
 	int i, r;
 	phys_t gphys2;
 	uint len2, tmp;
 	u8 *q;
 
-	if (gphysaddr <= 0xFFFFFFFFULL)
-		i = gphysaddr >> 28;
-	else
-		i = 16;
+	m = &current->vcpu0->mmio;
+	if (!len || !range_maybe_handled (m, gphysaddr, len))
+		return 0;
 	q = buf;
 	r = 0;
-	LIST1_FOREACH (current->vcpu0->mmio.mmio[i], p) {
-		if (!len)
+	for (i = search (m, gphysaddr); i < m->n && len; i++) {
+		h = m->handle[i];
+		if (!rangecheck (h, gphysaddr, len, &gphys2, &len2))
 			break;
-		h = p->handle;
-		if (rangecheck (h, gphysaddr, len, &gphys2, &len2)) {
-			r = 1;
-			tmp = gphys2 - gphysaddr;
-			mmio_gphys_access (gphysaddr, wr, q, tmp, f);
-			gphysaddr += tmp;
-			q += tmp;
-			len -= tmp;
-			if (!h->handler (h->data, gphysaddr, wr, q, len2, f))
-				mmio_gphys_access (gphysaddr, wr, q, len2, f);
-			gphysaddr += len2;
-			q += len2;
-			len -= len2;
-		}
+		r = 1;
+		tmp = gphys2 - gphysaddr;
+		mmio_gphys_access (gphysaddr, wr, q, tmp, f);
+		gphysaddr += tmp;
+		q += tmp;
+		len -= tmp;
+		if (!h->handler (h->data, gphysaddr, wr, q, len2, f))
+			mmio_gphys_access (gphysaddr, wr, q, len2, f);
+		gphysaddr += len2;
+		q += len2;
+		len -= len2;
 	}
 	if (r)
 		mmio_gphys_access (gphysaddr, wr, q, len, f);
@@ -145,83 +212,57 @@ int
 mmio_access_page (phys_t gphysaddr, bool emulation)
 {
 	enum vmmerr e;
-	struct mmio_list *p;
-	struct mmio_handle *h;
+	struct mmio_data *m;
 	int i;
 
+	m = &current->vcpu0->mmio;
 	gphysaddr &= ~PAGESIZE_MASK;
-	if (gphysaddr <= 0xFFFFFFFFULL)
-		i = gphysaddr >> 28;
-	else
-		i = 16;
-	LIST1_FOREACH (current->vcpu0->mmio.mmio[i], p) {
-		h = p->handle;
-		if (rangecheck (h, gphysaddr, PAGESIZE, NULL, NULL)) {
-			if (!emulation)
-				return 1;
-			e = cpu_interpreter ();
-			if (e == VMMERR_SUCCESS)
-				return 1;
-			panic ("Fatal error: MMIO access error %d", e);
-		}
+	if (!page_maybe_handled (m, gphysaddr))
+		return 0;
+	i = search (m, gphysaddr);
+	if (i < m->n &&
+	    rangecheck (m->handle[i], gphysaddr, PAGESIZE, NULL, NULL)) {
+		if (!emulation)
+			return 1;
+		e = cpu_interpreter ();
+		if (e == VMMERR_SUCCESS)
+			return 1;
+		panic ("Fatal error: MMIO access error %d", e);
 	}
 	return 0;
 }
 
-static void
-add (int i, void *handle)
-{
-	struct mmio_list *p, *d;
-	struct mmio_handle *h;
-	phys_t gphys;
-
-	h = handle;
-	gphys = h->gphys;
-	LIST1_FOREACH (current->vcpu0->mmio.mmio[i], d) {
-		h = d->handle;
-		if (h->gphys > gphys)
-			break;
-	}
-	p = alloc (sizeof *p);
-	ASSERT (p);
-	p->handle = handle;
-	LIST1_INSERT (current->vcpu0->mmio.mmio[i], d, p);
-}
-
-static void
-del (int i, void *handle)
+/* handle a simple MOV which caused a nested page fault in an MMIO */
+/* page without the instruction interpreter */
+/* returns 0 if the fault must be handled as usual */
+int
+mmio_access_page_fast (phys_t gphysaddr, bool wr, u8 *code, uint codelen)
 {
-	struct mmio_list *p;
+	int r;
 
-	LIST1_FOREACH (current->vcpu0->mmio.mmio[i], p) {
-		if (p->handle == handle)
-			goto found;
-	}
-	return;
-found:
-	LIST1_DEL (current->vcpu0->mmio.mmio[i], p);
-	free (p);
+	r = 0;
+	mmio_lock ();
+	if (mmio_access_page (gphysaddr, false) &&
+	    cpu_interpreter_mov_mmio (gphysaddr, wr, code, codelen) ==
+	    VMMERR_SUCCESS)
+		r = 1;
+	mmio_unlock ();
+	return r;
 }
 
-static void
-scan (phys_t gphys, uint len, void (*func) (int i, void *data), void *data)
+/* return 1 if any MMIO handler is registered in the range */
+/* mmio_lock() must be held */
+int
+mmio_range (phys_t gphys, uint len)
 {
-	int i, s, e;
-	phys_t end;
+	struct mmio_data *m;
+	int i;
 
-	end = gphys + len - 1;
-	end |= 0x0FFFFFFFULL;
-	gphys &= ~0x0FFFFFFFULL;
-	if (gphys <= 0xFFFFFFFFULL)
-		s = gphys >> 28;
-	else
-		s = 16;
-	if (end <= 0xFFFFFFFFULL)
-		e = end >> 28;
-	else
-		e = 16;
-	for (i = s; i <= e; i++)
-		func (i, data);
+	m = &current->vcpu0->mmio;
+	i = search (m, gphys);
+	if (i < m->n && m->handle[i]->gphys <= gphys + (len - 1))
+		return 1;
+	return 0;
 }
 
 static bool
@@ -276,26 +317,36 @@ flush_tlb_entry (phys_t gpst, phys_t gpend)
 void *
 mmio_register (phys_t gphys, uint len, mmio_handler_t handler, void *data)
 {
+	struct mmio_data *m;
 	struct mmio_handle *p;
+	int i, j;
 
 	rw_spinlock_lock_ex (&mmio_rwlock);
-	LIST1_FOREACH (current->vcpu0->mmio.handle, p) {
-		if (rangecheck (p, gphys, len, NULL, NULL))
-			goto fail;
-	}
+	m = &current->vcpu0->mmio;
+	i = search (m, gphys);
+	if (i < m->n && rangecheck (m->handle[i], gphys, len, NULL, NULL))
+		goto fail;
 	if (flush_tlb_entry (gphys, gphys + len - 1)) {
 		printf ("%s: flush_tlb_entry(0x%llX, 0x%llX) failed\n"
 			, __func__, gphys, gphys + len - 1);
 		goto fail;
 	}
+	if (m->n == m->max) {
+		m->max = m->max ? m->max * 2 : 16;
+		m->handle = realloc (m->handle, m->max * sizeof *m->handle);
+		ASSERT (m->handle);
+	}
 	p = alloc (sizeof *p);
 	ASSERT (p);
 	p->gphys = gphys;
 	p->len = len;
 	p->data = data;
 	p->handler = handler;
-	LIST1_ADD (current->vcpu0->mmio.handle, p);
-	scan (gphys, len, add, p);
+	for (j = m->n; j > i; j--)
+		m->handle[j] = m->handle[j - 1];
+	m->handle[i] = p;
+	m->n++;
+	update_pagebmp (m, gphys, len, true);
 ret:
 	rw_spinlock_unlock_ex (&mmio_rwlock);
 	return p;
@@ -307,12 +358,18 @@ fail:
 void
 mmio_unregister (void *handle)
 {
+	struct mmio_data *m;
 	struct mmio_handle *p;
+	int i;
 
 	rw_spinlock_lock_ex (&mmio_rwlock);
+	m = &current->vcpu0->mmio;
 	p = handle;
-	LIST1_DEL (current->vcpu0->mmio.handle, p);
-	scan (p->gphys, p->len, del, p);
+	i = search (m, p->gphys);
+	ASSERT (i < m->n && m->handle[i] == p);
+	for (m->n--; i < m->n; i++)
+		m->handle[i] = m->handle[i + 1];
+	update_pagebmp (m, p->gphys, p->len, false);
 	free (p);
 	rw_spinlock_unlock_ex (&mmio_rwlock);
 }
@@ -376,12 +433,13 @@ mmio_debug (void)
 static void
 mmio_init (void)
 {
-	int i;
-
 	rw_spinlock_init (&mmio_rwlock);
-	LIST1_HEAD_INIT (current->mmio.handle);
-	for (i = 0; i < 17; i++)
-		LIST1_HEAD_INIT (current->mmio.mmio[i]);
+	current->mmio.handle = NULL;
+	current->mmio.n = 0;
+	current->mmio.max = 0;
+	current->mmio.pagebmp = alloc (NUM_OF_BMPPAGES / 8);
+	ASSERT (current->mmio.pagebmp);
+	memset (current->mmio.pagebmp, 0, NUM_OF_BMPPAGES / 8);
 }
 
 INITFUNC ("vcpu0", mmio_init);
@@ -31,29 +31,27 @@
 #define _CORE_MMIO_H
 
 #include <core/mmio.h>
-#include "list.h"
+#include "types.h"
 
 struct mmio_handle {
-	LIST1_DEFINE (struct mmio_handle);
 	phys_t gphys;
 	uint len;
 	void *data;
 	mmio_handler_t handler;
 };
 
-struct mmio_list {
-	LIST1_DEFINE (struct mmio_list);
-	void *handle;
-};
-
 struct mmio_data {
-	LIST1_DEFINE_HEAD (struct mmio_list, mmio[17]);
-	LIST1_DEFINE_HEAD (struct mmio_handle, handle);
+	struct mmio_handle **handle; /* sorted by address, no overlaps */
+	int n, max;
+	u8 *pagebmp;		/* pages below 4GiB which have handlers */
 };
 
 int mmio_access_memory (phys_t gphysaddr, bool wr, void *buf, uint len,
 			u32 flags);
 int mmio_access_page (phys_t gphysaddr, bool emulation);
+int mmio_access_page_fast (phys_t gphysaddr, bool wr, u8 *code,
+			   uint codelen);
+int mmio_range (phys_t gphys, uint len);
 void mmio_lock (void);
 void mmio_unlock (void);
 
@@ -33,11 +33,14 @@
 #include "asm.h"
 #include "cache.h"
 #include "desc.h"
+#include "exitstat.h"
+#include "mm.h"
 #include "panic.h"
 #include "seg.h"
 #include "spinlock.h"
 #include "svm.h"
 #include "thread.h"
+#include "timer.h"
 #include "types.h"
 #include "vt.h"
 
@@ -63,6 +66,10 @@ struct pcpu {
 	struct svm_pcpu_data svm;
 	struct cache_pcpu_data cache;
 	struct panic_pcpu_data panic;
+	struct exitstat_pcpu_data exitstat;
+	struct timer_pcpu_data timer;
+	struct thread_pcpu_data thread;
+	struct mm_pcpu_data mm;
 	enum fullvirtualize_type fullvirtualize;
 	int cpunum;
 	int pid;
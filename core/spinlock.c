@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2007, 2008 University of Tsukuba
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the University of Tsukuba nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Per-lock statistics collected when SPINLOCK_STAT is defined.  Every */
+/* spinlock_unlock reports the cycles spent spinning for the lock and */
+/* the cycles the lock was held.  They are accumulated in a table */
+/* indexed by the address of the lock and the locks with the longest */
+/* spin time are printed by get_status. */
+
+#include "initfunc.h"
+#include "printf.h"
+#include "spinlock.h"
+#include "string.h"
+#include "vmmcall_status.h"
+
+#ifdef SPINLOCK_STAT
+#define NUM_OF_SPINLOCK_STAT	512
+#define SPINLOCK_STAT_PROBE	16
+#define SPINLOCK_STAT_PRINT	16
+
+struct spinlock_stat {
+	spinlock_t *lock;
+	u64 count;
+	u64 spin;
+	u64 hold;
+	u64 hold_max;
+};
+
+static struct spinlock_stat spinlock_stat[NUM_OF_SPINLOCK_STAT];
+static spinlock_value_t spinlock_stat_lock;
+static u32 spinlock_stat_dropped = 0;
+
+static struct spinlock_stat *
+spinlock_stat_find (spinlock_t *l)
+{
+	struct spinlock_stat *s;
+	ulong h;
+	int i;
+
+	h = ((ulong)l >> 3) * 0x9E3779B1;
+	for (i = 0; i < SPINLOCK_STAT_PROBE; i++) {
+		s = &spinlock_stat[(h + i) % NUM_OF_SPINLOCK_STAT];
+		if (s->lock == l)
+			return s;
+		if (s->lock)
+			continue;
+		spinlock_value_lock (&spinlock_stat_lock);
+		if (!s->lock)
+			s->lock = l;
+		spinlock_value_unlock (&spinlock_stat_lock);
+		if (s->lock == l)
+			return s;
+	}
+	return NULL;
+}
+
+/* Called with the lock held, so the entry of the lock is updated by */
+/* one CPU at a time. */
+void
+spinlock_stat_update (spinlock_t *l, u64 spin, u64 hold)
+{
+	struct spinlock_stat *s;
+
+	s = spinlock_stat_find (l);
+	if (!s) {
+		asm volatile ("lock incl %0" : "+m" (spinlock_stat_dropped));
+		return;
+	}
+	s->count++;
+	s->spin += spin;
+	s->hold += hold;
+	if (s->hold_max < hold)
+		s->hold_max = hold;
+}
+
+#ifdef VMMCALL_STATUS_ENABLE
+static char *
+spinlock_status (void)
+{
+	static char buf[4096];
+	static bool printed[NUM_OF_SPINLOCK_STAT];
+	struct spinlock_stat *s, *max;
+	int i, j, len;
+
+	memset (printed, 0, sizeof printed);
+	len = snprintf (buf, sizeof buf, "Spinlocks: dropped %u\n",
+			spinlock_stat_dropped);
+	for (j = 0; j < SPINLOCK_STAT_PRINT; j++) {
+		max = NULL;
+		for (i = 0; i < NUM_OF_SPINLOCK_STAT; i++) {
+			s = &spinlock_stat[i];
+			if (s->lock && !printed[i] &&
+			    (!max || max->spin < s->spin))
+				max = s;
+		}
+		if (!max || len >= sizeof buf)
+			break;
+		printed[max - spinlock_stat] = true;
+		len += snprintf (buf + len, sizeof buf - len,
+				 " %p: count %llu spin %llu hold %llu"
+				 " max %llu\n", max->lock, max->count,
+				 max->spin, max->hold, max->hold_max);
+	}
+	return buf;
+}
+
+static void
+spinlock_register_status_callback (void)
+{
+	register_status_callback (spinlock_status);
+}
+
+INITFUNC ("paral01", spinlock_register_status_callback);
+#endif
+#endif
@@ -237,6 +237,10 @@ svm_init (void)
 		currentcpu->svm.flush_by_asid = true;
 	else
 		currentcpu->svm.flush_by_asid = false;
+	if (d & CPUID_EXT_A_EDX_DECODE_ASSISTS_BIT)
+		currentcpu->svm.decode_assists = true;
+	else
+		currentcpu->svm.decode_assists = false;
 }
 
 void
@@ -34,6 +34,8 @@
 #include "cpu_mmu.h"
 #include "current.h"
 #include "exint_pass.h"
+#include "exitstat.h"
+#include "mmio.h"
 #include "panic.h"
 #include "pcpu.h"
 #include "printf.h"
@@ -47,6 +49,8 @@
 #include "vmmerr.h"
 #include "vmmcall.h"
 
+#define NPF_EXITINFO1_FINAL_BIT 0x100000000ULL
+
 static void
 svm_nmi (void)
 {
@@ -79,8 +83,10 @@ svm_vm_run (void)
 {
 	if (current->u.svm.saved_vmcb)
 		spinlock_unlock (&currentcpu->suspend_lock);
+	exitstat_vmentry ();
 	asm_vmrun_regs (&current->u.svm.vr, current->u.svm.vi.vmcb_phys,
 			currentcpu->svm.vmcbhost_phys);
+	exitstat_vmexit ();
 	if (current->u.svm.saved_vmcb)
 		spinlock_lock (&currentcpu->suspend_lock);
 }
@@ -359,9 +365,26 @@ do_npf (void)
 {
 	struct vmcb *vmcb;
 	bool write;
+	u8 *code;
+	uint codelen;
 
 	vmcb = current->u.svm.vi.vmcb;
 	write = !!(vmcb->exitinfo1 & PAGEFAULT_ERR_WR_BIT);
+	/* data access to the final guest physical address, not an */
+	/* access to guest paging structures or an instruction fetch */
+	if (current->u.svm.np &&
+	    (vmcb->exitinfo1 & NPF_EXITINFO1_FINAL_BIT) &&
+	    !(vmcb->exitinfo1 & PAGEFAULT_ERR_ID_BIT)) {
+		code = NULL;
+		codelen = 0;
+		if (currentcpu->svm.decode_assists) {
+			code = vmcb->guest_insn_bytes;
+			codelen = vmcb->guest_insn_len;
+		}
+		if (mmio_access_page_fast (vmcb->exitinfo2, write, code,
+					   codelen))
+			return;
+	}
 	svm_paging_npf (write, vmcb->exitinfo2);
 }
 
@@ -385,9 +408,39 @@ do_cpuid (void)
 	current->u.svm.vi.vmcb->rip += 2;
 }
 
+static enum exitstat_type
+svm_exitstat_type (u64 exitcode)
+{
+	switch (exitcode) {
+	case VMEXIT_EXCP14:
+		return EXITSTAT_EXCEPTION;
+	case VMEXIT_CR0_READ:
+	case VMEXIT_CR0_WRITE:
+	case VMEXIT_CR3_READ:
+	case VMEXIT_CR3_WRITE:
+	case VMEXIT_CR4_READ:
+	case VMEXIT_CR4_WRITE:
+		return EXITSTAT_CR;
+	case VMEXIT_IOIO:
+		return EXITSTAT_IO;
+	case VMEXIT_INTR:
+		return EXITSTAT_INTR;
+	case VMEXIT_MSR:
+		return EXITSTAT_MSR;
+	case VMEXIT_NPF:
+		return EXITSTAT_NPF;
+	case VMEXIT_CPUID:
+		return EXITSTAT_CPUID;
+	default:
+		return EXITSTAT_OTHER;
+	}
+}
+
 static void
 svm_exit_code (void)
 {
+	exitstat_set_type (svm_exitstat_type
+			   (current->u.svm.vi.vmcb->exitcode));
 	switch (current->u.svm.vi.vmcb->exitcode) {
 	case VMEXIT_EXCP14:	/* Page fault */
 		do_pagefault ();
@@ -27,82 +27,277 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "asm.h"
+#include "assert.h"
 #include "cache.h"
 #include "constants.h"
 #include "current.h"
+#include "initfunc.h"
 #include "mm.h"
 #include "panic.h"
 #include "printf.h"
 #include "string.h"
 #include "svm_np.h"
 #include "svm_paging.h"
+#include "vmmcall_status.h"
 
-#define NUM_OF_NPTBL 1024
+#define NUM_OF_NPTBL		256	/* tables allocated at first */
+#define MAX_NUM_OF_NPTBL	2048
+#define NPTBL_GROW		128	/* tables allocated at once */
+#define NPTBL_RESERVED_PAGES	4096	/* pages left for others */
+#define NPTBL_RECLAIM		32	/* tables evicted at once */
+
+struct svm_np_tbl {
+	void *virt;
+	phys_t phys;
+	u64 *parent;		/* entry pointing to this table */
+	int level;		/* level of entries, -1 if free */
+	int next;		/* next free table */
+};
 
 struct svm_np {
-	int cnt;
+	int cnt;		/* tables [0, cnt) have been used */
+	int num;		/* tables allocated */
+	int free;		/* head of the free list, -1 if empty */
+	int nfree;
+	int hand;		/* clock hand for reclamation */
+	int large_level;	/* 0: 4KiB only, 1: 2MiB, 2: 1GiB */
 	void *ncr3tbl;
 	phys_t ncr3tbl_phys;
-	void *tbl[NUM_OF_NPTBL];
-	phys_t tbl_phys[NUM_OF_NPTBL];
+	struct svm_np_tbl tbl[MAX_NUM_OF_NPTBL];
 };
 
+static u32 stat_tblcnt = 0;
+static u32 stat_evictcnt = 0;
+static u32 stat_reclaimcnt = 0;
+static u32 stat_fullcnt = 0;
+static u32 stat_clearcnt = 0;
+
+static void
+svm_np_tbl_alloc (struct svm_np *np, int n)
+{
+	int i;
+
+	for (i = 0; i < n && np->num < MAX_NUM_OF_NPTBL; i++) {
+		alloc_page (&np->tbl[np->num].virt, &np->tbl[np->num].phys);
+		np->tbl[np->num].level = -1;
+		np->num++;
+		STATUS_UPDATE (asm_lock_incl (&stat_tblcnt));
+	}
+}
+
 void
 svm_np_init (void)
 {
 	struct svm_np *np;
-	int i;
+	u32 a, b, c, d;
 
 	np = alloc (sizeof (*np));
 	alloc_page (&np->ncr3tbl, &np->ncr3tbl_phys);
 	memset (np->ncr3tbl, 0, PAGESIZE);
-	for (i = 0; i < NUM_OF_NPTBL; i++)
-		alloc_page (&np->tbl[i], &np->tbl_phys[i]);
+	np->num = 0;
+	svm_np_tbl_alloc (np, NUM_OF_NPTBL);
 	np->cnt = 0;
+	np->free = -1;
+	np->nfree = 0;
+	np->hand = 0;
+	np->large_level = 0;
+	if (PMAP_LEVELS >= 3)
+		np->large_level = 1;
+	if (PMAP_LEVELS == 4) {
+		asm_cpuid (CPUID_EXT_1, 0, &a, &b, &c, &d);
+		if (d & CPUID_EXT_1_EDX_PAGE1GB_BIT)
+			np->large_level = 2;
+	}
 	current->u.svm.np = np;
 	current->u.svm.vi.vmcb->n_cr3 = np->ncr3tbl_phys;
 }
 
+/* remove all mappings without flushing TLB */
 static void
-svm_np_map_page (bool write, u64 gphys)
+svm_np_reset (struct svm_np *np)
+{
+	int i;
+
+	memset (np->ncr3tbl, 0, PAGESIZE);
+	for (i = 0; i < np->cnt; i++)
+		np->tbl[i].level = -1;
+	np->cnt = 0;
+	np->free = -1;
+	np->nfree = 0;
+	np->hand = 0;
+}
+
+static bool
+svm_np_tbl_has_child (struct svm_np_tbl *t)
+{
+	int i;
+	u64 *e;
+
+	if (t->level == 0)
+		return false;
+	e = t->virt;
+	for (i = 0; i < 512; i++)
+		if ((e[i] & PDE_P_BIT) && !(e[i] & PDE_PS_BIT))
+			return true;
+	return false;
+}
+
+/* Evict up to n tables that have no child tables and have not been */
+/* used by the processor since the clock hand passed last time. */
+/* PDPTEs in PAE mode do not have the accessed flag. */
+static int
+svm_np_tbl_reclaim (struct svm_np *np, int n)
+{
+	int i, evicted;
+	struct svm_np_tbl *t;
+
+	evicted = 0;
+	for (i = 0; i < np->cnt * 2 && evicted < n; i++) {
+		if (np->hand >= np->cnt)
+			np->hand = 0;
+		t = &np->tbl[np->hand];
+		if (t->level < 0 || svm_np_tbl_has_child (t))
+			goto next;
+		if ((PMAP_LEVELS != 3 || t->level != 1) &&
+		    (*t->parent & PDE_A_BIT)) {
+			*t->parent &= ~PDE_A_BIT;
+			goto next;
+		}
+		*t->parent = 0;
+		t->level = -1;
+		t->next = np->free;
+		np->free = np->hand;
+		np->nfree++;
+		evicted++;
+		STATUS_UPDATE (asm_lock_incl (&stat_evictcnt));
+	next:
+		np->hand++;
+	}
+	if (evicted) {
+		STATUS_UPDATE (asm_lock_incl (&stat_reclaimcnt));
+		svm_paging_flush_guest_tlb ();
+	}
+	return evicted;
+}
+
+/* make n or more tables available by using free tables, allocating */
+/* new tables, evicting cold tables or removing all mappings */
+static void
+svm_np_tbl_reserve (struct svm_np *np, int n)
+{
+	while (np->nfree + np->num - np->cnt < n) {
+		if (np->num < MAX_NUM_OF_NPTBL &&
+		    num_of_available_pages () > NPTBL_RESERVED_PAGES) {
+			svm_np_tbl_alloc (np, NPTBL_GROW);
+			continue;
+		}
+		if (svm_np_tbl_reclaim (np, NPTBL_RECLAIM) > 0)
+			continue;
+		/* printf ("!"); */
+		svm_np_reset (np);
+		STATUS_UPDATE (asm_lock_incl (&stat_fullcnt));
+		svm_paging_flush_guest_tlb ();
+	}
+}
+
+static struct svm_np_tbl *
+svm_np_tbl_get (struct svm_np *np, u64 *parent, int level)
+{
+	struct svm_np_tbl *t;
+	u64 e;
+
+	if (np->free >= 0) {
+		t = &np->tbl[np->free];
+		np->free = t->next;
+		np->nfree--;
+	} else {
+		ASSERT (np->cnt < np->num);
+		t = &np->tbl[np->cnt++];
+	}
+	memset (t->virt, 0, PAGESIZE);
+	t->parent = parent;
+	t->level = level;
+	e = t->phys | PDE_P_BIT;
+	if (PMAP_LEVELS != 3 || level != 1)
+		e |= PDE_RW_BIT | PDE_US_BIT | PDE_A_BIT;
+	*parent = e;
+	return t;
+}
+
+/* Find the largest page that can map gphys.  A large page is used */
+/* only if the whole range is contiguous and writable host memory, */
+/* has the same memory type and has no MMIO handlers. */
+/* Returns 0 for a 4KiB page, 1 for a 2MiB page and 2 for a 1GiB page. */
+static int
+svm_np_large_level (struct svm_np *np, u64 gphys)
 {
 	int l;
-	bool fakerom;
-	u64 hphys;
+	u64 size, base;
+
+	for (l = np->large_level; l > 0; l--) {
+		size = PAGESIZE << (9 * l);
+		base = gphys & ~(size - 1);
+		if (current->gmm.gp2hp_large (base, size) ==
+		    GMM_GP2HP_LARGE_FAIL)
+			continue;
+		if (!cache_gmtrr_type_equal (base, size - 1))
+			continue;
+		if (mmio_range (base, size))
+			continue;
+		break;
+	}
+	return l;
+}
+
+static void
+svm_np_map_page (bool write, u64 gphys)
+{
+	int l, ll;
+	bool fakerom, flush;
+	u64 hphys, size;
 	u32 hattr;
 	struct svm_np *np;
-	u64 *p, *q, e;
+	struct svm_np_tbl *t;
+	u64 *p, e;
 
 	np = current->u.svm.np;
-	q = np->ncr3tbl;
-	q += (gphys >> (PMAP_LEVELS * 9 + 3)) & 0x1FF;
-	p = q;
+	ll = svm_np_large_level (np, gphys);
+	flush = false;
+	svm_np_tbl_reserve (np, PMAP_LEVELS - 1);
+	p = np->ncr3tbl;
+	p += (gphys >> (PMAP_LEVELS * 9 + 3)) & 0x1FF;
 	for (l = PMAP_LEVELS - 1; l > 0; l--) {
 		e = *p;
-		if (!(e & PDE_P_BIT)) {
-			if (np->cnt + l > NUM_OF_NPTBL) {
-				/* printf ("!"); */
-				memset (np->ncr3tbl, 0, PAGESIZE);
-				np->cnt = 0;
-				svm_paging_flush_guest_tlb ();
-				l = PMAP_LEVELS - 1;
-				p = q;
-			}
+		if (!(e & PDE_P_BIT) || (e & PDE_PS_BIT)) {
+			if (e & PDE_P_BIT)
+				flush = true;
 			break;
 		}
 		e &= ~PAGESIZE_MASK;
 		e |= (gphys >> (9 * l)) & 0xFF8;
 		p = (u64 *)phys_to_virt (e);
 	}
-	for (; l > 0; l--) {
-		e = np->tbl_phys[np->cnt] | PDE_P_BIT;
-		if (PMAP_LEVELS != 3 || l != 2)
-			e |= PDE_RW_BIT | PDE_US_BIT | PDE_A_BIT;
-		*p = e;
-		p = np->tbl[np->cnt++];
-		memset (p, 0, PAGESIZE);
+	/* Existing tables are reused and a large page is put in a */
+	/* smaller level in that case. */
+	if (ll > l)
+		ll = l;
+	for (; l > ll; l--) {
+		t = svm_np_tbl_get (np, p, l - 1);
+		p = t->virt;
 		p += (gphys >> (9 * l + 3)) & 0x1FF;
 	}
+	if (ll > 0) {
+		size = PAGESIZE << (9 * ll);
+		hphys = current->gmm.gp2hp_large (gphys & ~(size - 1), size);
+		hattr = cache_get_gmtrr_attr (gphys);
+		if (hattr & PTE_PAT_BIT)
+			hattr = (hattr & ~PTE_PAT_BIT) | PDE_PS_PAT_BIT;
+		hattr |= PDE_P_BIT | PDE_RW_BIT | PDE_US_BIT | PDE_A_BIT |
+			PDE_D_BIT | PDE_PS_BIT;
+		*p = hphys | hattr;
+		goto end;
+	}
 	hphys = current->gmm.gp2hp (gphys, &fakerom) & ~PAGESIZE_MASK;
 	if (fakerom && write)
 		panic ("NP: Writing to VMM memory.");
@@ -111,6 +306,9 @@ svm_np_map_page (bool write, u64 gphys)
 	if (fakerom)
 		hattr &= ~PTE_RW_BIT;
 	*p = hphys | hattr;
+end:
+	if (flush)
+		svm_paging_flush_guest_tlb ();
 }
 
 void
@@ -139,31 +337,52 @@ svm_np_clear_all (void)
 	struct svm_np *np;
 
 	np = current->u.svm.np;
-	memset (np->ncr3tbl, 0, PAGESIZE);
-	np->cnt = 0;
+	svm_np_reset (np);
+	STATUS_UPDATE (asm_lock_incl (&stat_clearcnt));
 	svm_paging_flush_guest_tlb ();
 }
 
 bool
 svm_np_extern_mapsearch (struct vcpu *p, phys_t start, phys_t end)
 {
-	u64 *e, tmp, mask = p->pte_addr_mask;
+	u64 *e, tmp, tmpend, mask = p->pte_addr_mask;
 	unsigned int cnt, i, j, n = 512;
 	struct svm_np *np;
+	bool flush = false;
 
 	np = p->u.svm.np;
 	cnt = np->cnt;
 	for (i = 0; i < cnt; i++) {
-		e = np->tbl[i];
+		if (np->tbl[i].level < 0)
+			continue;
+		e = np->tbl[i].virt;
 		for (j = 0; j < n; j++) {
+			if (!(e[j] & PTE_P_BIT))
+				continue;
+			/* Entries pointing to a child table hold the
+			 * table address, not a guest address.  The
+			 * leaf entries in the child are checked when
+			 * that table is visited. */
+			if (np->tbl[i].level > 0 && !(e[j] & PDE_PS_BIT))
+				continue;
 			tmp = e[j] & mask;
-			if ((e[j] & PTE_P_BIT) && start <= tmp && tmp <= end) {
+			tmpend = tmp;
+			if (np->tbl[i].level > 0 && (e[j] & PDE_PS_BIT)) {
+				tmp &= ~PDE_PS_PAT_BIT;
+				tmpend = tmp | ((PAGESIZE <<
+						 (9 * np->tbl[i].level)) - 1);
+			}
+			if (start <= tmpend && tmp <= end) {
 				if (p != current)
 					return true;
+				if (tmpend != tmp)
+					flush = true;
 				e[j] = 0;
 			}
 		}
 	}
+	if (flush)
+		svm_paging_flush_guest_tlb ();
 	return false;
 }
 
@@ -180,3 +399,26 @@ svm_np_map_1mb (void)
 		mmio_unlock ();
 	}
 }
+
+static char *
+svm_np_status (void)
+{
+	static char buf[1024];
+
+	snprintf (buf, 1024,
+		  "NP:\n"
+		  " Tables: %u\n"
+		  " Evict: %u Reclaim: %u\n"
+		  " Full: %u Clear: %u\n"
+		  , stat_tblcnt, stat_evictcnt, stat_reclaimcnt
+		  , stat_fullcnt, stat_clearcnt);
+	return buf;
+}
+
+static void
+svm_np_register_status_callback (void)
+{
+	register_status_callback (svm_np_status);
+}
+
+INITFUNC ("paral01", svm_np_register_status_callback);
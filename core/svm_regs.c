@@ -29,6 +29,7 @@
 
 #include "asm.h"
 #include "constants.h"
+#include "cpu_interpreter.h"
 #include "current.h"
 #include "entry.h"
 #include "mm.h"
@@ -197,6 +198,7 @@ svm_write_control_reg (enum control_reg reg, ulong val)
 		break;
 	case CONTROL_REG_CR3:
 		*current->u.svm.cr3 = val;
+		cpu_interpreter_flush_cache ();
 		svm_paging_updatecr3 ();
 		svm_paging_flush_guest_tlb ();
 		break;
@@ -154,7 +154,9 @@ struct vmcb {
 	u64 reserved0b8 : 63;	/* 63-1 */
 	/* 0x0C0 */
 	u32 reserved0c[4];	/* 0x0C0 */
-	u32 reserved0d[4];	/* 0x0D0 */
+	/* 0x0D0 */
+	u8 guest_insn_len;	/* 0x0D0 */
+	u8 guest_insn_bytes[15]; /* 0x0D1 */
 	u32 reserved0e[4];	/* 0x0E0 */
 	u32 reserved0f[4];	/* 0x0F0 */
 	u32 reserved1[64];	/* 0x100 */
@@ -39,8 +39,10 @@
 #include "string.h"
 #include "thread.h"
 #include "thread_switch.h"
+#include "timer.h"
 
 #define MAXNUM_OF_THREADS	256
+#define NUM_OF_THREAD_PRIORITY	2
 #define CPUNUM_ANY		-1
 
 extern ulong volatile syscallstack asm ("%gs:gs_syscallstack");
@@ -59,9 +61,13 @@ struct thread_context {
 struct thread_data {
 	LIST1_DEFINE (struct thread_data);
 	struct thread_context *context;
+	struct thread_runqueue *runqueue;
+	spinlock_t lock;
 	tid_t tid;
 	enum thread_state state;
+	enum thread_priority priority;
 	int cpunum;
+	int lastcpu;
 	bool boot;
 	void *stack;
 	int pid;
@@ -70,18 +76,36 @@ struct thread_data {
 	bool process_switch_enable;
 };
 
+/* A run queue holds runnable threads bound to one physical CPU and
+ * CPUNUM_ANY threads last made runnable there.  Each queue has its
+ * own lock; other CPUs only take it when stealing CPUNUM_ANY
+ * threads. */
+struct thread_runqueue {
+	LIST1_DEFINE (struct thread_runqueue);
+	LIST1_DEFINE_HEAD (struct thread_data,
+			   runnable[NUM_OF_THREAD_PRIORITY]);
+	spinlock_t lock;
+	u32 nany[NUM_OF_THREAD_PRIORITY];
+	struct thread_data *prev;
+	int cpunum;
+};
+
 static struct thread_data td[MAXNUM_OF_THREADS];
 static LIST1_DEFINE_HEAD (struct thread_data, td_free);
-static LIST1_DEFINE_HEAD (struct thread_data, td_runnable);
+static LIST1_DEFINE_HEAD (struct thread_runqueue, runqueue_list);
+static struct thread_runqueue runqueue_default;
+static u32 thread_nany[NUM_OF_THREAD_PRIORITY];
 static spinlock_t thread_lock;
-static void *old_stack;
 
 static void
 thread_data_init (struct thread_data *d, struct thread_context *c, void *stack,
 		  int cpunum)
 {
 	d->context = c;
+	d->runqueue = NULL;
 	d->cpunum = cpunum;
+	d->lastcpu = currentcpu->cpunum;
+	d->priority = THREAD_PRIORITY_NORMAL;
 	d->boot = false;
 	d->stack = stack;
 	d->pid = 0;
@@ -108,59 +132,193 @@ thread_data_load (struct thread_data *d)
 		mm_process_switch (d->process_switch);
 }
 
+static void
+thread_runqueue_init (struct thread_runqueue *q)
+{
+	int i;
+
+	for (i = 0; i < NUM_OF_THREAD_PRIORITY; i++) {
+		LIST1_HEAD_INIT (q->runnable[i]);
+		q->nany[i] = 0;
+	}
+	spinlock_init (&q->lock);
+	q->prev = NULL;
+	q->cpunum = CPUNUM_ANY;
+}
+
+static struct thread_runqueue *
+thread_runqueue_current (void)
+{
+	struct thread_runqueue *q;
+
+	q = currentcpu->thread.runqueue;
+	if (!q)
+		q = &runqueue_default;
+	return q;
+}
+
+/* Threads bound to a CPU always go to the run queue of the CPU.
+ * CPUNUM_ANY threads go to the run queue of the current CPU. */
+static void
+thread_runqueue_add (struct thread_data *d)
+{
+	struct thread_runqueue *q;
+	int prio;
+
+	q = d->runqueue;
+	if (!q)
+		q = thread_runqueue_current ();
+	prio = d->priority;
+	spinlock_lock (&q->lock);
+	LIST1_ADD (q->runnable[prio], d);
+	if (d->cpunum == CPUNUM_ANY) {
+		q->nany[prio]++;
+		asm_lock_incl (&thread_nany[prio]);
+	}
+	spinlock_unlock (&q->lock);
+}
+
+static void
+thread_runqueue_del (struct thread_runqueue *q, struct thread_data *d)
+{
+	int prio;
+
+	prio = d->priority;
+	LIST1_DEL (q->runnable[prio], d);
+	if (d->cpunum == CPUNUM_ANY) {
+		q->nany[prio]--;
+		asm_lock_decl (&thread_nany[prio]);
+	}
+}
+
+static struct thread_data *
+thread_runqueue_pop (struct thread_runqueue *q, int prio)
+{
+	struct thread_data *d;
+
+	if (!q->runnable[prio].next)
+		return NULL;
+	spinlock_lock (&q->lock);
+	d = q->runnable[prio].next;
+	if (d)
+		thread_runqueue_del (q, d);
+	spinlock_unlock (&q->lock);
+	return d;
+}
+
+/* Take a CPUNUM_ANY thread from another CPU's run queue.  Called
+ * only when thread_nany says that such a thread exists, so an idle
+ * CPU does not walk the run queues of other CPUs. */
+static struct thread_data *
+thread_runqueue_steal (struct thread_runqueue *self, int prio)
+{
+	struct thread_runqueue *q;
+	struct thread_data *d;
+
+	LIST1_FOREACH (runqueue_list, q) {
+		if (q == self || !q->nany[prio])
+			continue;
+		spinlock_lock (&q->lock);
+		LIST1_FOREACH (q->runnable[prio], d) {
+			if (d->cpunum == CPUNUM_ANY) {
+				thread_runqueue_del (q, d);
+				spinlock_unlock (&q->lock);
+				return d;
+			}
+		}
+		spinlock_unlock (&q->lock);
+	}
+	return NULL;
+}
+
+static struct thread_data *
+thread_runqueue_next (struct thread_runqueue *q)
+{
+	struct thread_data *d;
+	int prio;
+
+	for (prio = NUM_OF_THREAD_PRIORITY - 1; prio >= 0; prio--) {
+		d = thread_runqueue_pop (q, prio);
+		if (d)
+			return d;
+		if (thread_nany[prio] != q->nany[prio]) {
+			d = thread_runqueue_steal (q, prio);
+			if (d)
+				return d;
+		}
+	}
+	return NULL;
+}
+
 tid_t
 thread_gettid (void)
 {
 	return currentcpu->tid;
 }
 
+/* Called on the stack of the new thread.  The previous thread is put
+ * back to a run queue here, after its context has been saved, so that
+ * another CPU cannot pick it up while it is still switching. */
 static void
 switched (void)
 {
-	spinlock_unlock (&thread_lock);
+	struct thread_runqueue *q;
+	struct thread_data *prev;
+	bool exited = false;
+
+	q = thread_runqueue_current ();
+	prev = q->prev;
+	q->prev = NULL;
+	if (!prev)
+		return;
+	spinlock_lock (&prev->lock);
+	switch (prev->state) {
+	case THREAD_EXIT:
+		exited = true;
+		break;
+	case THREAD_RUN:
+		thread_runqueue_add (prev);
+		break;
+	case THREAD_WILL_STOP:
+		prev->state = THREAD_STOP;
+		break;
+	case THREAD_STOP:
+	default:
+		panic ("schedule: bad state tid=%d state=%d",
+		       prev->tid, prev->state);
+	}
+	spinlock_unlock (&prev->lock);
+	if (exited) {
+		if (prev->stack)
+			free (prev->stack);
+		spinlock_lock (&thread_lock);
+		LIST1_ADD (td_free, prev);
+		spinlock_unlock (&thread_lock);
+	}
 }
 
 void
 schedule (void)
 {
+	struct thread_runqueue *q;
 	struct thread_data *d;
 	tid_t oldtid, newtid;
 
-	spinlock_lock (&thread_lock);
-	if (old_stack) {
-		free (old_stack);
-		old_stack = NULL;
-	}
-	LIST1_FOREACH (td_runnable, d) {
-		if (d->cpunum == CPUNUM_ANY ||
-		    d->cpunum == currentcpu->cpunum)
-			goto found;
-	}
-	spinlock_unlock (&thread_lock);
-	return;
-found:
-	LIST1_DEL (td_runnable, d);
+	timer_wakeup_check ();
+	q = thread_runqueue_current ();
+	d = thread_runqueue_next (q);
+	if (!d)
+		return;
 	oldtid = currentcpu->tid;
 	newtid = d->tid;
 	thread_data_save (&td[oldtid]);
 	currentcpu->tid = newtid;
 	thread_data_load (d);
-	switch (td[oldtid].state) {
-	case THREAD_EXIT:
-		old_stack = td[oldtid].stack;
-		LIST1_ADD (td_free, &td[oldtid]);
-		break;
-	case THREAD_RUN:
-		LIST1_ADD (td_runnable, &td[oldtid]);
-		break;
-	case THREAD_WILL_STOP:
-		td[oldtid].state = THREAD_STOP;
-		break;
-	case THREAD_STOP:
-	default:
-		panic ("schedule: bad state tid=%d state=%d",
-		       oldtid, td[oldtid].state);
+	if (d->lastcpu != currentcpu->cpunum) {
+		d->lastcpu = currentcpu->cpunum;
+		mapmem_thread_migrated ();
 	}
+	q->prev = &td[oldtid];
 	thread_switch (&td[oldtid].context, d->context, 0);
 	switched ();
 }
@@ -174,23 +332,25 @@ thread_start1 (void (*func) (void *), void *arg)
 }
 
 static tid_t
-thread_new0 (struct thread_context *c, void *stack)
+thread_new0 (struct thread_context *c, void *stack,
+	     enum thread_priority priority, struct thread_runqueue *q)
 {
 	struct thread_data *d;
-	tid_t r;
 
 	spinlock_lock (&thread_lock);
 	d = LIST1_POP (td_free);
-	ASSERT (d);
-	thread_data_init (d, c, stack, CPUNUM_ANY);
-	LIST1_ADD (td_runnable, d);
-	r = d->tid;
 	spinlock_unlock (&thread_lock);
-	return r;
+	ASSERT (d);
+	thread_data_init (d, c, stack, q ? q->cpunum : CPUNUM_ANY);
+	d->runqueue = q;
+	d->priority = priority;
+	thread_runqueue_add (d);
+	return d->tid;
 }
 
-tid_t
-thread_new (void (*func) (void *), void *arg, int stacksize)
+static tid_t
+thread_new1 (void (*func) (void *), void *arg, int stacksize,
+	     enum thread_priority priority, struct thread_runqueue *rq)
 {
 	u8 *stack, *q;
 	struct thread_context c;
@@ -204,7 +364,40 @@ thread_new (void (*func) (void *), void *arg, int stacksize)
 	PUSH (func);
 	PUSH (c);
 #undef PUSH
-	return thread_new0 ((struct thread_context *)q, stack);
+	ASSERT (priority < NUM_OF_THREAD_PRIORITY);
+	return thread_new0 ((struct thread_context *)q, stack, priority, rq);
+}
+
+/* High priority threads are always picked before normal ones.  A
+ * high priority thread must sleep with thread_will_stop() while it
+ * waits, because one that polls by calling schedule() keeps normal
+ * threads on its CPU, including the timer thread, from running. */
+tid_t
+thread_new_priority (void (*func) (void *), void *arg, int stacksize,
+		     enum thread_priority priority)
+{
+	return thread_new1 (func, arg, stacksize, priority, NULL);
+}
+
+/* Create a thread that runs only on the physical CPU cpunum.  The
+ * thread is not bound if the CPU does not exist. */
+tid_t
+thread_new_bind (void (*func) (void *), void *arg, int stacksize,
+		 enum thread_priority priority, int cpunum)
+{
+	struct thread_runqueue *q;
+
+	LIST1_FOREACH (runqueue_list, q)
+		if (q->cpunum == cpunum)
+			break;
+	return thread_new1 (func, arg, stacksize, priority, q);
+}
+
+tid_t
+thread_new (void (*func) (void *), void *arg, int stacksize)
+{
+	return thread_new_priority (func, arg, stacksize,
+				    THREAD_PRIORITY_NORMAL);
 }
 
 static enum thread_state
@@ -212,31 +405,35 @@ thread_set_state (tid_t tid, enum thread_state state)
 {
 	enum thread_state oldstate;
 
-	spinlock_lock (&thread_lock);
+	spinlock_lock (&td[tid].lock);
 	oldstate = td[tid].state;
 	td[tid].state = state;
-	spinlock_unlock (&thread_lock);
+	spinlock_unlock (&td[tid].lock);
 	return oldstate;
 }
 
 void
 thread_wakeup (tid_t tid)
 {
-	switch (thread_set_state (tid, THREAD_RUN)) {
+	enum thread_state oldstate;
+
+	spinlock_lock (&td[tid].lock);
+	oldstate = td[tid].state;
+	td[tid].state = THREAD_RUN;
+	if (oldstate == THREAD_STOP)
+		thread_runqueue_add (&td[tid]);
+	spinlock_unlock (&td[tid].lock);
+	switch (oldstate) {
 	case THREAD_RUN:
 		printf ("WARNING: waking up runnable thread tid=%d\n", tid);
 		break;
 	case THREAD_WILL_STOP:
-		break;
 	case THREAD_STOP:
-		spinlock_lock (&thread_lock);
-		LIST1_ADD (td_runnable, &td[tid]);
-		spinlock_unlock (&thread_lock);
 		break;
 	case THREAD_EXIT:
 	default:
 		panic ("thread_wakeup: bad state tid=%d state=%d",
-		       tid, td[tid].state);
+		       tid, oldstate);
 	}
 }
 
@@ -293,12 +490,16 @@ thread_init_global (void)
 	int i;
 
 	LIST1_HEAD_INIT (td_free);
-	LIST1_HEAD_INIT (td_runnable);
+	LIST1_HEAD_INIT (runqueue_list);
 	spinlock_init (&thread_lock);
-	old_stack = NULL;
+	thread_runqueue_init (&runqueue_default);
+	LIST1_ADD (runqueue_list, &runqueue_default);
+	for (i = 0; i < NUM_OF_THREAD_PRIORITY; i++)
+		thread_nany[i] = 0;
 	for (i = 0; i < MAXNUM_OF_THREADS; i++) {
 		td[i].tid = i;
 		td[i].state = THREAD_EXIT;
+		spinlock_init (&td[i].lock);
 		LIST1_ADD (td_free, &td[i]);
 	}
 }
@@ -306,15 +507,22 @@ thread_init_global (void)
 static void
 thread_init_pcpu (void)
 {
+	struct thread_runqueue *q;
 	struct thread_data *d;
 
+	q = alloc (sizeof *q);
+	thread_runqueue_init (q);
+	q->cpunum = currentcpu->cpunum;
 	spinlock_lock (&thread_lock);
+	LIST1_ADD (runqueue_list, q);
 	d = LIST1_POP (td_free);
+	spinlock_unlock (&thread_lock);
 	ASSERT (d);
 	thread_data_init (d, NULL, NULL, currentcpu->cpunum);
+	d->runqueue = q;
 	d->boot = true;
+	currentcpu->thread.runqueue = q;
 	currentcpu->tid = d->tid;
-	spinlock_unlock (&thread_lock);
 }
 
 INITFUNC ("global3", thread_init_global);
@@ -32,6 +32,12 @@
 
 #include <core/thread.h>
 
+struct thread_runqueue;
+
+struct thread_pcpu_data {
+	struct thread_runqueue *runqueue;
+};
+
 void thread_set_process_switch (phys_t switchto);
 
 #endif
@@ -27,33 +27,341 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include "comphappy.h"
+/* Armed timers are kept in hierarchical timing wheels, one wheel per */
+/* physical CPU.  A timer belongs to the wheel of the CPU that created */
+/* it, so setting and cancelling a timer is O(1) and contends only */
+/* with the timer thread on that wheel.  The timer thread processes */
+/* all wheels, calls expired callbacks in batches, and stops itself */
+/* until the nearest deadline instead of polling.  schedule() calls */
+/* timer_wakeup_check() to wake it up when the deadline has passed. */
+
+#include "arith.h"
+#include "asm.h"
+#include "assert.h"
 #include "constants.h"
+#include "convert.h"
 #include "initfunc.h"
 #include "list.h"
 #include "mm.h"
+#include "pcpu.h"
 #include "spinlock.h"
 #include "thread.h"
 #include "time.h"
 #include "timer.h"
 #include "types.h"
 
-#define MAX_TIMER 128
+#define MAX_TIMER		128
+#define TIMER_TICK_SHIFT	8 /* 256 usec */
+#define TIMER_SLOT_SHIFT	6
+#define NUM_OF_TIMER_SLOTS	(1 << TIMER_SLOT_SHIFT)
+#define TIMER_SLOT_MASK		(NUM_OF_TIMER_SLOTS - 1)
+#define NUM_OF_TIMER_LEVELS	4
+#define TIMER_RANGE		(1ULL << (NUM_OF_TIMER_LEVELS * \
+					  TIMER_SLOT_SHIFT)) /* ticks */
+#define TIMER_BATCH		16
+#define TIMER_NEVER		0xFFFFFFFFFFFFFFFFULL
 
-static spinlock_t timer_lock;
+struct timer_data;
+
+struct timer_list {
+	struct timer_data **pnext, *next;
+};
 
 struct timer_data {
 	LIST1_DEFINE (struct timer_data);
-	bool enable;
-	u64 settime;
-	u64 interval;
+	struct timer_wheel *wheel;
+	struct timer_list *list; /* slot of the wheel, NULL if not armed */
+	u64 expire;
 	void (*callback) (void *handle, void *data);
 	void *data;
 };
 
-static LIST1_DEFINE_HEAD (struct timer_data, list1_timer_on);
-static LIST1_DEFINE_HEAD (struct timer_data, list1_timer_off);
+struct timer_wheel {
+	LIST1_DEFINE (struct timer_wheel);
+	spinlock_t lock;
+	u64 tick;		/* the tick being processed */
+	int num;		/* number of armed timers */
+	u64 bitmap[NUM_OF_TIMER_LEVELS];
+	struct timer_list slot[NUM_OF_TIMER_LEVELS][NUM_OF_TIMER_SLOTS];
+};
+
+struct timer_expired {
+	struct timer_data *p;
+	void (*callback) (void *handle, void *data);
+	void *data;
+};
+
+static spinlock_t timer_lock;
 static LIST1_DEFINE_HEAD (struct timer_data, list1_timer_free);
+static LIST1_DEFINE_HEAD (struct timer_wheel, list1_timer_wheel);
+static struct timer_wheel *timer_wheel_default;
+static spinlock_t timer_sleep_lock;
+static volatile bool timer_sleeping;
+static volatile u64 timer_wake_tsc;
+static tid_t timer_tid;
+
+static u64
+timer_rdtsc (void)
+{
+	u32 tsc_l, tsc_h;
+	u64 tsc;
+
+	asm_rdtsc (&tsc_l, &tsc_h);
+	conv32to64 (tsc_l, tsc_h, &tsc);
+	return tsc;
+}
+
+/* TSC value when the time reaches the deadline.  The TSCs of all */
+/* processors are assumed to be roughly synchronized; a wakeup which */
+/* is a little early is harmless. */
+static u64
+timer_deadline_tsc (u64 deadline, u64 time)
+{
+	u64 tmp[2], hz, usec;
+
+	if (deadline == TIMER_NEVER)
+		return TIMER_NEVER;
+	if (deadline <= time)
+		return 0;
+	usec = deadline - time;
+	hz = currentcpu->hz;
+	while (hz > 0xFFFFFFFFULL) {
+		usec <<= 1;
+		hz >>= 1;
+	}
+	mpumul_64_64 (usec, hz, tmp); /* tmp = usec * hz */
+	mpudiv_128_32 (tmp, 1000000U, tmp); /* tmp = tmp / 1000000 */
+	if (tmp[1])
+		return TIMER_NEVER;
+	return timer_rdtsc () + tmp[0];
+}
+
+static void
+timer_update_wakeup (u64 deadline, u64 time)
+{
+	u64 tsc;
+
+	tsc = timer_deadline_tsc (deadline, time);
+	spinlock_lock (&timer_sleep_lock);
+	if (timer_wake_tsc > tsc)
+		timer_wake_tsc = tsc;
+	spinlock_unlock (&timer_sleep_lock);
+}
+
+/* called by schedule() */
+void
+timer_wakeup_check (void)
+{
+	bool wakeup;
+
+	if (!timer_sleeping || timer_rdtsc () < timer_wake_tsc)
+		return;
+	wakeup = false;
+	spinlock_lock (&timer_sleep_lock);
+	if (timer_sleeping && timer_rdtsc () >= timer_wake_tsc) {
+		timer_sleeping = false;
+		wakeup = true;
+	}
+	spinlock_unlock (&timer_sleep_lock);
+	if (wakeup)
+		thread_wakeup (timer_tid);
+}
+
+static struct timer_wheel *
+timer_wheel_new (void)
+{
+	struct timer_wheel *w;
+	int i, j;
+
+	w = alloc (sizeof *w);
+	spinlock_init (&w->lock);
+	w->tick = 0;
+	w->num = 0;
+	for (i = 0; i < NUM_OF_TIMER_LEVELS; i++) {
+		w->bitmap[i] = 0;
+		for (j = 0; j < NUM_OF_TIMER_SLOTS; j++)
+			LIST1_HEAD_INIT (w->slot[i][j]);
+	}
+	return w;
+}
+
+/* w->lock must be held */
+static void
+timer_wheel_add (struct timer_wheel *w, struct timer_data *p)
+{
+	u64 tick, delta;
+	int level, idx;
+
+	tick = p->expire >> TIMER_TICK_SHIFT;
+	if (tick < w->tick)
+		tick = w->tick;
+	delta = tick - w->tick;
+	for (level = 0; level < NUM_OF_TIMER_LEVELS - 1; level++)
+		if (delta < 1ULL << ((level + 1) * TIMER_SLOT_SHIFT))
+			break;
+	if (delta >= TIMER_RANGE)
+		tick = w->tick + TIMER_RANGE - 1;
+	idx = (tick >> (level * TIMER_SLOT_SHIFT)) & TIMER_SLOT_MASK;
+	p->list = &w->slot[level][idx];
+	LIST1_ADD (*p->list, p);
+	w->bitmap[level] |= 1ULL << idx;
+	w->num++;
+}
+
+/* w->lock must be held */
+static void
+timer_wheel_del (struct timer_wheel *w, struct timer_data *p)
+{
+	int n;
+
+	LIST1_DEL (*p->list, p);
+	if (!p->list->next) {
+		n = p->list - &w->slot[0][0];
+		w->bitmap[n / NUM_OF_TIMER_SLOTS] &=
+			~(1ULL << (n % NUM_OF_TIMER_SLOTS));
+	}
+	p->list = NULL;
+	w->num--;
+}
+
+/* move timers in upper levels down when w->tick reaches boundaries */
+static void
+timer_wheel_cascade (struct timer_wheel *w)
+{
+	struct timer_list list;
+	struct timer_data *p;
+	int level, idx;
+
+	for (level = 1; level < NUM_OF_TIMER_LEVELS; level++) {
+		if (w->tick & ((1ULL << (level * TIMER_SLOT_SHIFT)) - 1))
+			break;
+		idx = (w->tick >> (level * TIMER_SLOT_SHIFT)) &
+			TIMER_SLOT_MASK;
+		if (!(w->bitmap[level] & (1ULL << idx)))
+			continue;
+		LIST1_HEAD_INIT (list);
+		while ((p = LIST1_POP (w->slot[level][idx])))
+			LIST1_ADD (list, p);
+		w->bitmap[level] &= ~(1ULL << idx);
+		while ((p = LIST1_POP (list))) {
+			w->num--;
+			timer_wheel_add (w, p);
+		}
+	}
+}
+
+/* distance from slot idx to the next slot with timers, from 1 to */
+/* NUM_OF_TIMER_SLOTS because slots before idx have wrapped around, */
+/* or 0 if the bitmap is empty */
+static int
+timer_slot_distance (u64 bitmap, int idx)
+{
+	int d;
+
+	if (!bitmap)
+		return 0;
+	idx = (idx + 1) & TIMER_SLOT_MASK;
+	if (idx)
+		bitmap = (bitmap >> idx) |
+			(bitmap << (NUM_OF_TIMER_SLOTS - idx));
+	for (d = 1; !(bitmap & 1); d++)
+		bitmap >>= 1;
+	return d;
+}
+
+/* the next tick after w->tick at which a timer may expire or a slot */
+/* has to be cascaded.  w->tick must not be moved beyond it, because */
+/* timer_wheel_cascade() only looks at the slots of the boundary */
+/* w->tick is on. */
+static u64
+timer_wheel_next (struct timer_wheel *w)
+{
+	int level, shift, d;
+	u64 next, tmp;
+
+	next = TIMER_NEVER;
+	for (level = 0; level < NUM_OF_TIMER_LEVELS; level++) {
+		shift = level * TIMER_SLOT_SHIFT;
+		d = timer_slot_distance (w->bitmap[level],
+					 (w->tick >> shift) & TIMER_SLOT_MASK);
+		if (!d)
+			continue;
+		tmp = ((w->tick >> shift) + d) << shift;
+		if (next > tmp)
+			next = tmp;
+	}
+	return next;
+}
+
+/* Collect expired timers of the wheel into e[*n] up to TIMER_BATCH. */
+/* Returns the earliest time when another timer of the wheel may */
+/* expire. */
+static u64
+timer_wheel_run (struct timer_wheel *w, u64 time, struct timer_expired *e,
+		 int *n)
+{
+	struct timer_data *p, *pn;
+	struct timer_list *list;
+	u64 now_tick, next, ret;
+
+	now_tick = time >> TIMER_TICK_SHIFT;
+	spinlock_lock (&w->lock);
+	if (!w->num) {
+		if (w->tick < now_tick)
+			w->tick = now_tick;
+		spinlock_unlock (&w->lock);
+		return TIMER_NEVER;
+	}
+	for (;;) {
+		list = &w->slot[0][w->tick & TIMER_SLOT_MASK];
+		LIST1_FOREACH_DELETABLE (*list, p, pn) {
+			/* A timer beyond the range of the wheel was put
+			 * in the last slot by timer_wheel_add().  Put it
+			 * again instead of letting it expire early. */
+			if (p->expire > time &&
+			    (p->expire >> TIMER_TICK_SHIFT) > w->tick) {
+				timer_wheel_del (w, p);
+				timer_wheel_add (w, p);
+				continue;
+			}
+			if (*n >= TIMER_BATCH) {
+				spinlock_unlock (&w->lock);
+				return time;
+			}
+			if (w->tick < now_tick || p->expire <= time) {
+				timer_wheel_del (w, p);
+				e[*n].p = p;
+				e[*n].callback = p->callback;
+				e[*n].data = p->data;
+				(*n)++;
+			}
+		}
+		if (w->tick >= now_tick)
+			break;
+		next = timer_wheel_next (w);
+		w->tick = next < now_tick ? next : now_tick;
+		timer_wheel_cascade (w);
+	}
+	ret = TIMER_NEVER;
+	if (w->num) {
+		LIST1_FOREACH (*list, p)
+			if (ret > p->expire)
+				ret = p->expire;
+		next = timer_wheel_next (w);
+		if (next != TIMER_NEVER && ret > next << TIMER_TICK_SHIFT)
+			ret = next << TIMER_TICK_SHIFT;
+	}
+	spinlock_unlock (&w->lock);
+	return ret;
+}
+
+static struct timer_wheel *
+timer_wheel_current (void)
+{
+	if (currentcpu->timer.wheel)
+		return currentcpu->timer.wheel;
+	return timer_wheel_default;
+}
 
 void *
 timer_new (void (*callback) (void *handle, void *data), void *data)
@@ -62,53 +370,51 @@ timer_new (void (*callback) (void *handle, void *data), void *data)
 
 	spinlock_lock (&timer_lock);
 	p = LIST1_POP (list1_timer_free);
+	spinlock_unlock (&timer_lock);
 	if (p == NULL)
 		return NULL;
-	p->enable = false;
+	p->wheel = timer_wheel_current ();
+	p->list = NULL;
 	p->callback = callback;
 	p->data = data;
-	LIST1_ADD (list1_timer_off, p);
-	spinlock_unlock (&timer_lock);
 	return p;
 }
 
 void
 timer_set (void *handle, u64 interval_usec)
 {
-	struct timer_data *p, *d;
+	struct timer_data *p;
+	struct timer_wheel *w;
 	u64 time;
 
-	spinlock_lock (&timer_lock);
-	time = get_time ();
 	p = handle;
-	if (!p->enable) {
-		LIST1_DEL (list1_timer_off, p);
-		p->enable = true;
-	} else {
-		LIST1_DEL (list1_timer_on, p);
-	}
-	p->settime = time;
-	p->interval = interval_usec;
-	LIST1_FOREACH (list1_timer_on, d)
-		if (d->interval > (time - d->settime) &&
-		    d->interval - (time - d->settime) > interval_usec)
-			break;
-	LIST1_INSERT (list1_timer_on, d, p);
-	spinlock_unlock (&timer_lock);
+	w = p->wheel;
+	spinlock_lock (&w->lock);
+	time = get_time ();
+	if (p->list)
+		timer_wheel_del (w, p);
+	/* no timers are armed, so the wheel can be moved forward */
+	if (!w->num && w->tick < (time >> TIMER_TICK_SHIFT))
+		w->tick = time >> TIMER_TICK_SHIFT;
+	p->expire = time + interval_usec;
+	timer_wheel_add (w, p);
+	spinlock_unlock (&w->lock);
+	timer_update_wakeup (time + interval_usec, time);
 }
 
 void
 timer_free (void *handle)
 {
 	struct timer_data *p;
+	struct timer_wheel *w;
 
-	spinlock_lock (&timer_lock);
 	p = handle;
-	if (p->enable)
-		LIST1_DEL (list1_timer_on, p);
-	else
-		LIST1_DEL (list1_timer_off, p);
-	p->enable = false;
+	w = p->wheel;
+	spinlock_lock (&w->lock);
+	if (p->list)
+		timer_wheel_del (w, p);
+	spinlock_unlock (&w->lock);
+	spinlock_lock (&timer_lock);
 	LIST1_ADD (list1_timer_free, p);
 	spinlock_unlock (&timer_lock);
 }
@@ -116,53 +422,121 @@ timer_free (void *handle)
 static void
 timer_thread (void *thread_data)
 {
-	struct timer_data *p;
-	u64 time;
-	bool call;
-	void (*callback) (void *handle, void *data);
-	void *data;
+	struct timer_expired e[TIMER_BATCH];
+	struct timer_wheel *w;
+	u64 time, deadline, tmp;
+	int i, n;
 
-	VAR_IS_INITIALIZED (callback);
-	VAR_IS_INITIALIZED (data);
+	timer_tid = thread_gettid ();
 	for (;;) {
-		call = false;
-		spinlock_lock (&timer_lock);
+		spinlock_lock (&timer_sleep_lock);
+		timer_wake_tsc = TIMER_NEVER;
+		spinlock_unlock (&timer_sleep_lock);
 		time = get_time ();
-		p = LIST1_POP (list1_timer_on);
-		if (p) {
-			if (p->enable && (time - p->settime) >= p->interval) {
-				p->enable = false;
-				call = true;
-				callback = p->callback;
-				data = p->data;
-			}
-			if (p->enable)
-				LIST1_PUSH (list1_timer_on, p);
-			else
-				LIST1_ADD (list1_timer_off, p);
+		deadline = TIMER_NEVER;
+		n = 0;
+		spinlock_lock (&timer_lock);
+		LIST1_FOREACH (list1_timer_wheel, w) {
+			tmp = timer_wheel_run (w, time, e, &n);
+			if (deadline > tmp)
+				deadline = tmp;
 		}
 		spinlock_unlock (&timer_lock);
-		if (call)
-			callback (p, data);
-		else
-			schedule ();
+		for (i = 0; i < n; i++)
+			e[i].callback (e[i].p, e[i].data);
+		if (n)
+			continue;
+		/* timer_set() may have lowered timer_wake_tsc */
+		tmp = timer_deadline_tsc (deadline, time);
+		spinlock_lock (&timer_sleep_lock);
+		if (timer_wake_tsc > tmp)
+			timer_wake_tsc = tmp;
+		timer_sleeping = true;
+		thread_will_stop ();
+		spinlock_unlock (&timer_sleep_lock);
+		schedule ();
 	}
 }
 
+#ifdef ENABLE_ASSERT
+/* check that a level 0 slot before the current one and a level 1 */
+/* boundary between w->tick and the current time are not skipped */
+static void
+timer_wheel_selftest (void)
+{
+	struct timer_expired e[TIMER_BATCH];
+	struct timer_data t[2];
+	struct timer_wheel *w;
+	int n;
+
+	w = timer_wheel_new ();
+	w->tick = 60;
+	t[0].expire = 80ULL << TIMER_TICK_SHIFT; /* level 0, slot 16 */
+	t[1].expire = 193ULL << TIMER_TICK_SHIFT; /* level 1, slot 3 */
+	timer_wheel_add (w, &t[0]);
+	timer_wheel_add (w, &t[1]);
+	ASSERT (timer_wheel_next (w) == 80);
+	n = 0;
+	ASSERT (timer_wheel_run (w, 79ULL << TIMER_TICK_SHIFT, e, &n) ==
+		80ULL << TIMER_TICK_SHIFT);
+	ASSERT (n == 0);
+	ASSERT (timer_wheel_run (w, 80ULL << TIMER_TICK_SHIFT, e, &n) ==
+		192ULL << TIMER_TICK_SHIFT);
+	ASSERT (n == 1 && e[0].p == &t[0]);
+	n = 0;
+	ASSERT (timer_wheel_run (w, 300ULL << TIMER_TICK_SHIFT, e, &n) ==
+		TIMER_NEVER);
+	ASSERT (n == 1 && e[0].p == &t[1]);
+	ASSERT (w->tick == 300 && !w->num);
+	/* a timer longer than the range of the wheel */
+	w->tick = 0;
+	t[0].expire = (TIMER_RANGE + 1000) << TIMER_TICK_SHIFT;
+	timer_wheel_add (w, &t[0]);
+	n = 0;
+	timer_wheel_run (w, (TIMER_RANGE - 1) << TIMER_TICK_SHIFT, e, &n);
+	ASSERT (n == 0);
+	timer_wheel_run (w, (TIMER_RANGE + 999) << TIMER_TICK_SHIFT, e, &n);
+	ASSERT (n == 0);
+	ASSERT (timer_wheel_run (w, t[0].expire, e, &n) == TIMER_NEVER);
+	ASSERT (n == 1 && e[0].p == &t[0]);
+	free (w);
+}
+#endif
+
 static void
 timer_init_global (void)
 {
 	struct timer_data *p;
 	int i;
 
-	LIST1_HEAD_INIT (list1_timer_on);
-	LIST1_HEAD_INIT (list1_timer_off);
 	LIST1_HEAD_INIT (list1_timer_free);
+	LIST1_HEAD_INIT (list1_timer_wheel);
 	p = alloc (MAX_TIMER * sizeof (struct timer_data));
 	for (i = 0; i < MAX_TIMER; i++)
 		LIST1_PUSH (list1_timer_free, &p[i]);
 	spinlock_init (&timer_lock);
+	spinlock_init (&timer_sleep_lock);
+#ifdef ENABLE_ASSERT
+	timer_wheel_selftest ();
+#endif
+	timer_sleeping = false;
+	timer_wake_tsc = TIMER_NEVER;
+	timer_wheel_default = timer_wheel_new ();
+	LIST1_ADD (list1_timer_wheel, timer_wheel_default);
 	thread_new (timer_thread, NULL, VMM_STACKSIZE);
 }
 
+static void
+timer_init_pcpu (void)
+{
+	struct timer_wheel *w;
+
+	w = timer_wheel_new ();
+	spinlock_lock (&timer_lock);
+	LIST1_ADD (list1_timer_wheel, w);
+	spinlock_unlock (&timer_lock);
+	currentcpu->timer.wheel = w;
+}
+
 INITFUNC ("paral20", timer_init_global);
+INITFUNC ("pcpu4", timer_init_pcpu);
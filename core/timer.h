@@ -32,4 +32,12 @@
 
 #include <core/timer.h>
 
+struct timer_wheel;
+
+struct timer_pcpu_data {
+	struct timer_wheel *wheel;
+};
+
+void timer_wakeup_check (void);
+
 #endif
@@ -32,6 +32,7 @@
 
 #include "acpi.h"
 #include "cache.h"
+#include "cpu_interpreter.h"
 #include "cpu_mmu_spt.h"
 #include "cpuid.h"
 #include "gmm.h"
@@ -78,6 +79,7 @@ struct vcpu {
 	struct io_io_data io;
 	struct msr_data msr;
 	struct vmctl_func vmctl;
+	struct cpu_interpreter_data interp;
 	/* vcpu0: data per VM */
 	struct vcpu *vcpu0;
 	struct mmio_data mmio;
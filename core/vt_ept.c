@@ -28,89 +28,289 @@
  */
 
 #include "asm.h"
+#include "assert.h"
 #include "constants.h"
 #include "convert.h"
 #include "current.h"
 #include "gmm_access.h"
+#include "initfunc.h"
 #include "mm.h"
 #include "panic.h"
+#include "printf.h"
 #include "string.h"
+#include "vmmcall_status.h"
 #include "vt_ept.h"
 #include "vt_main.h"
 #include "vt_paging.h"
 #include "vt_regs.h"
 
-#define NUM_OF_EPTBL	1024
+#define NUM_OF_EPTBL		256	/* tables allocated at first */
+#define MAX_NUM_OF_EPTBL	2048
+#define EPTBL_GROW		128	/* tables allocated at once */
+#define EPTBL_RESERVED_PAGES	4096	/* pages left for others */
+#define EPTBL_RECLAIM		32	/* tables evicted at once */
 #define EPTE_READ	0x1
 #define EPTE_READEXEC	0x5
 #define EPTE_WRITE	0x2
+#define EPTE_LARGE	0x80
+#define EPTE_ACCESSED	0x100
 #define EPTE_ATTR_MASK	0xFFF
 #define EPTE_MT_SHIFT	3
 #define EPT_LEVELS	4
 
+struct vt_ept_tbl {
+	void *virt;
+	phys_t phys;
+	u64 *parent;		/* entry pointing to this table */
+	int level;		/* level of entries, -1 if free */
+	int next;		/* next free table */
+};
+
 struct vt_ept {
-	int cnt;
+	int cnt;		/* tables [0, cnt) have been used */
+	int num;		/* tables allocated */
+	int free;		/* head of the free list, -1 if empty */
+	int nfree;
+	int hand;		/* clock hand for reclamation */
+	int large_level;	/* 0: 4KiB only, 1: 2MiB, 2: 1GiB */
+	bool ad;		/* accessed flags are available */
 	void *ncr3tbl;
 	phys_t ncr3tbl_phys;
-	void *tbl[NUM_OF_EPTBL];
-	phys_t tbl_phys[NUM_OF_EPTBL];
+	struct vt_ept_tbl tbl[MAX_NUM_OF_EPTBL];
 };
 
+static u32 stat_tblcnt = 0;
+static u32 stat_evictcnt = 0;
+static u32 stat_reclaimcnt = 0;
+static u32 stat_fullcnt = 0;
+static u32 stat_clearcnt = 0;
+
+static void
+vt_ept_tbl_alloc (struct vt_ept *ept, int n)
+{
+	int i;
+
+	for (i = 0; i < n && ept->num < MAX_NUM_OF_EPTBL; i++) {
+		alloc_page (&ept->tbl[ept->num].virt,
+			    &ept->tbl[ept->num].phys);
+		ept->tbl[ept->num].level = -1;
+		ept->num++;
+		STATUS_UPDATE (asm_lock_incl (&stat_tblcnt));
+	}
+}
+
 void
 vt_ept_init (void)
 {
 	struct vt_ept *ept;
-	int i;
+	u64 ept_vpid_cap;
+	ulong eptp;
 
 	ept = alloc (sizeof *ept);
 	alloc_page (&ept->ncr3tbl, &ept->ncr3tbl_phys);
 	memset (ept->ncr3tbl, 0, PAGESIZE);
-	for (i = 0; i < NUM_OF_EPTBL; i++)
-		alloc_page (&ept->tbl[i], &ept->tbl_phys[i]);
+	ept->num = 0;
+	vt_ept_tbl_alloc (ept, NUM_OF_EPTBL);
 	ept->cnt = 0;
+	ept->free = -1;
+	ept->nfree = 0;
+	ept->hand = 0;
+	ept->large_level = 0;
+	asm_rdmsr64 (MSR_IA32_VMX_EPT_VPID_CAP, &ept_vpid_cap);
+	if (ept_vpid_cap & MSR_IA32_VMX_EPT_VPID_CAP_2MB_PAGE_BIT) {
+		ept->large_level = 1;
+		if (ept_vpid_cap & MSR_IA32_VMX_EPT_VPID_CAP_1GB_PAGE_BIT)
+			ept->large_level = 2;
+	}
+	ept->ad = !!(ept_vpid_cap & MSR_IA32_VMX_EPT_VPID_CAP_AD_BIT);
 	current->u.vt.ept = ept;
-	asm_vmwrite (VMCS_EPT_POINTER, ept->ncr3tbl_phys |
-		     VMCS_EPT_POINTER_EPT_WB | VMCS_EPT_PAGEWALK_LENGTH_4);
+	eptp = ept->ncr3tbl_phys | VMCS_EPT_POINTER_EPT_WB |
+		VMCS_EPT_PAGEWALK_LENGTH_4;
+	if (ept->ad)
+		eptp |= VMCS_EPT_POINTER_AD_BIT;
+	asm_vmwrite (VMCS_EPT_POINTER, eptp);
 	asm_vmwrite (VMCS_EPT_POINTER_HIGH, 0);
 }
 
+/* remove all mappings without flushing TLB */
 static void
-vt_ept_map_page (bool write, u64 gphys)
+vt_ept_reset (struct vt_ept *ept)
+{
+	int i;
+
+	memset (ept->ncr3tbl, 0, PAGESIZE);
+	for (i = 0; i < ept->cnt; i++)
+		ept->tbl[i].level = -1;
+	ept->cnt = 0;
+	ept->free = -1;
+	ept->nfree = 0;
+	ept->hand = 0;
+}
+
+static bool
+vt_ept_tbl_has_child (struct vt_ept_tbl *t)
+{
+	int i;
+	u64 *e;
+
+	if (t->level == 0)
+		return false;
+	e = t->virt;
+	for (i = 0; i < 512; i++)
+		if ((e[i] & EPTE_READ) && !(e[i] & EPTE_LARGE))
+			return true;
+	return false;
+}
+
+/* Evict up to n tables that have no child tables and have not been */
+/* used by the processor since the clock hand passed last time. */
+/* Without accessed flags, the tables are evicted in the clock order. */
+static int
+vt_ept_tbl_reclaim (struct vt_ept *ept, int n)
+{
+	int i, evicted;
+	struct vt_ept_tbl *t;
+
+	evicted = 0;
+	for (i = 0; i < ept->cnt * 2 && evicted < n; i++) {
+		if (ept->hand >= ept->cnt)
+			ept->hand = 0;
+		t = &ept->tbl[ept->hand];
+		if (t->level < 0 || vt_ept_tbl_has_child (t))
+			goto next;
+		if (ept->ad && (*t->parent & EPTE_ACCESSED)) {
+			*t->parent &= ~EPTE_ACCESSED;
+			goto next;
+		}
+		*t->parent = 0;
+		t->level = -1;
+		t->next = ept->free;
+		ept->free = ept->hand;
+		ept->nfree++;
+		evicted++;
+		STATUS_UPDATE (asm_lock_incl (&stat_evictcnt));
+	next:
+		ept->hand++;
+	}
+	if (evicted) {
+		STATUS_UPDATE (asm_lock_incl (&stat_reclaimcnt));
+		vt_paging_flush_guest_tlb ();
+	}
+	return evicted;
+}
+
+/* make n or more tables available by using free tables, allocating */
+/* new tables, evicting cold tables or removing all mappings */
+static void
+vt_ept_tbl_reserve (struct vt_ept *ept, int n)
+{
+	while (ept->nfree + ept->num - ept->cnt < n) {
+		if (ept->num < MAX_NUM_OF_EPTBL &&
+		    num_of_available_pages () > EPTBL_RESERVED_PAGES) {
+			vt_ept_tbl_alloc (ept, EPTBL_GROW);
+			continue;
+		}
+		if (vt_ept_tbl_reclaim (ept, EPTBL_RECLAIM) > 0)
+			continue;
+		/* printf ("!"); */
+		vt_ept_reset (ept);
+		STATUS_UPDATE (asm_lock_incl (&stat_fullcnt));
+		vt_paging_flush_guest_tlb ();
+	}
+}
+
+static struct vt_ept_tbl *
+vt_ept_tbl_get (struct vt_ept *ept, u64 *parent, int level)
+{
+	struct vt_ept_tbl *t;
+
+	if (ept->free >= 0) {
+		t = &ept->tbl[ept->free];
+		ept->free = t->next;
+		ept->nfree--;
+	} else {
+		ASSERT (ept->cnt < ept->num);
+		t = &ept->tbl[ept->cnt++];
+	}
+	memset (t->virt, 0, PAGESIZE);
+	t->parent = parent;
+	t->level = level;
+	*parent = t->phys | EPTE_READEXEC | EPTE_WRITE;
+	return t;
+}
+
+/* Find the largest page that can map gphys.  A large page is used */
+/* only if the whole range is contiguous and writable host memory, */
+/* has the same memory type and has no MMIO handlers. */
+/* Returns 0 for a 4KiB page, 1 for a 2MiB page and 2 for a 1GiB page. */
+static int
+vt_ept_large_level (struct vt_ept *ept, u64 gphys)
 {
 	int l;
-	bool fakerom;
-	u64 hphys;
+	u64 size, base;
+
+	for (l = ept->large_level; l > 0; l--) {
+		size = PAGESIZE << (9 * l);
+		base = gphys & ~(size - 1);
+		if (current->gmm.gp2hp_large (base, size) ==
+		    GMM_GP2HP_LARGE_FAIL)
+			continue;
+		if (!cache_gmtrr_type_equal (base, size - 1))
+			continue;
+		if (mmio_range (base, size))
+			continue;
+		break;
+	}
+	return l;
+}
+
+static void
+vt_ept_map_page (bool write, u64 gphys)
+{
+	int l, ll;
+	bool fakerom, flush;
+	u64 hphys, size;
 	u32 hattr;
 	struct vt_ept *ept;
-	u64 *p, *q, e;
+	struct vt_ept_tbl *t;
+	u64 *p, e;
 
 	ept = current->u.vt.ept;
-	q = ept->ncr3tbl;
-	q += (gphys >> (EPT_LEVELS * 9 + 3)) & 0x1FF;
-	p = q;
+	ll = vt_ept_large_level (ept, gphys);
+	flush = false;
+	vt_ept_tbl_reserve (ept, EPT_LEVELS - 1);
+	p = ept->ncr3tbl;
+	p += (gphys >> (EPT_LEVELS * 9 + 3)) & 0x1FF;
 	for (l = EPT_LEVELS - 1; l > 0; l--) {
 		e = *p;
-		if (!(e & EPTE_READ)) {
-			if (ept->cnt + l > NUM_OF_EPTBL) {
-				/* printf ("!"); */
-				memset (ept->ncr3tbl, 0, PAGESIZE);
-				ept->cnt = 0;
-				vt_paging_flush_guest_tlb ();
-				l = EPT_LEVELS - 1;
-				p = q;
-			}
+		if (!(e & EPTE_READ) || (e & EPTE_LARGE)) {
+			if (e & EPTE_READ)
+				flush = true;
 			break;
 		}
 		e &= ~PAGESIZE_MASK;
 		e |= (gphys >> (9 * l)) & 0xFF8;
 		p = (u64 *)phys_to_virt (e);
 	}
-	for (; l > 0; l--) {
-		*p = ept->tbl_phys[ept->cnt] | EPTE_READEXEC | EPTE_WRITE;
-		p = ept->tbl[ept->cnt++];
-		memset (p, 0, PAGESIZE);
+	/* Existing tables are reused and a large page is put in a */
+	/* smaller level in that case.  It is safe because a range */
+	/* that can be mapped by a large page can also be mapped by */
+	/* smaller large pages. */
+	if (ll > l)
+		ll = l;
+	for (; l > ll; l--) {
+		t = vt_ept_tbl_get (ept, p, l - 1);
+		p = t->virt;
 		p += (gphys >> (9 * l + 3)) & 0x1FF;
 	}
+	if (ll > 0) {
+		size = PAGESIZE << (9 * ll);
+		hphys = current->gmm.gp2hp_large (gphys & ~(size - 1), size);
+		hattr = (cache_get_gmtrr_type (gphys) << EPTE_MT_SHIFT) |
+			EPTE_READEXEC | EPTE_WRITE | EPTE_LARGE;
+		*p = hphys | hattr;
+		goto end;
+	}
 	hphys = current->gmm.gp2hp (gphys, &fakerom) & ~PAGESIZE_MASK;
 	if (fakerom && write)
 		panic ("EPT: Writing to VMM memory.");
@@ -119,6 +319,9 @@ vt_ept_map_page (bool write, u64 gphys)
 	if (fakerom)
 		hattr &= ~EPTE_WRITE;
 	*p = hphys | hattr;
+end:
+	if (flush)
+		vt_paging_flush_guest_tlb ();
 }
 
 void
@@ -174,31 +377,50 @@ vt_ept_clear_all (void)
 	struct vt_ept *ept;
 
 	ept = current->u.vt.ept;
-	memset (ept->ncr3tbl, 0, PAGESIZE);
-	ept->cnt = 0;
+	vt_ept_reset (ept);
+	STATUS_UPDATE (asm_lock_incl (&stat_clearcnt));
 	vt_paging_flush_guest_tlb ();
 }
 
 bool
 vt_ept_extern_mapsearch (struct vcpu *p, phys_t start, phys_t end)
 {
-	u64 *e, tmp, mask = p->pte_addr_mask;
+	u64 *e, tmp, tmpend, mask = p->pte_addr_mask;
 	unsigned int cnt, i, j, n = 512;
 	struct vt_ept *ept;
+	bool flush = false;
 
 	ept = p->u.vt.ept;
 	cnt = ept->cnt;
 	for (i = 0; i < cnt; i++) {
-		e = ept->tbl[i];
+		if (ept->tbl[i].level < 0)
+			continue;
+		e = ept->tbl[i].virt;
 		for (j = 0; j < n; j++) {
+			if (!(e[j] & EPTE_READ))
+				continue;
+			/* Entries pointing to a child table hold the
+			 * table address, not a guest address.  The
+			 * leaf entries in the child are checked when
+			 * that table is visited. */
+			if (ept->tbl[i].level > 0 && !(e[j] & EPTE_LARGE))
+				continue;
 			tmp = e[j] & mask;
-			if ((e[j] & EPTE_READ) && start <= tmp && tmp <= end) {
+			tmpend = tmp;
+			if (e[j] & EPTE_LARGE)
+				tmpend |= (PAGESIZE <<
+					   (9 * ept->tbl[i].level)) - 1;
+			if (start <= tmpend && tmp <= end) {
 				if (p != current)
 					return true;
+				if (e[j] & EPTE_LARGE)
+					flush = true;
 				e[j] = 0;
 			}
 		}
 	}
+	if (flush)
+		vt_paging_flush_guest_tlb ();
 	return false;
 }
 
@@ -215,3 +437,26 @@ vt_ept_map_1mb (void)
 		mmio_unlock ();
 	}
 }
+
+static char *
+vt_ept_status (void)
+{
+	static char buf[1024];
+
+	snprintf (buf, 1024,
+		  "EPT:\n"
+		  " Tables: %u\n"
+		  " Evict: %u Reclaim: %u\n"
+		  " Full: %u Clear: %u\n"
+		  , stat_tblcnt, stat_evictcnt, stat_reclaimcnt
+		  , stat_fullcnt, stat_clearcnt);
+	return buf;
+}
+
+static void
+vt_ept_register_status_callback (void)
+{
+	register_status_callback (vt_ept_status);
+}
+
+INITFUNC ("paral01", vt_ept_register_status_callback);
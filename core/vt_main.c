@@ -34,9 +34,11 @@
 #include "cpu_mmu.h"
 #include "current.h"
 #include "exint_pass.h"
+#include "exitstat.h"
 #include "gmm_pass.h"
 #include "initfunc.h"
 #include "linkage.h"
+#include "mmio.h"
 #include "panic.h"
 #include "pcpu.h"
 #include "printf.h"
@@ -56,6 +58,9 @@
 #include "vt_vmcs.h"
 
 #define EPT_VIOLATION_EXIT_QUAL_WRITE_BIT 0x2
+#define EPT_VIOLATION_EXIT_QUAL_FETCH_BIT 0x4
+#define EPT_VIOLATION_EXIT_QUAL_LINEAR_VALID_BIT 0x80
+#define EPT_VIOLATION_EXIT_QUAL_TRANSLATION_BIT 0x100
 
 enum vt__status {
 	VT__VMENTRY_SUCCESS,
@@ -337,7 +342,9 @@ vt__vm_run_first (void)
 {
 	enum vt__status status;
 
+	exitstat_vmentry ();
 	status = call_vt__vmlaunch ();
+	exitstat_vmexit ();
 	if (status != VT__VMEXIT) {
 		if (status == VT__VMENTRY_FAILED)
 			panic ("Fatal error: VM entry failed.");
@@ -358,7 +365,9 @@ vt__vm_run (void)
 	}
 	if (current->u.vt.saved_vmcs)
 		spinlock_unlock (&currentcpu->suspend_lock);
+	exitstat_vmentry ();
 	status = call_vt__vmresume ();
+	exitstat_vmexit ();
 	if (current->u.vt.saved_vmcs)
 		spinlock_lock (&currentcpu->suspend_lock);
 	if (status != VT__VMEXIT) {
@@ -710,12 +719,48 @@ do_ept_violation (void)
 	ulong eqe;
 	ulong gpl, gph;
 	u64 gp;
+	bool write;
 
 	asm_vmread (VMCS_EXIT_QUALIFICATION, &eqe);
 	asm_vmread (VMCS_GUEST_PHYSICAL_ADDRESS, &gpl);
 	asm_vmread (VMCS_GUEST_PHYSICAL_ADDRESS_HIGH, &gph);
 	conv32to64 (gpl, gph, &gp);
-	vt_paging_npf (!!(eqe & EPT_VIOLATION_EXIT_QUAL_WRITE_BIT), gp);
+	write = !!(eqe & EPT_VIOLATION_EXIT_QUAL_WRITE_BIT);
+	/* data access to the final guest physical address, not an */
+	/* access to guest paging structures or an instruction fetch */
+	if ((eqe & EPT_VIOLATION_EXIT_QUAL_LINEAR_VALID_BIT) &&
+	    (eqe & EPT_VIOLATION_EXIT_QUAL_TRANSLATION_BIT) &&
+	    !(eqe & EPT_VIOLATION_EXIT_QUAL_FETCH_BIT) &&
+	    mmio_access_page_fast (gp, write, NULL, 0))
+		return;
+	vt_paging_npf (write, gp);
+}
+
+static enum exitstat_type
+vt_exitstat_type (ulong exit_reason)
+{
+	switch (exit_reason & EXIT_REASON_MASK) {
+	case EXIT_REASON_MOV_CR:
+		return EXITSTAT_CR;
+	case EXIT_REASON_CPUID:
+		return EXITSTAT_CPUID;
+	case EXIT_REASON_IO_INSTRUCTION:
+		return EXITSTAT_IO;
+	case EXIT_REASON_RDMSR:
+	case EXIT_REASON_WRMSR:
+		return EXITSTAT_MSR;
+	case EXIT_REASON_EXCEPTION_OR_NMI:
+		return EXITSTAT_EXCEPTION;
+	case EXIT_REASON_EXTERNAL_INT:
+	case EXIT_REASON_INTERRUPT_WINDOW:
+		return EXITSTAT_INTR;
+	case EXIT_REASON_HLT:
+		return EXITSTAT_HLT;
+	case EXIT_REASON_EPT_VIOLATION:
+		return EXITSTAT_NPF;
+	default:
+		return EXITSTAT_OTHER;
+	}
 }
 
 static void
@@ -726,6 +771,7 @@ vt__exit_reason (void)
 	asm_vmread (VMCS_EXIT_REASON, &exit_reason);
 	if (exit_reason & EXIT_REASON_VMENTRY_FAILURE_BIT)
 		panic ("Fatal error: VM Entry failure.");
+	exitstat_set_type (vt_exitstat_type (exit_reason));
 	switch (exit_reason & EXIT_REASON_MASK) {
 	case EXIT_REASON_MOV_CR:
 		do_mov_cr ();
@@ -29,6 +29,7 @@
 
 #include "asm.h"
 #include "constants.h"
+#include "cpu_interpreter.h"
 #include "current.h"
 #include "entry.h"
 #include "mm.h"
@@ -373,6 +374,7 @@ vt_write_control_reg (enum control_reg reg, ulong val)
 		break;
 	case CONTROL_REG_CR3:
 		current->u.vt.vr.cr3 = val;
+		cpu_interpreter_flush_cache ();
 		vt_paging_updatecr3 ();
 		vt_paging_flush_guest_tlb ();
 		break;
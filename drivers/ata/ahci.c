@@ -56,6 +56,8 @@
 /* According to the AHCI 1.3 specification, bit0-6 of CTBA is
    reserved, but 88SE91xx is different. */
 #define CTBA_MASK		0x3F /* for supporting 88SE91xx */
+#define DMABUF_ALIGN		0x10000
+#define DMABUF_KEEP_MAX		0x40000 /* larger buffers are freed */
 
 static const char driver_name[] = "ahci_driver";
 static int ahci_host_id = 0;
@@ -197,6 +199,7 @@ struct ahci_port {
 		phys_t cmdtbl_p;
 		void *dmabuf;
 		phys_t dmabuf_p;
+		u32 dmabufsize;
 		u32 dmabuflen;
 		u64 dmabuf_lba;
 		u32 dmabuf_nsec;
@@ -386,6 +389,34 @@ ahci_get_dmalen (struct command_table *cmdtbl, u16 prdtl, unsigned int *intr)
 	return totalsize;
 }
 
+static void
+ahci_free_dmabuf (struct ahci_port *port, int cmdhdr_index)
+{
+	if (port->my[cmdhdr_index].dmabuf)
+		free (port->my[cmdhdr_index].dmabuf);
+	port->my[cmdhdr_index].dmabuf = NULL;
+	port->my[cmdhdr_index].dmabufsize = 0;
+}
+
+static void
+ahci_crypt_dmabuf (struct ahci_port *port, int cmdhdr_index, bool wr,
+		   u32 off, u32 len, u8 *src, u8 *dst)
+{
+	struct storage_access access;
+	u32 ssiz = port->my[cmdhdr_index].dmabuf_ssiz;
+
+	access.rw = wr ? 1 : 0;
+	access.lba = port->my[cmdhdr_index].dmabuf_lba + off / ssiz;
+	access.count = len / ssiz;
+	access.sector_size = ssiz;
+	storage_handle_sectors (port->storage_device, &access, src, dst);
+}
+
+/* Copy data between the guest buffer and the shadow buffer.  Sectors
+   of read/write commands are encrypted or decrypted during the copy
+   instead of being copied and then processed in place.  A sector
+   split between PRD entries is assembled in the shadow buffer and
+   processed there. */
 static void
 ahci_copy_dmabuf (struct ahci_port *port, int cmdhdr_index, bool wr,
 		  struct command_table *cmdtbl, u16 prdtl)
@@ -393,42 +424,66 @@ ahci_copy_dmabuf (struct ahci_port *port, int cmdhdr_index, bool wr,
 	u8 *mybuf = port->my[cmdhdr_index].dmabuf;
 	u32 dba, dbau, dbc;
 	phys_t db_phys;
-	void *gbuf;
+	u8 *gbuf, *p;
 	int i;
-	u32 remain;
+	u32 off, end, ssiz, n, s;
 
 	ASSERT (mybuf);
-	remain = port->my[cmdhdr_index].dmabuflen;
-	if (wr) {
-		/* copy guest buffer to shadow buffer */
-		for (i = 0; i < prdtl; i++) {
-			dba = cmdtbl->prdt[i].dba;
-			dbau = cmdtbl->prdt[i].dbau;
-			dbc = (cmdtbl->prdt[i].dbc & 0x3FFFFE) + 2;
-			ASSERT (remain >= dbc);
-			remain -= dbc;
-			db_phys = ahci_get_phys (dba & ~1, dbau);
-			gbuf = mapmem_gphys (db_phys, dbc, 0);
-			memcpy (mybuf, gbuf, dbc);
-			mybuf += dbc;
-			unmapmem (gbuf, dbc);
-		}
-	} else {
-		/* copy shadow buffer to guest buffer */
-		for (i = 0; i < prdtl; i++) {
-			dba = cmdtbl->prdt[i].dba;
-			dbau = cmdtbl->prdt[i].dbau;
-			dbc = (cmdtbl->prdt[i].dbc & 0x3FFFFE) + 2;
-			ASSERT (remain >= dbc);
-			remain -= dbc;
-			db_phys = ahci_get_phys (dba & ~1, dbau);
-			gbuf = mapmem_gphys (db_phys, dbc, MAPMEM_WRITE);
-			memcpy (gbuf, mybuf, dbc);
-			mybuf += dbc;
-			unmapmem (gbuf, dbc);
+	ssiz = port->my[cmdhdr_index].dmabuf_ssiz;
+	end = 0;
+	if (port->my[cmdhdr_index].dmabuf_rwflag)
+		end = port->my[cmdhdr_index].dmabuf_nsec * ssiz;
+	off = 0;
+	for (i = 0; i < prdtl; i++) {
+		dba = cmdtbl->prdt[i].dba;
+		dbau = cmdtbl->prdt[i].dbau;
+		dbc = (cmdtbl->prdt[i].dbc & 0x3FFFFE) + 2;
+		ASSERT (port->my[cmdhdr_index].dmabuflen - off >= dbc);
+		db_phys = ahci_get_phys (dba & ~1, dbau);
+		gbuf = mapmem_gphys (db_phys, dbc, MAPMEM_TEMP |
+				     (wr ? 0 : MAPMEM_WRITE));
+		for (p = gbuf; p < gbuf + dbc; p += n, off += n) {
+			n = gbuf + dbc - p;
+			if (off >= end) {
+				if (wr)
+					memcpy (mybuf + off, p, n);
+				else
+					memcpy (p, mybuf + off, n);
+			} else if (off % ssiz == 0 && n >= ssiz) {
+				if (n > end - off)
+					n = end - off;
+				n -= n % ssiz;
+				if (wr)
+					ahci_crypt_dmabuf (port, cmdhdr_index,
+							   wr, off, n, p,
+							   mybuf + off);
+				else
+					ahci_crypt_dmabuf (port, cmdhdr_index,
+							   wr, off, n,
+							   mybuf + off, p);
+			} else {
+				s = off - off % ssiz;
+				if (n > s + ssiz - off)
+					n = s + ssiz - off;
+				if (!wr && off == s)
+					ahci_crypt_dmabuf (port, cmdhdr_index,
+							   wr, s, ssiz,
+							   mybuf + s,
+							   mybuf + s);
+				if (wr)
+					memcpy (mybuf + off, p, n);
+				else
+					memcpy (p, mybuf + off, n);
+				if (wr && off + n == s + ssiz)
+					ahci_crypt_dmabuf (port, cmdhdr_index,
+							   wr, s, ssiz,
+							   mybuf + s,
+							   mybuf + s);
+			}
 		}
+		unmapmem (gbuf, dbc);
 	}
-	ASSERT (remain == 0);
+	ASSERT (off == port->my[cmdhdr_index].dmabuflen);
 }
 
 static bool
@@ -588,6 +643,8 @@ ahci_port_data_init (struct ahci_data *ad, int port_num)
 		port->my[i].cmdtbl = virt;
 		port->my[i].cmdtbl_p = phys;
 		port->my[i].dmabuf = NULL;
+		port->my[i].dmabufsize = 0;
+		port->my[i].dmabuf_ssiz = 512;
 	}
 	port->storage_device = storage_new (STORAGE_TYPE_AHCI, ad->host_id,
 					    port_num, NULL, NULL);
@@ -787,7 +844,6 @@ ahci_cmd_prehook (struct ahci_data *ad, struct ahci_port *port,
 	u8 *acmd;
 	union cmdfis *cfis;
 	ata_cmd_type_t type;
-	struct storage_access access;
 
 	cfis = &port->my[cmdhdr_index].cmdtbl->cfis;
 	acmd = port->my[cmdhdr_index].cmdtbl->acmd;
@@ -806,41 +862,16 @@ ahci_cmd_prehook (struct ahci_data *ad, struct ahci_port *port,
 							    type.rw, type.ext);
 		ASSERT (!port->my[cmdhdr_index].dmabuf_rwflag || !port->atapi);
 	}
-	if (!port->my[cmdhdr_index].dmabuf_rwflag)
-		return;
-	if (!port->mycmdlist->cmdhdr[cmdhdr_index].w) /* read */
-		return;
-	access.rw = 1;
-	access.lba = port->my[cmdhdr_index].dmabuf_lba;
-	access.count = port->my[cmdhdr_index].dmabuf_nsec;
-	access.sector_size = port->my[cmdhdr_index].dmabuf_ssiz;
-	storage_handle_sectors (port->storage_device, &access,
-				port->my[cmdhdr_index].dmabuf,
-				port->my[cmdhdr_index].dmabuf);
 }
 
 static void
 ahci_cmd_posthook (struct ahci_data *ad, struct ahci_port *port,
 		   int cmdhdr_index)
 {
-	struct storage_access access;
-
 	if (port->my[cmdhdr_index].dmabuf_identify) {
 		/* check atapi or not */
 		ahci_identity_check (ad, port, cmdhdr_index);
-		return;
 	}
-	if (!port->my[cmdhdr_index].dmabuf_rwflag)
-		return;
-	if (port->mycmdlist->cmdhdr[cmdhdr_index].w) /* write */
-		return;
-	access.rw = 0;
-	access.lba = port->my[cmdhdr_index].dmabuf_lba;
-	access.count = port->my[cmdhdr_index].dmabuf_nsec;
-	access.sector_size = port->my[cmdhdr_index].dmabuf_ssiz;
-	storage_handle_sectors (port->storage_device, &access,
-				port->my[cmdhdr_index].dmabuf,
-				port->my[cmdhdr_index].dmabuf);
 }
 
 /************************************************************/
@@ -857,27 +888,62 @@ ahci_cmd_cancel (struct ahci_port *port)
 		if (!(port->shadowbit & (1 << i)))
 			continue;
 		port->shadowbit &= ~(1 << i);
-		if (port->my[i].dmabuf) {
-			free (port->my[i].dmabuf);
-			port->my[i].dmabuf = NULL;
-		}
 		if (!port->shadowbit)
 			break;
 	}
 }
 
+/* Slots processed by storage_parallel().  Only memory accessible
+   from every CPU is referenced here; the guest command tables are
+   mapped again by the thread processing each slot. */
+struct ahci_cmd_job {
+	struct ahci_data *ad;
+	struct ahci_port *port;
+	int port_num;
+	int n;
+	int slot[NUM_OF_COMMAND_HEADER];
+	u16 prdtl[NUM_OF_COMMAND_HEADER];
+	phys_t ctphys[NUM_OF_COMMAND_HEADER];
+	spinlock_t lock;
+	int issued;
+	bool ready[NUM_OF_COMMAND_HEADER];
+};
+
+static void
+ahci_cmd_complete_slot (void *arg, int n)
+{
+	struct ahci_cmd_job *job = arg;
+	struct command_table *cmdtbl;
+	int i = job->slot[n];
+	u16 prdtl = job->prdtl[n];
+
+	cmdtbl = mapmem_gphys (job->ctphys[n], cmdtbl_size (prdtl),
+			       MAPMEM_WRITE | MAPMEM_TEMP);
+	ahci_cmd_posthook (job->ad, job->port, i);
+	if (!(job->port->mycmdlist->cmdhdr[i].w)) /* read */
+		ahci_copy_dmabuf (job->port, i, false, cmdtbl, prdtl);
+	unmapmem (cmdtbl, cmdtbl_size (prdtl));
+}
+
+/* Completed slots are decrypted in parallel.  The guest sees the
+   completion only after the MMIO access that found it returns, that
+   is, after all the slots have been processed. */
 static void
 ahci_cmd_complete (struct ahci_data *ad, struct ahci_port *port, u32 pxsact,
 		   u32 pxci)
 {
 	struct command_list *cmdlist;
-	struct command_table *cmdtbl;
+	struct ahci_cmd_job job;
 	int i;
 	u16 prdtl;
-	phys_t ctphys;
+	u32 done;
 
 	cmdlist = mapmem_gphys (ahci_get_phys (port->clb, port->clbu),
-				sizeof *cmdlist, MAPMEM_WRITE);
+				sizeof *cmdlist, MAPMEM_WRITE | MAPMEM_TEMP);
+	job.ad = ad;
+	job.port = port;
+	job.n = 0;
+	done = 0;
 	for (i = 0; i < NUM_OF_COMMAND_HEADER; i++) {
 		if (!(port->shadowbit & (1 << i)))
 			continue;
@@ -886,33 +952,62 @@ ahci_cmd_complete (struct ahci_data *ad, struct ahci_port *port, u32 pxsact,
 		if (pxsact & (1 << i))
 			continue;
 		port->shadowbit &= ~(1 << i);
+		done |= 1 << i;
 		prdtl = cmdlist->cmdhdr[i].prdtl;
 		if (prdtl > 0) {
-			ctphys = ahci_get_phys
+			job.slot[job.n] = i;
+			job.prdtl[job.n] = prdtl;
+			job.ctphys[job.n] = ahci_get_phys
 				(cmdlist->cmdhdr[i].ctba & ~CTBA_MASK,
 				 cmdlist->cmdhdr[i].ctbau);
-			cmdtbl = mapmem_gphys (ctphys, cmdtbl_size (prdtl),
-					       MAPMEM_WRITE);
-			ahci_cmd_posthook (ad, port, i);
-			if (!(port->mycmdlist->cmdhdr[i].w)) /* read */
-				ahci_copy_dmabuf (port, i, false, cmdtbl,
-						  prdtl);
-			unmapmem (cmdtbl, cmdtbl_size (prdtl));
-			free (port->my[i].dmabuf);
-			port->my[i].dmabuf = NULL;
-		} else {
-			ASSERT (port->my[i].dmabuf == NULL);
+			job.n++;
 		}
+	}
+	storage_parallel (ahci_cmd_complete_slot, &job, job.n);
+	for (i = 0; i < NUM_OF_COMMAND_HEADER; i++) {
+		if (!(done & (1 << i)))
+			continue;
 		cmdlist->cmdhdr[i].prdbc = port->mycmdlist->cmdhdr[i].prdbc;
+		if (port->my[i].dmabufsize > DMABUF_KEEP_MAX)
+			ahci_free_dmabuf (port, i);
 	}
 	unmapmem (cmdlist, sizeof *cmdlist);
 }
 
+/* Encrypt the data of a write command and issue the slot.  Slots are
+   issued to the controller in the order of the slot numbers, each as
+   soon as it and the slots before it are ready, so that the
+   controller starts working while later slots are encrypted. */
+static void
+ahci_cmd_start_slot (void *arg, int n)
+{
+	struct ahci_cmd_job *job = arg;
+	struct command_table *cmdtbl;
+	int i = job->slot[n];
+	u16 prdtl = job->prdtl[n];
+
+	if (prdtl > 0 && job->port->mycmdlist->cmdhdr[i].w) { /* write */
+		cmdtbl = mapmem_gphys (job->ctphys[n], cmdtbl_size (prdtl),
+				       MAPMEM_TEMP);
+		ahci_copy_dmabuf (job->port, i, true, cmdtbl, prdtl);
+		unmapmem (cmdtbl, cmdtbl_size (prdtl));
+	}
+	spinlock_lock (&job->lock);
+	job->ready[n] = true;
+	while (job->issued < job->n && job->ready[job->issued]) {
+		ahci_port_write (job->ad, job->port_num, PxCI,
+				 1 << job->slot[job->issued]);
+		job->issued++;
+	}
+	spinlock_unlock (&job->lock);
+}
+
 static void
 ahci_cmd_start (struct ahci_data *ad, struct ahci_port *pt, u32 pxci)
 {
 	struct command_list *cmdlist;
 	struct command_table *cmdtbl;
+	struct ahci_cmd_job job;
 	int i;
 	u16 prdtl;
 	phys_t ctphys;
@@ -920,26 +1015,40 @@ ahci_cmd_start (struct ahci_data *ad, struct ahci_port *pt, u32 pxci)
 	unsigned int intrflag;
 
 	cmdlist = mapmem_gphys (ahci_get_phys (pt->clb, pt->clbu),
-				sizeof *cmdlist, MAPMEM_WRITE);
+				sizeof *cmdlist, MAPMEM_WRITE | MAPMEM_TEMP);
+	job.ad = ad;
+	job.port = pt;
+	job.port_num = pt - ad->port;
+	job.n = 0;
+	spinlock_init (&job.lock);
+	job.issued = 0;
 	for (i = 0; i < NUM_OF_COMMAND_HEADER; i++) {
 		if (!(pxci & (1 << i)))
 			continue;
 		memcpy (&pt->mycmdlist->cmdhdr[i], &cmdlist->cmdhdr[i],
 			sizeof (struct command_header));
 		prdtl = pt->mycmdlist->cmdhdr[i].prdtl;
+		ctphys = 0;
 		if (prdtl > 0) {
 			ctphys = ahci_get_phys
 				(cmdlist->cmdhdr[i].ctba & ~CTBA_MASK,
 				 cmdlist->cmdhdr[i].ctbau);
 			cmdtbl = mapmem_gphys (ctphys, cmdtbl_size (prdtl),
-					       MAPMEM_WRITE);
+					       MAPMEM_WRITE | MAPMEM_TEMP);
 			totalsize = ahci_get_dmalen (cmdtbl, prdtl, &intrflag);
 			ASSERT (totalsize < 4 * 1024 * 1024);
-			if (pt->my[i].dmabuf != NULL)
-				panic ("pt->my[i].dmabuf=%p is not NULL!",
-				       pt->my[i].dmabuf);
-			pt->my[i].dmabuf = alloc2 (totalsize,
-						   &pt->my[i].dmabuf_p);
+			/* The shadow buffer of a command slot is kept and
+			   reused up to DMABUF_KEEP_MAX bytes.  Larger ones
+			   are freed when the command completes. */
+			if (pt->my[i].dmabufsize < totalsize) {
+				ahci_free_dmabuf (pt, i);
+				pt->my[i].dmabufsize = (totalsize +
+							DMABUF_ALIGN - 1) &
+					~(DMABUF_ALIGN - 1);
+				pt->my[i].dmabuf = alloc2
+					(pt->my[i].dmabufsize,
+					 &pt->my[i].dmabuf_p);
+			}
 			pt->my[i].dmabuflen = totalsize;
 			pt->mycmdlist->cmdhdr[i].ctba = pt->my[i].cmdtbl_p;
 			pt->mycmdlist->cmdhdr[i].ctbau =
@@ -953,17 +1062,19 @@ ahci_cmd_start (struct ahci_data *ad, struct ahci_port *pt, u32 pxci)
 			pt->my[i].cmdtbl->prdt[0].dbc = (totalsize - 2) | 1;
 			pt->my[i].cmdtbl->prdt[0].i = intrflag;
 			pt->mycmdlist->cmdhdr[i].prdtl = 1;
-			if (pt->mycmdlist->cmdhdr[i].w) /* write */
-				ahci_copy_dmabuf (pt, i, true, cmdtbl, prdtl);
 			ahci_cmd_prehook (ad, pt, i);
 			unmapmem (cmdtbl, cmdtbl_size (prdtl));
-		} else {
-			ASSERT (pt->my[i].dmabuf == NULL);
 		}
 		ASSERT (!(pt->shadowbit & (1 << i)));
 		pt->shadowbit |= (1 << i);
+		job.slot[job.n] = i;
+		job.prdtl[job.n] = prdtl;
+		job.ctphys[job.n] = ctphys;
+		job.ready[job.n] = false;
+		job.n++;
 	}
 	unmapmem (cmdlist, sizeof *cmdlist);
+	storage_parallel (ahci_cmd_start_slot, &job, job.n);
 }
 
 /************************************************************/
@@ -1058,6 +1169,8 @@ mmhandler2 (struct ahci_data *ad, u32 offset, bool wr, u32 *buf32, uint len,
 			   in some BIOSes */
 			ASSERT (port->storage_device);
 			ahci_cmd_start (ad, port, *buf32);
+			/* ahci_cmd_start() has issued the slots */
+			return;
 		}
 		if (ahci_port_eq (offset, len, GLOBAL_GHC)) {
 			ahci_write (ad, GLOBAL_GHC, *buf32);
@@ -1168,6 +1281,8 @@ ahci_command_fill (struct ahci_port *port, int slot,
 		cfis->sector_count |= slot << 3;
 	cfis->sector_count_exp = cmd->sector_count_exp;
 	cfis->control = cmd->control;
+	/* the shadow buffer kept for guest commands is not used here */
+	ahci_free_dmabuf (port, slot);
 	if (cmd->buf_phys && !(cmd->buf_phys & 0x7F) && !(cmd->buf_len & 1) &&
 	    cmd->buf_len >= 2) {
 		port->my[slot].dmabuf = NULL;
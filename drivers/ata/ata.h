@@ -219,7 +219,6 @@ struct ata_channel {
 	void			*shadow_prd;
 	u32			shadow_prd_phys;
 	void			*shadow_buf;
-	long			shadow_buf_premap;
 
 	// handler
 	u32			base[3];
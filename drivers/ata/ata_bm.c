@@ -44,68 +44,165 @@
  * ATA Bus Master
  *********************************************************************************************************************/
 /* PRD handlers */
-static void ata_dma_handle_rw_sectors(struct ata_channel *channel, int rw)
-{
-	struct storage_access access;
+#define ATA_BM_PRD_BATCH	16
 
-	access.rw = rw;
-	access.lba = channel->lba;
-	access.count = channel->sector_count;
-	access.sector_size = ata_get_ata_device(channel)->storage_sector_size;
-	if (channel->atapi_device->atapi_flag != 0 && 
-			channel->atapi_device->dma_state != ATA_STATE_DMA_READY)
-		goto end;
+/* guest PRD table walker */
+struct ata_bm_walk {
+	phys_t			prd_phys;	/* next entry to be read */
+	ata_prd_table_t		prd[ATA_BM_PRD_BATCH];
+	int			index, num;
+	bool			eot;
+	int			total_count;
+};
+
+static void ata_bm_walk_init(struct ata_bm_walk *walk, struct ata_channel *channel)
+{
+	walk->prd_phys = channel->guest_prd_phys;
+	walk->index = walk->num = 0;
+	walk->eot = false;
+	walk->total_count = 0;
+}
 
-	storage_premap_handle_sectors (ata_get_storage_device(channel),
-				       &access, channel->shadow_buf,
-				       channel->shadow_buf,
-				       channel->shadow_buf_premap,
-				       channel->shadow_buf_premap);
-	channel->atapi_device->dma_state = ATA_STATE_DMA_THROUGH;
+// guest PRD entries are read up to the end of the page at once
+static ata_prd_table_t *ata_bm_walk_peek(struct ata_bm_walk *walk)
+{
+	int n;
 
- end:	return;
+	if (walk->index < walk->num)
+		return &walk->prd[walk->index];
+	n = (PAGESIZE - (walk->prd_phys & (PAGESIZE - 1))) / sizeof(ata_prd_table_t);
+	if (n < 1)
+		n = 1;
+	if (n > ATA_BM_PRD_BATCH)
+		n = ATA_BM_PRD_BATCH;
+	core_mm_read_guest_phys(walk->prd_phys, walk->prd, n * sizeof(ata_prd_table_t));
+	walk->prd_phys += n * sizeof(ata_prd_table_t);
+	walk->index = 0;
+	walk->num = n;
+	return &walk->prd[0];
 }
 
-static int ata_copy_shadow_buf(struct ata_channel *channel, int dir)
+/**
+ * get the next guest buffer, merging physically contiguous PRD entries
+ * @param walk
+ * @param base		guest physical address of the buffer
+ * @param len		length of the buffer
+ * @return		false if the PRD table has been finished
+ */
+static bool ata_bm_walk_next(struct ata_bm_walk *walk, phys_t *base, int *len)
 {
-	int count, total_count = 0;
-	phys_t guest_prd_phys = channel->guest_prd_phys;
-	u8 *shadow_buf = channel->shadow_buf;
-	ata_prd_table_t guest_prd;
-	phys_t (*copy)(phys_t phys, void *buf, int len);
+	ata_prd_table_t *guest_prd;
+	int count;
 
-	// To optimize:
-	// 1. cache the result of mapmem()
-	// 2. eliminate extra copy between the guest and the vmm by integrating encryption
-	copy = (dir == STORAGE_READ) ? core_mm_write_guest_phys : core_mm_read_guest_phys;
+	if (walk->eot)
+		return false;
+	*base = ata_bm_walk_peek(walk)->base;
+	*len = 0;
 	do {
-		guest_prd.value = core_mm_read_guest_phys64(guest_prd_phys);
-		count = ata_get_16bit_count(guest_prd.count);
-		total_count += count;
-		if (total_count > ATA_BM_TOTAL_BUFSIZE)
+		guest_prd = ata_bm_walk_peek(walk);
+		if (guest_prd->base != *base + *len)
+			break;
+		count = ata_get_16bit_count(guest_prd->count);
+		*len += count;
+		walk->total_count += count;
+		if (walk->total_count > ATA_BM_TOTAL_BUFSIZE)
 			panic("DMA buffer size too small\n");
-		copy(guest_prd.base, shadow_buf, count);
-		shadow_buf += count; guest_prd_phys += sizeof(guest_prd);
-	} while (guest_prd.eot == 0);
-	return total_count;
+		walk->index++;
+		walk->eot = guest_prd->eot;
+	} while (!walk->eot);
+	return true;
+}
+
+static void ata_dma_crypt(struct ata_channel *channel, int rw, int off, int len, u8 *src, u8 *dst)
+{
+	struct storage_access access;
+	int sector_size = ata_get_ata_device(channel)->storage_sector_size;
+
+	access.rw = rw;
+	access.lba = channel->lba + off / sector_size;
+	access.count = len / sector_size;
+	access.sector_size = sector_size;
+	storage_handle_sectors(ata_get_storage_device(channel), &access, src, dst);
+}
+
+/**
+ * copy data between the guest buffers and the shadow buffer
+ *
+ * The sectors are encrypted or decrypted during the copy instead of
+ * being copied and then processed in the shadow buffer.  A sector
+ * split between guest buffers is assembled in the shadow buffer and
+ * processed there.
+ * @param channel
+ * @param rw		STORAGE_READ or STORAGE_WRITE
+ * @return		total DMA count
+ */
+static int ata_copy_shadow_buf(struct ata_channel *channel, int rw)
+{
+	struct ata_bm_walk walk;
+	u8 *shadow_buf = channel->shadow_buf;
+	int sector_size = ata_get_ata_device(channel)->storage_sector_size;
+	int off = 0, end = 0, len, n, s;
+	phys_t base;
+	u8 *gbuf, *p;
+
+	if (channel->atapi_device->atapi_flag == 0 ||
+	    channel->atapi_device->dma_state == ATA_STATE_DMA_READY) {
+		end = channel->sector_count * sector_size;
+		channel->atapi_device->dma_state = ATA_STATE_DMA_THROUGH;
+	}
+	ata_bm_walk_init(&walk, channel);
+	while (ata_bm_walk_next(&walk, &base, &len)) {
+		gbuf = mapmem_gphys(base, len, MAPMEM_TEMP |
+				    (rw == STORAGE_READ ? MAPMEM_WRITE : 0));
+		for (p = gbuf; p < gbuf + len; p += n, off += n) {
+			n = gbuf + len - p;
+			if (off >= end) {
+				if (rw == STORAGE_WRITE)
+					memcpy(shadow_buf + off, p, n);
+				else
+					memcpy(p, shadow_buf + off, n);
+			} else if (off % sector_size == 0 && n >= sector_size) {
+				if (n > end - off)
+					n = end - off;
+				n -= n % sector_size;
+				if (rw == STORAGE_WRITE)
+					ata_dma_crypt(channel, rw, off, n, p, shadow_buf + off);
+				else
+					ata_dma_crypt(channel, rw, off, n, shadow_buf + off, p);
+			} else {
+				s = off - off % sector_size;
+				if (n > s + sector_size - off)
+					n = s + sector_size - off;
+				if (rw == STORAGE_READ && off == s)
+					ata_dma_crypt(channel, rw, s, sector_size,
+						      shadow_buf + s, shadow_buf + s);
+				if (rw == STORAGE_WRITE)
+					memcpy(shadow_buf + off, p, n);
+				else
+					memcpy(p, shadow_buf + off, n);
+				if (rw == STORAGE_WRITE && off + n == s + sector_size)
+					ata_dma_crypt(channel, rw, s, sector_size,
+						      shadow_buf + s, shadow_buf + s);
+			}
+		}
+		unmapmem(gbuf, len);
+	}
+	return walk.total_count;
 }
 
 static int ata_get_total_dma_count(struct ata_channel *channel)
 {
-	int total_count = 0;
-	phys_t guest_prd_phys = channel->guest_prd_phys;
-	ata_prd_table_t guest_prd;
+	struct ata_bm_walk walk;
+	phys_t base;
+	int len;
 
-	do {
-		guest_prd.value = core_mm_read_guest_phys64(guest_prd_phys);
-		total_count += ata_get_16bit_count(guest_prd.count);
-		if (total_count > ATA_BM_TOTAL_BUFSIZE)
-			panic("DMA buffer size too small\n");
-		guest_prd_phys += sizeof(guest_prd);
-	} while (guest_prd.eot == 0);
-	return total_count;
+	ata_bm_walk_init(&walk, channel);
+	while (ata_bm_walk_next(&walk, &base, &len));
+	return walk.total_count;
 }
 
+/* The shadow buffer is physically contiguous and 64KB aligned, so any
+   guest PRD table is replaced by the fewest entries possible. */
 static void ata_set_shadow_prd(struct ata_channel *channel, int count)
 {
 	ata_prd_table_t *shadow_prd = channel->shadow_prd;
@@ -141,7 +238,6 @@ int ata_bm_handle_command(struct ata_channel *channel, core_io_t io, union mem *
 	} else {
 		channel->state = ATA_STATE_DMA_WRITE;
 		count = ata_copy_shadow_buf(channel, STORAGE_WRITE);
-		ata_dma_handle_rw_sectors (channel, STORAGE_WRITE);
 	}
 	ata_set_shadow_prd(channel, count);
  end:	return CORE_IO_RET_DEFAULT;
@@ -166,10 +262,8 @@ int ata_bm_handle_status(struct ata_channel *channel, core_io_t io, union mem *d
 	if (bm_status_reg.active != 0)
 		goto done;
 
-	if (channel->state == ATA_STATE_DMA_READ) {
-		ata_dma_handle_rw_sectors (channel, STORAGE_READ);
+	if (channel->state == ATA_STATE_DMA_READ)
 		ata_copy_shadow_buf (channel, STORAGE_READ);
-	}
 	channel->state = ATA_STATE_READY;
  done:	return CORE_IO_RET_DONE;
  end:	return CORE_IO_RET_DEFAULT;
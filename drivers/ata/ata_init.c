@@ -102,8 +102,6 @@ static void ata_init_prd(struct ata_channel *channel)
 	channel->shadow_prd = prd;
 	channel->shadow_prd_phys = prd_phys;
 	channel->shadow_buf = buf;
-	channel->shadow_buf_premap = storage_premap_buf (buf,
-							 ATA_BM_TOTAL_BUFSIZE);
 	return;
 
 error:
@@ -340,11 +340,13 @@ usbmsc_copy_buffer(struct usb_buffer_list *dest,
 		if (src->vadr)
 			src_vadr = src->vadr;
 		else
-			src_vadr = (virt_t)mapmem_gphys(src->padr, clen, 0);
+			src_vadr = (virt_t)mapmem_gphys(src->padr, clen,
+							  MAPMEM_TEMP);
 		if (dest->vadr)
 			dest_vadr = dest->vadr;
 		else
-			dest_vadr = (virt_t)mapmem_gphys(dest->padr, clen, 0);
+			dest_vadr = (virt_t)mapmem_gphys(dest->padr, clen,
+							  MAPMEM_TEMP);
 		memcpy((void *)dest_vadr, (void *)src_vadr, clen);
 		if (!dest->vadr)
 			unmapmem((void *)dest_vadr, clen);
@@ -384,6 +384,9 @@ void pro100_write_recv_packet(PRO100_CTX *ctx, void *buf, UINT size)
 void pro100_poll_ru(PRO100_CTX *ctx)
 {
 	bool b = false;
+	void *packet_data[VPN_NIC_RECV_BATCH];
+	UINT packet_size[VPN_NIC_RECV_BATCH];
+	UINT num_packets = 0;
 	// 引数チェック
 	if (ctx == NULL)
 	{
@@ -427,12 +430,15 @@ LABEL_LOOP:
 #else	// PRO100_PASS_MODE
 				if (ctx->CallbackRecvPhyNic != NULL)
 				{
-					void *packet_data[1];
-					UINT packet_size[1];
+					// まとめて VPN に渡すために溜めておく
+					packet_data[num_packets] = data;
+					packet_size[num_packets] = size;
+					num_packets++;
 
-					packet_data[0] = data;
-					packet_size[0] = size;
-					ctx->CallbackRecvPhyNic(ctx, 1, packet_data, packet_size, ctx->CallbackRecvPhyNicParam);
+					if (num_packets >= VPN_NIC_RECV_BATCH)
+					{
+						pro100_flush_recv_packets(ctx, packet_data, packet_size, &num_packets);
+					}
 				}
 #endif	// PRO100_PASS_MODE
 			}
@@ -441,6 +447,9 @@ LABEL_LOOP:
 
 			if (ctx->current_recv == NULL)
 			{
+				// バッファをリセットする前に溜めたパケットを渡しておく
+				pro100_flush_recv_packets(ctx, packet_data, packet_size, &num_packets);
+
 				// 最後の受信バッファまで受信が完了したのでバッファをリセットする
 				pro100_init_recv_buffer(ctx);
 				ctx->host_ru_started = false;
@@ -454,6 +463,8 @@ LABEL_LOOP:
 		}
 	}
 
+	pro100_flush_recv_packets(ctx, packet_data, packet_size, &num_packets);
+
 	if (b)
 	{
 		b = false;
@@ -461,6 +472,25 @@ LABEL_LOOP:
 	}
 }
 
+// 溜めておいた受信パケットをまとめて VPN に渡す
+void pro100_flush_recv_packets(PRO100_CTX *ctx, void **packet_data, UINT *packet_size, UINT *num_packets)
+{
+	// 引数チェック
+	if (ctx == NULL || packet_data == NULL || packet_size == NULL || num_packets == NULL)
+	{
+		return;
+	}
+
+	if (*num_packets == 0 || ctx->CallbackRecvPhyNic == NULL)
+	{
+		*num_packets = 0;
+		return;
+	}
+
+	ctx->CallbackRecvPhyNic(ctx, *num_packets, packet_data, packet_size, ctx->CallbackRecvPhyNicParam);
+	*num_packets = 0;
+}
+
 // CU にオペレーションを実行させる
 void pro100_exec_cu_op(PRO100_CTX *ctx, PRO100_OP_BLOCK_MAX *op, UINT size)
 {
@@ -278,6 +278,7 @@ void pro100_sleep(UINT msecs);
 UINT pro100_read_send_packet(PRO100_CTX *ctx, phys_t addr, void *buf);
 void pro100_send_packet_to_line(PRO100_CTX *ctx, void *buf, UINT size);
 void pro100_poll_ru(PRO100_CTX *ctx);
+void pro100_flush_recv_packets(PRO100_CTX *ctx, void **packet_data, UINT *packet_size, UINT *num_packets);
 void pro100_write_recv_packet(PRO100_CTX *ctx, void *buf, UINT size);
 
 char *pro100_get_ru_command_string(UINT ru);
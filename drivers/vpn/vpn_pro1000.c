@@ -964,10 +964,10 @@ static void
 receive_physnic (struct desc_shadow *s, struct data2 *d2, uint off2)
 {
 	u32 *head, *tail, h, t, nt;
-	void *pkt[16];
-	UINT pktsize[16];
-	long pkt_premap[16];
-	int i = 0, num = 16;
+	void *pkt[VPN_NIC_RECV_BATCH];
+	UINT pktsize[VPN_NIC_RECV_BATCH];
+	long pkt_premap[VPN_NIC_RECV_BATCH];
+	int i = 0, num = VPN_NIC_RECV_BATCH;
 	struct rdesc *rd;
 
 	write_mydesc (s, d2, off2, false);
@@ -982,10 +982,12 @@ receive_physnic (struct desc_shadow *s, struct data2 *d2, uint off2)
 		if (nt >= NUM_OF_RDESC)
 			nt = 0;
 		if (h == nt || i == num) {
-			vpn_premap_PhysicalNicRecv (d2->recvphys_func, d2, i,
-						    pkt, pktsize,
-						    d2->recvphys_param,
-						    pkt_premap);
+			if (i > 0)
+				vpn_premap_PhysicalNicRecv (d2->recvphys_func,
+							    d2, i, pkt,
+							    pktsize,
+							    d2->recvphys_param,
+							    pkt_premap);
 			if (h == nt)
 				break;
 			i = 0;
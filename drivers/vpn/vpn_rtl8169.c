@@ -946,6 +946,7 @@ rtl8169_get_rxdata_to_vpn(RTL8169_CTX *ctx, RTL8169_SUB_CTX *sctx)
 			break;
 		}
 	}
+	rtl8169_flush_rxdesc_data(ctx, &ArrayNum);
 
 #ifdef _DEBUG
 	time = get_cpu_time(); 
@@ -956,6 +957,25 @@ rtl8169_get_rxdata_to_vpn(RTL8169_CTX *ctx, RTL8169_SUB_CTX *sctx)
 	return;
 }
 
+static void
+rtl8169_flush_rxdesc_data(RTL8169_CTX *ctx, int *ArrayNum)
+{
+	int	i;
+
+	if(*ArrayNum == 0)
+	{
+		return;
+	}
+	//溜めた受信パケットをまとめてVPNへ渡し、ディスクリプタを返却する
+	ctx->CallbackRecvPhyNic(ctx, *ArrayNum, ctx->RxBufAddr, ctx->RxBufSize, ctx->CallbackRecvPhyNicParam);
+	for(i = 0; i < *ArrayNum; i++)
+	{
+		ctx->rxtmpdesc[i]->opts &= OPT_EOR;
+		ctx->rxtmpdesc[i]->opts |= OPT_OWN | 0xFFF;
+	}
+	*ArrayNum = 0;
+}
+
 static void
 rtl8169_get_rxdesc_data(RTL8169_CTX *ctx, int *ArrayNum, struct desc *TargetDesc, UINT BufSize, void *RxBuf)
 {
@@ -991,15 +1011,17 @@ rtl8169_get_rxdesc_data(RTL8169_CTX *ctx, int *ArrayNum, struct desc *TargetDesc
 			
 			if(TotalSize <= BufSize)
 			{
-				ctx->RxBufAddr[0]   = RxBuf;
-				ctx->RxBufSize[0]   = TotalSize;
-				ctx->RxTmpSize[0]   = BufSize;
-				/* TargetDesc->opts1 |= OPT_OWN; */
-				ctx->rxtmpdesc[0]   = TargetDesc;
+				//ディスクリプタはVPNへ渡し終わるまで返却しない
+				ctx->RxBufAddr[*ArrayNum] = RxBuf;
+				ctx->RxBufSize[*ArrayNum] = TotalSize;
+				ctx->RxTmpSize[*ArrayNum] = BufSize;
+				ctx->rxtmpdesc[*ArrayNum] = TargetDesc;
+				(*ArrayNum)++;
 				bret = true;
-				ctx->CallbackRecvPhyNic(ctx, 1, ctx->RxBufAddr, ctx->RxBufSize, ctx->CallbackRecvPhyNicParam);
-				TargetDesc->opts &= OPT_EOR;
-				TargetDesc->opts |= OPT_OWN | 0xFFF;
+				if(*ArrayNum >= VPN_NIC_RECV_BATCH)
+				{
+					rtl8169_flush_rxdesc_data(ctx, ArrayNum);
+				}
 			}
 		}
 #ifdef _DEBUG
@@ -230,6 +230,7 @@ static bool rtl8169_hook_write(RTL8169_SUB_CTX *sctx, phys_t offset, UINT data,
 static bool rtl8169_get_txdata_to_vpn(struct RTL8169_CTX *ctx, struct RTL8169_SUB_CTX *sctx, int Desckind);
 static bool rtl8169_hook_read(RTL8169_SUB_CTX *sctx, phys_t offset, UINT *data, UINT len);
 static void rtl8169_get_rxdata_to_vpn(struct RTL8169_CTX *ctx, struct RTL8169_SUB_CTX *sctx);
+static void rtl8169_flush_rxdesc_data(struct RTL8169_CTX *ctx, int *ArrayNum);
 static void rtl8169_get_rxdesc_data(struct RTL8169_CTX *ctx, int *ArrayNum, struct desc *TargetDesc, UINT BufSize, void *);
 static void GetPhysicalNicInfo(SE_HANDLE nic_handle, SE_NICINFO *info);
 static void SendPhysicalNic(SE_HANDLE nic_handle, UINT num_packets, void **packets, UINT *packet_sizes);
@@ -31,5 +31,6 @@
 #define __CORE_CPU_H
 
 int get_cpu_id (void);
+int get_cpu_count (void);
 
 #endif
@@ -38,6 +38,7 @@
 #define MAPMEM_PWT			0x8
 #define MAPMEM_PCD			0x10
 #define MAPMEM_PAT			0x80
+#define MAPMEM_TEMP			0x100 /* unmapped soon by the same thread */
 
 struct mempool;
 
@@ -35,17 +35,81 @@
 #endif
 #include <core/types.h>
 
-typedef u8 spinlock_t;
+/* spinlock_t is a test-and-set lock by default.  With SPINLOCK_TICKET
+ * it is a ticket lock which grants the lock in FIFO order.  With
+ * SPINLOCK_STAT every lock also records acquisition counts, spin
+ * cycles and hold time which core/spinlock.c collects per lock. */
+#ifdef SPINLOCK_TICKET
+typedef u32 spinlock_value_t;
+#else
+typedef u8 spinlock_value_t;
+#endif
 typedef u32 rw_spinlock_t;
 
+#ifdef SPINLOCK_STAT
+typedef struct {
+	spinlock_value_t value;
+	u64 spin;
+	u64 acquired;
+} spinlock_t;
+
+#define SPINLOCK_INITIALIZER { 0, 0, 0 }
+#else
+typedef spinlock_value_t spinlock_t;
+
 #define SPINLOCK_INITIALIZER ((spinlock_t)0)
+#endif
+
+#ifdef SPINLOCK_TICKET
+/* The low 16 bits are the ticket being served and the high 16 bits
+ * are the next ticket. */
+static inline void
+spinlock_value_lock (spinlock_value_t *l)
+{
+	u32 ticket;
 
+	asm volatile (" lock xaddl %0, %1 \n" /* take a ticket */
+		      "      movl  %0, %%ecx \n"
+		      "      shrl  $16, %0 \n" /* %0 = my ticket */
+		      "      cmpw  %w0, %%cx \n" /* check whether served */
+		      "      je    1f \n" /* if so, succeeded */
+		      "2: \n"
+		      "      pause \n" /* spin loop hint */
+		      "      cmpw  %w0, %1 \n" /* compare serving ticket */
+		      "      jne   2b \n" /* if not mine, do spin loop */
+		      "1: \n"
+		      : "=&r" (ticket)
+		      , "+m" (*l)
+		      : "0" ((u32)0x10000)
+		      : "cc", "ecx", "memory");
+}
+
+static inline void
+spinlock_value_unlock (spinlock_value_t *l)
+{
+	asm volatile ("lock incw %0" /* serve the next ticket */
+		      : "+m" (*(u16 *)l)
+		      :
+		      : "cc", "memory");
+}
+
+static inline void
+spinlock_value_init (spinlock_value_t *l)
+{
+	spinlock_value_t dummy;
+
+	asm volatile ("xchg %1, %0 \n"
+		      : "=r" (dummy)
+		      , "=m" (*l)
+		      : "0" ((spinlock_value_t)0));
+}
+#else
 #ifdef SPINLOCK_DEBUG
-#define spinlock_lock _spinlock_lock
+#define spinlock_value_lock _spinlock_value_lock
 #endif
 
 static inline void
-spinlock_lock (spinlock_t *l)
+spinlock_value_lock (spinlock_value_t *l)
 {
 	u8 dummy;
 
@@ -70,16 +134,16 @@ spinlock_lock (spinlock_t *l)
 }
 
 #ifdef SPINLOCK_DEBUG
-#undef spinlock_lock
+#undef spinlock_value_lock
 #define spinlock_debug1(a) spinlock_debug2(a)
 #define spinlock_debug2(a) #a
-#define spinlock_lock(l) spinlock_lock_debug (l, \
+#define spinlock_value_lock(l) spinlock_lock_debug (l, \
 	"spinlock_lock failed." \
 	" file " __FILE__ \
 	" line " spinlock_debug1 (__LINE__))
 
 static inline void
-spinlock_lock_debug (spinlock_t *l, char *msg)
+spinlock_lock_debug (spinlock_value_t *l, char *msg)
 {
 	u8 dummy;
 	u32 c;
@@ -112,7 +176,7 @@ spinlock_lock_debug (spinlock_t *l, char *msg)
 #endif
 
 static inline void
-spinlock_unlock (spinlock_t *l)
+spinlock_value_unlock (spinlock_value_t *l)
 {
 	u8 dummy;
 
@@ -126,11 +190,69 @@ spinlock_unlock (spinlock_t *l)
 		      : "0" ((u8)0));
 }
 
+static inline void
+spinlock_value_init (spinlock_value_t *l)
+{
+	spinlock_value_unlock (l);
+}
+#endif
+
+#ifdef SPINLOCK_STAT
+void spinlock_stat_update (spinlock_t *l, u64 spin, u64 hold);
+
+static inline u64
+spinlock_rdtsc (void)
+{
+	u32 tsc_l, tsc_h;
+
+	asm volatile ("rdtsc" : "=a" (tsc_l), "=d" (tsc_h));
+	return ((u64)tsc_h << 32) | tsc_l;
+}
+
+static inline void
+spinlock_lock (spinlock_t *l)
+{
+	u64 start;
+
+	start = spinlock_rdtsc ();
+	spinlock_value_lock (&l->value);
+	l->acquired = spinlock_rdtsc ();
+	l->spin = l->acquired - start;
+}
+
+static inline void
+spinlock_unlock (spinlock_t *l)
+{
+	spinlock_stat_update (l, l->spin, spinlock_rdtsc () - l->acquired);
+	spinlock_value_unlock (&l->value);
+}
+
 static inline void
 spinlock_init (spinlock_t *l)
 {
-	spinlock_unlock (l);
+	l->spin = 0;
+	l->acquired = 0;
+	spinlock_value_init (&l->value);
 }
+#else
+static inline void
+spinlock_lock (spinlock_t *l)
+{
+	spinlock_value_lock (l);
+}
+
+static inline void
+spinlock_unlock (spinlock_t *l)
+{
+	spinlock_value_unlock (l);
+}
+
+static inline void
+spinlock_init (spinlock_t *l)
+{
+	spinlock_value_init (l);
+}
+#endif
 
 static inline void
 rw_spinlock_lock_sh (rw_spinlock_t *l)
@@ -34,9 +34,18 @@
 
 typedef u8 tid_t;
 
+enum thread_priority {
+	THREAD_PRIORITY_NORMAL,
+	THREAD_PRIORITY_HIGH,
+};
+
 tid_t thread_gettid (void);
 void schedule (void);
 tid_t thread_new (void (*func) (void *), void *arg, int stacksize);
+tid_t thread_new_priority (void (*func) (void *), void *arg, int stacksize,
+			   enum thread_priority priority);
+tid_t thread_new_bind (void (*func) (void *), void *arg, int stacksize,
+		       enum thread_priority priority, int cpunum);
 void thread_exit (void);
 void thread_wakeup (tid_t tid);
 void thread_will_stop (void);
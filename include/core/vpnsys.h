@@ -32,6 +32,9 @@
 
 #include <Se/Se.h>
 
+/* maximum number of received packets passed to the VPN at once */
+#define VPN_NIC_RECV_BATCH	64
+
 struct nicfunc {
 	void (*GetPhysicalNicInfo) (SE_HANDLE nic_handle, SE_NICINFO *info);
 	void (*SendPhysicalNic) (SE_HANDLE nic_handle, UINT num_packets,
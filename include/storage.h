@@ -69,5 +69,6 @@ long storage_premap_buf (void *buf, unsigned int len);
 int storage_premap_handle_sectors (struct storage_device *storage,
 				   struct storage_access *access, u8 *src,
 				   u8 *dst, long premap_src, long premap_dst);
+void storage_parallel (void (*func) (void *arg, int i), void *arg, int n);
 
 #endif
@@ -0,0 +1,635 @@
+/*
+ * Copyright (c) 2007, 2008 University of Tsukuba
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the University of Tsukuba nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Host-side test and benchmark for the storage encryption engines.
+   storage/lib and its engines are built against the small libc
+   shim in include/, so the code measured here is the code that runs
+   in the VMM (aes-ni only leaves out the XMM save and restore). */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <core.h>
+#include <core/process.h>
+#include <storage.h>
+#include "../lib/storage_msg.h"
+#include "../lib/crypto/crypto.h"
+
+#define BENCH_MAX_LIST		16
+#define BENCH_MAX_SAMPLES	65536
+#define BENCH_SPAN		(1ULL << 24)	/* sectors */
+#define BENCH_REFERENCE		"aes-xts"
+
+/* IEEE Std 1619-2007 Annex B.  Vectors 15 and later use partial
+   blocks, which the engines do not support. */
+struct bench_kat {
+	int num;
+	int bits;		/* Key1 followed by Key2 */
+	char *key;
+	lba_t lba;		/* data unit sequence number */
+	int size;
+	char *ptx;		/* NULL means 00..ff repeated */
+	char *ctx;
+};
+
+#define BENCH_KAT4_CTX \
+	"27a7479befa1d476489f308cd4cfa6e2a96e4bbe3208ff25287dd3819616e89c" \
+	"c78cf7f5e543445f8333d8fa7f56000005279fa5d8b5e4ad40e736ddb4d35412" \
+	"328063fd2aab53e5ea1e0a9f332500a5df9487d07a5c92cc512c8866c7e860ce" \
+	"93fdf166a24912b422976146ae20ce846bb7dc9ba94a767aaef20c0d61ad0265" \
+	"5ea92dc4c4e41a8952c651d33174be51a10c421110e6d81588ede82103a252d8" \
+	"a750e8768defffed9122810aaeb99f9172af82b604dc4b8e51bcb08235a6f434" \
+	"1332e4ca60482a4ba1a03b3e65008fc5da76b70bf1690db4eae29c5f1badd03c" \
+	"5ccf2a55d705ddcd86d449511ceb7ec30bf12b1fa35b913f9f747a8afd1b130e" \
+	"94bff94effd01a91735ca1726acd0b197c4e5b03393697e126826fb6bbde8ecc" \
+	"1e08298516e2c9ed03ff3c1b7860f6de76d4cecd94c8119855ef5297ca67e9f3" \
+	"e7ff72b1e99785ca0a7e7720c5b36dc6d72cac9574c8cbbc2f801e23e56fd344" \
+	"b07f22154beba0f08ce8891e643ed995c94d9a69c9f1b5f499027a78572aeebd" \
+	"74d20cc39881c213ee770b1010e4bea718846977ae119f7a023ab58cca0ad752" \
+	"afe656bb3c17256a9f6e9bf19fdd5a38fc82bbe872c5539edb609ef4f79c203e" \
+	"bb140f2e583cb2ad15b4aa5b655016a8449277dbd477ef2c8d6c017db738b18d" \
+	"eb4a427d1923ce3ff262735779a418f20a282df920147beabe421ee5319d0568"
+
+#define BENCH_KAT5_CTX \
+	"264d3ca8512194fec312c8c9891f279fefdd608d0c027b60483a3fa811d65ee5" \
+	"9d52d9e40ec5672d81532b38b6b089ce951f0f9c35590b8b978d175213f329bb" \
+	"1c2fd30f2f7f30492a61a532a79f51d36f5e31a7c9a12c286082ff7d2394d18f" \
+	"783e1a8e72c722caaaa52d8f065657d2631fd25bfd8e5baad6e527d763517501" \
+	"c68c5edc3cdd55435c532d7125c8614deed9adaa3acade5888b87bef641c4c99" \
+	"4c8091b5bcd387f3963fb5bc37aa922fbfe3df4e5b915e6eb514717bdd2a7407" \
+	"9a5073f5c4bfd46adf7d282e7a393a52579d11a028da4d9cd9c77124f9648ee3" \
+	"83b1ac763930e7162a8d37f350b2f74b8472cf09902063c6b32e8c2d9290cefb" \
+	"d7346d1c779a0df50edcde4531da07b099c638e83a755944df2aef1aa31752fd" \
+	"323dcb710fb4bfbb9d22b925bc3577e1b8949e729a90bbafeacf7f7879e7b114" \
+	"7e28ba0bae940db795a61b15ecf4df8db07b824bb062802cc98a9545bb2aaeed" \
+	"77cb3fc6db15dcd7d80d7d5bc406c4970a3478ada8899b329198eb61c193fb62" \
+	"75aa8ca340344a75a862aebe92eee1ce032fd950b47d7704a3876923b4ad6284" \
+	"4bf4a09c4dbe8b4397184b7471360c9564880aedddb9baa4af2e75394b08cd32" \
+	"ff479c57a07d3eab5d54de5f9738b8d27f27a9f0ab11799d7b7ffefb2704c95c" \
+	"6ad12c39f1e867a4b7b1d7818a4b753dfd2a89ccb45e001a03a867b187f225dd"
+
+#define BENCH_KAT10_CTX \
+	"1c3b3a102f770386e4836c99e370cf9bea00803f5e482357a4ae12d414a3e63b" \
+	"5d31e276f8fe4a8d66b317f9ac683f44680a86ac35adfc3345befecb4bb188fd" \
+	"5776926c49a3095eb108fd1098baec70aaa66999a72a82f27d848b21d4a741b0" \
+	"c5cd4d5fff9dac89aeba122961d03a757123e9870f8acf1000020887891429ca" \
+	"2a3e7a7d7df7b10355165c8b9a6d0a7de8b062c4500dc4cd120c0f7418dae3d0" \
+	"b5781c34803fa75421c790dfe1de1834f280d7667b327f6c8cd7557e12ac3a0f" \
+	"93ec05c52e0493ef31a12d3d9260f79a289d6a379bc70c50841473d1a8cc81ec" \
+	"583e9645e07b8d9670655ba5bbcfecc6dc3966380ad8fecb17b6ba02469a020a" \
+	"84e18e8f84252070c13e9f1f289be54fbc481457778f616015e1327a02b140f1" \
+	"505eb309326d68378f8374595c849d84f4c333ec4423885143cb47bd71c5edae" \
+	"9be69a2ffeceb1bec9de244fbe15992b11b77c040f12bd8f6a975a44a0f90c29" \
+	"a9abc3d4d893927284c58754cce294529f8614dcd2aba991925fedc4ae74ffac" \
+	"6e333b93eb4aff0479da9a410e4450e0dd7ae4c6e2910900575da401fc07059f" \
+	"645e8b7e9bfdef33943054ff84011493c27b3429eaedb4ed5376441a77ed4385" \
+	"1ad77f16f541dfd269d50d6a5f14fb0aab1cbb4c1550be97f7ab4066193c4caa" \
+	"773dad38014bd2092fa755c824bb5e54c4f36ffda9fcea70b9c6e693e148c151"
+
+static struct bench_kat bench_kat[] = {
+	{ 1, 256,
+	  "00000000000000000000000000000000"
+	  "00000000000000000000000000000000",
+	  0x0ULL, 32,
+	  "00000000000000000000000000000000"
+	  "00000000000000000000000000000000",
+	  "917cf69ebd68b2ec9b9fe9a3eadda692"
+	  "cd43d2f59598ed858c02c2652fbf922e" },
+	{ 2, 256,
+	  "11111111111111111111111111111111"
+	  "22222222222222222222222222222222",
+	  0x3333333333ULL, 32,
+	  "44444444444444444444444444444444"
+	  "44444444444444444444444444444444",
+	  "c454185e6a16936e39334038acef838b"
+	  "fb186fff7480adc4289382ecd6d394f0" },
+	{ 3, 256,
+	  "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0"
+	  "22222222222222222222222222222222",
+	  0x3333333333ULL, 32,
+	  "44444444444444444444444444444444"
+	  "44444444444444444444444444444444",
+	  "af85336b597afc1a900b2eb21ec949d2"
+	  "92df4c047e0b21532186a5971a227a89" },
+	{ 4, 256,
+	  "27182818284590452353602874713526"
+	  "31415926535897932384626433832795",
+	  0x0ULL, 512, NULL, BENCH_KAT4_CTX },
+	{ 5, 256,
+	  "27182818284590452353602874713526"
+	  "31415926535897932384626433832795",
+	  0x1ULL, 512, BENCH_KAT4_CTX, BENCH_KAT5_CTX },
+	{ 10, 512,
+	  "27182818284590452353602874713526"
+	  "62497757247093699959574966967627"
+	  "31415926535897932384626433832795"
+	  "02884197169399375105820974944592",
+	  0xffULL, 512, NULL, BENCH_KAT10_CTX },
+};
+
+struct bench_param {
+	struct storage_device *storage;
+	int sector_size;
+	int count;
+	int rw;
+	double seconds;
+	int nthreads;
+	pthread_barrier_t barrier;
+};
+
+struct bench_thread {
+	pthread_t thread;
+	struct bench_param *p;
+	int id;
+	u8 *src, *dst;
+	u64 requests;
+	double elapsed;
+	double *lat;
+	int nlat;
+};
+
+static struct config_data_storage bench_cfg;
+
+void *
+alloc (uint len)
+{
+	void *p;
+
+	/* The aes-ni key schedules are expected to be 16-byte aligned,
+	   as alloc() in the VMM returns them. */
+	if (posix_memalign (&p, 16, len))
+		panic ("alloc: out of memory");
+	return p;
+}
+
+void
+panic (char *format, ...)
+{
+	va_list ap;
+
+	va_start (ap, format);
+	fprintf (stderr, "panic: ");
+	vfprintf (stderr, format, ap);
+	fprintf (stderr, "\n");
+	va_end (ap);
+	exit (1);
+}
+
+void
+assertion_failed (char *x, const char *funcname, char *filename,
+		  int linenum)
+{
+	panic ("assertion failed: %s in %s at %s:%d", x, funcname, filename,
+	       linenum);
+}
+
+int
+msgregister (char *name, void *func)
+{
+	return 0;
+}
+
+static double
+bench_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+bench_hex (char *s, u8 *buf, int len)
+{
+	int i;
+	unsigned int x;
+
+	if (strlen (s) != len * 2)
+		panic ("bench_hex: bad length");
+	for (i = 0; i < len; i++) {
+		sscanf (&s[i * 2], "%2x", &x);
+		buf[i] = x;
+	}
+}
+
+static void
+bench_random (u8 *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = random ();
+}
+
+static int
+bench_kat_one (struct crypto *crypto, struct bench_kat *kat)
+{
+	u8 key[64], ptx[512], ctx[512], buf[512];
+	void *keyctx;
+	int i, fail = 0;
+
+	bench_hex (kat->key, key, kat->bits / 8);
+	if (kat->ptx)
+		bench_hex (kat->ptx, ptx, kat->size);
+	else
+		for (i = 0; i < kat->size; i++)
+			ptx[i] = i;
+	bench_hex (kat->ctx, ctx, kat->size);
+	keyctx = crypto->setkey (key, kat->bits);
+	crypto->encrypt (buf, ptx, keyctx, kat->lba, kat->size);
+	fail |= memcmp (buf, ctx, kat->size);
+	crypto->decrypt (buf, ctx, keyctx, kat->lba, kat->size);
+	fail |= memcmp (buf, ptx, kat->size);
+	if (crypto->encrypt_sectors) {
+		memcpy (buf, ptx, kat->size);
+		crypto->encrypt_sectors (buf, buf, keyctx, kat->lba, 1,
+					 kat->size);
+		fail |= memcmp (buf, ctx, kat->size);
+	}
+	if (crypto->decrypt_sectors) {
+		memcpy (buf, ctx, kat->size);
+		crypto->decrypt_sectors (buf, buf, keyctx, kat->lba, 1,
+					 kat->size);
+		fail |= memcmp (buf, ptx, kat->size);
+	}
+	free (keyctx);
+	return fail;
+}
+
+static struct storage_device *
+bench_storage_new (char *name, int keys)
+{
+	static struct guid anyguid = STORAGE_GUID_ANY;
+	struct storage_keys_conf *c;
+	int i;
+
+	memset (bench_cfg.keys_conf, 0, sizeof bench_cfg.keys_conf);
+	for (i = 0; i < keys; i++) {
+		c = &bench_cfg.keys_conf[i];
+		c->guid = anyguid;
+		c->type = STORAGE_TYPE_ANY;
+		c->host_id = STORAGE_HOST_ID_ANY;
+		c->device_id = STORAGE_DEVICE_ID_ANY;
+		c->lba_low = BENCH_SPAN / keys * i;
+		c->lba_high = i == keys - 1 ? ~0ULL :
+			BENCH_SPAN / keys * (i + 1) - 1;
+		snprintf (c->crypto_name, sizeof c->crypto_name, "%s", name);
+		c->keyindex = i;
+		c->keybits = 256;
+	}
+	return storage_new (STORAGE_TYPE_AHCI, 0, 0, NULL, NULL);
+}
+
+static void
+bench_storage_crypt (struct storage_device *storage, int rw, lba_t lba,
+		     int count, int sector_size, u8 *src, u8 *dst)
+{
+	struct storage_access access;
+
+	access.lba = lba;
+	access.count = count;
+	access.sector_size = sector_size;
+	access.rw = rw;
+	storage_lib_handle_sectors (storage, &access, src, dst);
+}
+
+/* Compare an engine with the reference engine through the
+   storage_lib_handle_sectors() path, with requests crossing key
+   ranges. */
+static int
+bench_storage_check (char *name)
+{
+	static int keys[] = { 1, 3, STORAGE_MAX_KEYS_PER_DEVICE };
+	static const int count = 67, sector_size = 512;
+	struct storage_device *ref, *s;
+	u8 *ptx, *ctx, *buf;
+	int i, j, fail = 0;
+	lba_t lba;
+
+	ptx = alloc (count * sector_size);
+	ctx = alloc (count * sector_size);
+	buf = alloc (count * sector_size);
+	for (i = 0; i < sizeof keys / sizeof keys[0]; i++) {
+		ref = bench_storage_new (BENCH_REFERENCE, keys[i]);
+		s = bench_storage_new (name, keys[i]);
+		for (j = 0; j < keys[i]; j++) {
+			lba = BENCH_SPAN / keys[i] * (j + 1) - count / 2;
+			bench_random (ptx, count * sector_size);
+			if (strcmp (name, "none"))
+				bench_storage_crypt (ref, STORAGE_WRITE, lba,
+						     count, sector_size, ptx,
+						     ctx);
+			else
+				memcpy (ctx, ptx, count * sector_size);
+			bench_storage_crypt (s, STORAGE_WRITE, lba, count,
+					     sector_size, ptx, buf);
+			fail |= memcmp (buf, ctx, count * sector_size);
+			bench_storage_crypt (s, STORAGE_READ, lba, count,
+					     sector_size, buf, buf);
+			fail |= memcmp (buf, ptx, count * sector_size);
+		}
+		storage_free (s);
+		storage_free (ref);
+	}
+	free (buf);
+	free (ctx);
+	free (ptx);
+	return fail;
+}
+
+static int
+bench_kat_all (char **names, int n)
+{
+	struct crypto *crypto;
+	int i, j, fail, ret = 0;
+
+	for (i = 0; i < n; i++) {
+		crypto = crypto_find (names[i]);
+		if (!crypto)
+			panic ("unknown crypto name: %s", names[i]);
+		if (strcmp (names[i], "none")) {
+			for (j = 0; j < sizeof bench_kat / sizeof bench_kat[0];
+			     j++) {
+				fail = bench_kat_one (crypto, &bench_kat[j]);
+				printf ("kat %-8s IEEE 1619 vector %-2d %s\n",
+					names[i], bench_kat[j].num,
+					fail ? "FAILED" : "ok");
+				ret |= fail;
+			}
+		}
+		fail = bench_storage_check (names[i]);
+		printf ("kat %-8s storage path vs %-9s %s\n", names[i],
+			strcmp (names[i], "none") ? BENCH_REFERENCE : "memcpy",
+			fail ? "FAILED" : "ok");
+		ret |= fail;
+	}
+	return ret;
+}
+
+static void *
+bench_thread (void *arg)
+{
+	struct bench_thread *t = arg;
+	struct bench_param *p = t->p;
+	double start, s, e;
+	lba_t lba, step;
+
+	step = BENCH_SPAN / p->nthreads;
+	lba = step * t->id;
+	pthread_barrier_wait (&p->barrier);
+	start = e = bench_now ();
+	while (e - start < p->seconds) {
+		s = e;
+		bench_storage_crypt (p->storage, p->rw, lba, p->count,
+				     p->sector_size, t->src, t->dst);
+		e = bench_now ();
+		if (t->nlat < BENCH_MAX_SAMPLES)
+			t->lat[t->nlat++] = e - s;
+		t->requests++;
+		lba += p->count;
+		if (lba + p->count > BENCH_SPAN)
+			lba = 0;
+	}
+	t->elapsed = e - start;
+	return NULL;
+}
+
+static int
+bench_cmp_double (const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void
+bench_run (char *name, int sector_size, int request, int keys,
+	   int nthreads, int rw, double seconds)
+{
+	struct bench_param p;
+	struct bench_thread *t;
+	double elapsed = 0, sum = 0, *lat;
+	u64 requests = 0;
+	int i, n = 0;
+
+	p.storage = bench_storage_new (name, keys);
+	p.sector_size = sector_size;
+	p.count = request / sector_size;
+	p.rw = rw;
+	p.seconds = seconds;
+	p.nthreads = nthreads;
+	pthread_barrier_init (&p.barrier, NULL, nthreads);
+	t = alloc (sizeof *t * nthreads);
+	for (i = 0; i < nthreads; i++) {
+		memset (&t[i], 0, sizeof t[i]);
+		t[i].p = &p;
+		t[i].id = i;
+		t[i].src = alloc (request);
+		t[i].dst = alloc (request);
+		t[i].lat = alloc (sizeof *t[i].lat * BENCH_MAX_SAMPLES);
+		bench_random (t[i].src, request);
+		if (pthread_create (&t[i].thread, NULL, bench_thread, &t[i]))
+			panic ("pthread_create failed");
+	}
+	lat = alloc (sizeof *lat * BENCH_MAX_SAMPLES * nthreads);
+	for (i = 0; i < nthreads; i++) {
+		pthread_join (t[i].thread, NULL);
+		if (elapsed < t[i].elapsed)
+			elapsed = t[i].elapsed;
+		requests += t[i].requests;
+		memcpy (&lat[n], t[i].lat, sizeof *lat * t[i].nlat);
+		n += t[i].nlat;
+		free (t[i].lat);
+		free (t[i].dst);
+		free (t[i].src);
+	}
+	for (i = 0; i < n; i++)
+		sum += lat[i];
+	qsort (lat, n, sizeof *lat, bench_cmp_double);
+	printf ("%-8s %6d %8d %4d %7d %-5s %9.1f %9.1f %9.1f %9.1f\n",
+		name, sector_size, request, keys, nthreads,
+		rw == STORAGE_WRITE ? "write" : "read",
+		(double)requests * request / elapsed / 1e6,
+		sum / n * 1e6, lat[n / 2] * 1e6, lat[n * 99 / 100] * 1e6);
+	free (lat);
+	free (t);
+	pthread_barrier_destroy (&p.barrier);
+	storage_free (p.storage);
+}
+
+static int
+bench_list (char *s, long *v)
+{
+	int n;
+	char *end;
+
+	for (n = 0; n < BENCH_MAX_LIST; n++) {
+		v[n] = strtol (s, &end, 0);
+		if (end == s || v[n] <= 0)
+			panic ("bad number in list: %s", s);
+		if (*end == 'k' || *end == 'K')
+			v[n] <<= 10, end++;
+		else if (*end == 'm' || *end == 'M')
+			v[n] <<= 20, end++;
+		if (*end == '\0')
+			return n + 1;
+		if (*end != ',')
+			panic ("bad number in list: %s", s);
+		s = end + 1;
+	}
+	panic ("too many numbers in list");
+}
+
+static int
+bench_names (char *s, char **v)
+{
+	int n;
+
+	for (n = 0; n < BENCH_MAX_LIST; n++) {
+		v[n] = s;
+		s = strchr (s, ',');
+		if (!s)
+			return n + 1;
+		*s++ = '\0';
+	}
+	panic ("too many names in list");
+}
+
+static void
+usage (char *argv0)
+{
+	fprintf (stderr,
+		 "usage: %s [-K] [-e engines] [-s sector-sizes]"
+		 " [-r request-sizes]\n"
+		 "\t[-k key-counts] [-t thread-counts] [-d read|write]"
+		 " [-T seconds]\n"
+		 "Lists are separated by commas; sizes take K and M"
+		 " suffixes.\n"
+		 "-K only runs the known-answer tests.\n", argv0);
+	exit (2);
+}
+
+int
+main (int argc, char **argv)
+{
+	char defengines[] = "none,aes-xts,aes-ni", defthreads[32];
+	char *engines = defengines, *threads = defthreads;
+	char *sectors = "512,4096", *requests = "4K,64K,1M", *keys = "1,8";
+	char *names[BENCH_MAX_LIST];
+	long sector[BENCH_MAX_LIST], request[BENCH_MAX_LIST];
+	long key[BENCH_MAX_LIST], thread[BENCH_MAX_LIST];
+	int nname, nsector, nrequest, nkey, nthread;
+	int a, b, c, d, e, c_opt, katonly = 0, rw = -1;
+	double seconds = 0.2;
+	long ncpu;
+
+	ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+	if (ncpu > 1)
+		snprintf (defthreads, sizeof defthreads, "1,%ld", ncpu);
+	else
+		snprintf (defthreads, sizeof defthreads, "1");
+	while ((c_opt = getopt (argc, argv, "Ke:s:r:k:t:d:T:")) != -1) {
+		switch (c_opt) {
+		case 'K':
+			katonly = 1;
+			break;
+		case 'e':
+			engines = optarg;
+			break;
+		case 's':
+			sectors = optarg;
+			break;
+		case 'r':
+			requests = optarg;
+			break;
+		case 'k':
+			keys = optarg;
+			break;
+		case 't':
+			threads = optarg;
+			break;
+		case 'd':
+			if (!strcmp (optarg, "read"))
+				rw = STORAGE_READ;
+			else if (!strcmp (optarg, "write"))
+				rw = STORAGE_WRITE;
+			else
+				usage (argv[0]);
+			break;
+		case 'T':
+			seconds = atof (optarg);
+			break;
+		default:
+			usage (argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage (argv[0]);
+	nname = bench_names (engines, names);
+	nsector = bench_list (sectors, sector);
+	nrequest = bench_list (requests, request);
+	nkey = bench_list (keys, key);
+	nthread = bench_list (threads, thread);
+	for (a = 0; a < nkey; a++)
+		if (key[a] > STORAGE_MAX_KEYS_PER_DEVICE)
+			panic ("at most %d keys per device",
+			       STORAGE_MAX_KEYS_PER_DEVICE);
+	for (a = 0; a < STORAGE_MAX_KEYS_PER_DEVICE; a++)
+		bench_random (bench_cfg.keys[a], sizeof bench_cfg.keys[a]);
+	storage_init (&bench_cfg);
+
+	if (bench_kat_all (names, nname)) {
+		printf ("known-answer tests FAILED\n");
+		return 1;
+	}
+	if (katonly)
+		return 0;
+
+	printf ("%-8s %6s %8s %4s %7s %-5s %9s %9s %9s %9s\n", "engine",
+		"sector", "request", "keys", "threads", "dir", "MB/s",
+		"avg_us", "p50_us", "p99_us");
+	for (a = 0; a < nname; a++)
+		for (b = 0; b < nsector; b++)
+			for (c = 0; c < nrequest; c++)
+				for (d = 0; d < nkey; d++)
+					for (e = 0; e < nthread; e++) {
+		if (request[c] < sector[b] || request[c] % sector[b] ||
+		    sector[b] % 16)
+			continue;
+		if (rw != STORAGE_READ)
+			bench_run (names[a], sector[b], request[c], key[d],
+				   thread[e], STORAGE_WRITE, seconds);
+		if (rw != STORAGE_WRITE)
+			bench_run (names[a], sector[b], request[c], key[d],
+				   thread[e], STORAGE_READ, seconds);
+	}
+	return 0;
+}
@@ -28,7 +28,10 @@
  */
 
 #include <core.h>
+#include <core/cpu.h>
+#include <core/list.h>
 #include <core/process.h>
+#include <core/thread.h>
 #include <storage.h>
 #include "lib/storage_msg.h"
 
@@ -172,6 +175,201 @@ storage_init (struct config_data_storage *config_storage)
 	msgclose (d);
 }
 
+void
+storage_parallel (void (*func) (void *arg, int i), void *arg, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		func (arg, i);
+}
+
+#else /* STORAGE_PD */
+
+/* Requests of at least STORAGE_PARALLEL_MIN sectors are split into
+   chunks of STORAGE_PARALLEL_CHUNK sectors, which are processed by
+   per-CPU worker threads together with the requesting thread.  The
+   buffers must be accessible from every CPU; the per-CPU mapmem()
+   windows map at most 16KiB, which is less than that. */
+#define STORAGE_PARALLEL_CHUNK	32
+#define STORAGE_PARALLEL_MIN	(STORAGE_PARALLEL_CHUNK * 2)
+
+struct storage_job {
+	LIST1_DEFINE (struct storage_job);
+	void (*func) (void *arg, int i);
+	void *arg;
+	int n, claimed, done;
+};
+
+struct storage_worker {
+	tid_t tid;
+	int cpunum;
+	bool sleeping;
+};
+
+struct storage_sectors {
+	struct storage_device *storage;
+	struct storage_access *access;
+	u8 *src, *dst;
+};
+
+static LIST1_DEFINE_HEAD (struct storage_job, storage_jobs);
+static struct storage_worker *storage_workers;
+static int storage_nworkers;
+static spinlock_t storage_job_lock;
+
+/* Claim an item and process it.  If job is NULL, the item is taken
+   from the first queued job.  A job is in storage_jobs while it has
+   unclaimed items.  Returns false if there is nothing to claim. */
+static bool
+storage_job_run (struct storage_job *job)
+{
+	int i;
+
+	spinlock_lock (&storage_job_lock);
+	if (!job) {
+		job = LIST1_POP (storage_jobs);
+		if (!job) {
+			spinlock_unlock (&storage_job_lock);
+			return false;
+		}
+		LIST1_ADD (storage_jobs, job);
+	}
+	if (job->claimed == job->n) {
+		spinlock_unlock (&storage_job_lock);
+		return false;
+	}
+	i = job->claimed++;
+	if (job->claimed == job->n)
+		LIST1_DEL (storage_jobs, job);
+	spinlock_unlock (&storage_job_lock);
+	job->func (job->arg, i);
+	spinlock_lock (&storage_job_lock);
+	job->done++;
+	spinlock_unlock (&storage_job_lock);
+	return true;
+}
+
+static void
+storage_worker_thread (void *arg)
+{
+	struct storage_worker *w = arg;
+
+	for (;;) {
+		while (storage_job_run (NULL));
+		spinlock_lock (&storage_job_lock);
+		if (storage_jobs.next) {
+			spinlock_unlock (&storage_job_lock);
+			continue;
+		}
+		w->sleeping = true;
+		thread_will_stop ();
+		spinlock_unlock (&storage_job_lock);
+		schedule ();
+	}
+}
+
+/* Call func (arg, i) for i from 0 to n - 1 and return after all the
+   calls have returned.  The job is queued, the workers on the other
+   CPUs are woken up and the current thread processes items as well
+   until all of them are claimed, so the caller never waits for a
+   worker to be scheduled.  func must not sleep, and the memory it
+   uses must be accessible from every CPU.  The job is on the stack,
+   so it is protected by storage_job_lock rather than by a lock of
+   its own. */
+void
+storage_parallel (void (*func) (void *arg, int i), void *arg, int n)
+{
+	struct storage_job job;
+	int i, cpunum, done;
+
+	if (storage_nworkers == 0 || n < 2) {
+		for (i = 0; i < n; i++)
+			func (arg, i);
+		return;
+	}
+	job.func = func;
+	job.arg = arg;
+	job.n = n;
+	job.claimed = 0;
+	job.done = 0;
+	cpunum = get_cpu_id ();
+	spinlock_lock (&storage_job_lock);
+	LIST1_ADD (storage_jobs, &job);
+	for (i = 0; i < storage_nworkers; i++) {
+		if (storage_workers[i].sleeping &&
+		    storage_workers[i].cpunum != cpunum) {
+			storage_workers[i].sleeping = false;
+			thread_wakeup (storage_workers[i].tid);
+		}
+	}
+	spinlock_unlock (&storage_job_lock);
+	while (storage_job_run (&job));
+	do {
+		spinlock_lock (&storage_job_lock);
+		done = job.done;
+		spinlock_unlock (&storage_job_lock);
+	} while (done < n);
+}
+
+static void
+storage_sectors_chunk (void *arg, int i)
+{
+	struct storage_sectors *p = arg;
+	struct storage_access a;
+	count_t off;
+
+	off = i * STORAGE_PARALLEL_CHUNK;
+	a = *p->access;
+	a.lba += off;
+	a.count -= off;
+	if (a.count > STORAGE_PARALLEL_CHUNK)
+		a.count = STORAGE_PARALLEL_CHUNK;
+	storage_lib_handle_sectors (p->storage, &a,
+				    p->src + off * a.sector_size,
+				    p->dst + off * a.sector_size);
+}
+
+int
+storage_handle_sectors (struct storage_device *storage,
+			struct storage_access *access, u8 *src, u8 *dst)
+{
+	struct storage_sectors p;
+
+	if (storage_nworkers == 0 || access->count < STORAGE_PARALLEL_MIN)
+		return storage_lib_handle_sectors (storage, access, src, dst);
+	p.storage = storage;
+	p.access = access;
+	p.src = src;
+	p.dst = dst;
+	storage_parallel (storage_sectors_chunk, &p,
+			  (access->count + STORAGE_PARALLEL_CHUNK - 1) /
+			  STORAGE_PARALLEL_CHUNK);
+	return 0;
+}
+
+static void
+storage_workers_init (void)
+{
+	int i, n;
+
+	LIST1_HEAD_INIT (storage_jobs);
+	spinlock_init (&storage_job_lock);
+	n = get_cpu_count ();
+	if (n < 2)
+		return;
+	storage_workers = alloc (sizeof *storage_workers * n);
+	for (i = 0; i < n; i++) {
+		storage_workers[i].cpunum = i;
+		storage_workers[i].sleeping = false;
+		storage_workers[i].tid =
+			thread_new_bind (storage_worker_thread,
+					 &storage_workers[i], VMM_STACKSIZE,
+					 THREAD_PRIORITY_HIGH, i);
+	}
+	storage_nworkers = n;
+}
+
 #endif /* STORAGE_PD */
 
 long
@@ -202,6 +400,9 @@ static void
 storage_kernel_init (void)
 {
 	storage_init (&config.storage);
+#ifndef STORAGE_PD
+	storage_workers_init ();
+#endif /* STORAGE_PD */
 	desc = msgopen ("storage");
 	if (desc < 0)
 		panic ("open storage");
@@ -0,0 +1,530 @@
+/*
+ * Copyright (c) 2007, 2008 University of Tsukuba
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the University of Tsukuba nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* AES-XTS using the AES-NI instructions.  The VMM is built with
+   -mno-sse, so XMM registers are used only inside the inline
+   assembly below and the guest's XMM0-7 are saved and restored
+   around each call.  Four blocks are processed at a time to hide
+   the latency of the AESENC/AESDEC instructions.  The tweak update
+   (multiplication by alpha) is a shift and a conditional XOR, which
+   is done in C. */
+
+#include <core.h>
+#include "crypto.h"
+
+#define AES_BLK_BYTES		16
+#define AESNI_MAXROUNDS		14
+#define AESNI_PARALLEL		4
+
+#define AESNI_CPUID1_ECX_AES	0x02000000
+#define AESNI_CPUID1_EDX_SSE2	0x04000000
+#define AESNI_CR0_EM		0x4
+#define AESNI_CR0_TS		0x8
+#define AESNI_CR4_OSFXSR	0x200
+
+struct aesni_key {
+	u8 rk[(AESNI_MAXROUNDS + 1) * AES_BLK_BYTES];
+	int rounds;
+} __attribute__ ((aligned (16)));
+
+struct aes_xts_ni_keyctx {
+	struct aesni_key tweak_key;
+	struct aesni_key encrypt_key;
+	struct aesni_key decrypt_key;
+};
+
+struct aesni_fpu {
+	ulong cr0;
+	u8 xmm[8][AES_BLK_BYTES];
+};
+
+static struct crypto aes_xts_ni_crypto;
+
+#ifndef STORAGE_PD
+static const u8 aesni_sbox[256] = {
+	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5,
+	0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+	0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0,
+	0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+	0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc,
+	0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a,
+	0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+	0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0,
+	0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+	0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b,
+	0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85,
+	0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+	0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5,
+	0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+	0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17,
+	0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88,
+	0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+	0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c,
+	0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+	0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9,
+	0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6,
+	0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+	0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e,
+	0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+	0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94,
+	0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68,
+	0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+static u8
+aesni_xtime (u8 x)
+{
+	return (x << 1) ^ (x & 0x80 ? 0x1b : 0);
+}
+
+static u8
+aesni_gmul (u8 x, u8 y)
+{
+	u8 r = 0;
+
+	for (; y; y >>= 1) {
+		if (y & 1)
+			r ^= x;
+		x = aesni_xtime (x);
+	}
+	return r;
+}
+
+static u32
+aesni_subword (u32 w)
+{
+	return aesni_sbox[w & 0xFF] |
+		aesni_sbox[(w >> 8) & 0xFF] << 8 |
+		aesni_sbox[(w >> 16) & 0xFF] << 16 |
+		(u32)aesni_sbox[w >> 24] << 24;
+}
+
+/* FIPS-197 key expansion.  Words are stored in memory order, which
+   is the layout AESENC expects. */
+static void
+aesni_expand_key (struct aesni_key *k, const u8 *key, int bits)
+{
+	int nk = bits / 32, nw, i;
+	u32 w[(AESNI_MAXROUNDS + 1) * 4], t;
+	u8 rcon = 1;
+
+	k->rounds = nk + 6;
+	nw = (k->rounds + 1) * 4;
+	memcpy (w, (void *)key, nk * 4);
+	for (i = nk; i < nw; i++) {
+		t = w[i - 1];
+		if (i % nk == 0) {
+			t = aesni_subword (t >> 8 | t << 24) ^ rcon;
+			rcon = aesni_xtime (rcon);
+		} else if (nk > 6 && i % nk == 4) {
+			t = aesni_subword (t);
+		}
+		w[i] = w[i - nk] ^ t;
+	}
+	memcpy (k->rk, w, nw * 4);
+}
+
+/* Round keys for AESDEC: the encryption schedule in reverse order
+   with InvMixColumns applied to the inner round keys, as AESIMC
+   would do. */
+static void
+aesni_decrypt_key (struct aesni_key *d, struct aesni_key *e)
+{
+	int i, j;
+	u8 *s, *p;
+
+	d->rounds = e->rounds;
+	for (i = 0; i <= e->rounds; i++) {
+		s = &e->rk[(e->rounds - i) * AES_BLK_BYTES];
+		p = &d->rk[i * AES_BLK_BYTES];
+		if (i == 0 || i == e->rounds) {
+			memcpy (p, s, AES_BLK_BYTES);
+			continue;
+		}
+		for (j = 0; j < AES_BLK_BYTES; j += 4) {
+			p[j] = aesni_gmul (s[j], 14) ^
+				aesni_gmul (s[j + 1], 11) ^
+				aesni_gmul (s[j + 2], 13) ^
+				aesni_gmul (s[j + 3], 9);
+			p[j + 1] = aesni_gmul (s[j], 9) ^
+				aesni_gmul (s[j + 1], 14) ^
+				aesni_gmul (s[j + 2], 11) ^
+				aesni_gmul (s[j + 3], 13);
+			p[j + 2] = aesni_gmul (s[j], 13) ^
+				aesni_gmul (s[j + 1], 9) ^
+				aesni_gmul (s[j + 2], 14) ^
+				aesni_gmul (s[j + 3], 11);
+			p[j + 3] = aesni_gmul (s[j], 11) ^
+				aesni_gmul (s[j + 1], 13) ^
+				aesni_gmul (s[j + 2], 9) ^
+				aesni_gmul (s[j + 3], 14);
+		}
+	}
+}
+
+static bool
+aesni_supported (void)
+{
+	u32 a, b, c, d;
+
+	asm volatile ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d)
+		      : "a" (1), "c" (0));
+	return (c & AESNI_CPUID1_ECX_AES) && (d & AESNI_CPUID1_EDX_SSE2);
+}
+
+#ifdef STORAGE_BENCH
+/* The host benchmark runs as a Linux process, which owns its XMM
+   state. */
+static void
+aesni_fpu_begin (struct aesni_fpu *f)
+{
+}
+
+static void
+aesni_fpu_end (struct aesni_fpu *f)
+{
+}
+#else
+/* Make the XMM registers usable in the VMM and save the guest's
+   XMM0-7.  CR4.OSFXSR is checked every time because the host CR4
+   is reloaded from the VMCS on each VM exit. */
+static void
+aesni_fpu_begin (struct aesni_fpu *f)
+{
+	ulong cr4;
+
+	asm volatile ("mov %%cr0,%0" : "=r" (f->cr0));
+	if (f->cr0 & (AESNI_CR0_EM | AESNI_CR0_TS))
+		asm volatile ("mov %0,%%cr0"
+			      : : "r" (f->cr0 & ~(AESNI_CR0_EM |
+						  AESNI_CR0_TS)));
+	asm volatile ("mov %%cr4,%0" : "=r" (cr4));
+	if (!(cr4 & AESNI_CR4_OSFXSR))
+		asm volatile ("mov %0,%%cr4" : : "r" (cr4 | AESNI_CR4_OSFXSR));
+	asm volatile ("movdqu %%xmm0,0x00(%0)\n"
+		      "movdqu %%xmm1,0x10(%0)\n"
+		      "movdqu %%xmm2,0x20(%0)\n"
+		      "movdqu %%xmm3,0x30(%0)\n"
+		      "movdqu %%xmm4,0x40(%0)\n"
+		      "movdqu %%xmm5,0x50(%0)\n"
+		      "movdqu %%xmm6,0x60(%0)\n"
+		      "movdqu %%xmm7,0x70(%0)\n"
+		      : : "r" (f->xmm) : "memory");
+}
+
+static void
+aesni_fpu_end (struct aesni_fpu *f)
+{
+	asm volatile ("movdqu 0x00(%0),%%xmm0\n"
+		      "movdqu 0x10(%0),%%xmm1\n"
+		      "movdqu 0x20(%0),%%xmm2\n"
+		      "movdqu 0x30(%0),%%xmm3\n"
+		      "movdqu 0x40(%0),%%xmm4\n"
+		      "movdqu 0x50(%0),%%xmm5\n"
+		      "movdqu 0x60(%0),%%xmm6\n"
+		      "movdqu 0x70(%0),%%xmm7\n"
+		      : : "r" (f->xmm) : "memory");
+	if (f->cr0 & (AESNI_CR0_EM | AESNI_CR0_TS))
+		asm volatile ("mov %0,%%cr0" : : "r" (f->cr0));
+}
+#endif
+
+/* One block, no tweak.  Used for the tweak itself and for the
+   blocks left over after the four-block loop. */
+#define AESNI_CRYPT1(op, oplast) \
+	"movdqu (%[s]),%%xmm0\n" \
+	"pxor (%[k]),%%xmm0\n" \
+	"add $16,%[k]\n" \
+	"dec %[r]\n" \
+	"1:\n" \
+	op " (%[k]),%%xmm0\n" \
+	"add $16,%[k]\n" \
+	"dec %[r]\n" \
+	"jnz 1b\n" \
+	oplast " (%[k]),%%xmm0\n" \
+	"movdqu %%xmm0,(%[d])\n"
+
+/* Four blocks with their tweaks in XMM4-7. */
+#define AESNI_XTS4(op, oplast) \
+	"movdqu 0x00(%[t]),%%xmm4\n" \
+	"movdqu 0x10(%[t]),%%xmm5\n" \
+	"movdqu 0x20(%[t]),%%xmm6\n" \
+	"movdqu 0x30(%[t]),%%xmm7\n" \
+	"movdqu 0x00(%[s]),%%xmm0\n" \
+	"movdqu 0x10(%[s]),%%xmm1\n" \
+	"movdqu 0x20(%[s]),%%xmm2\n" \
+	"movdqu 0x30(%[s]),%%xmm3\n" \
+	"pxor %%xmm4,%%xmm0\n" \
+	"pxor %%xmm5,%%xmm1\n" \
+	"pxor %%xmm6,%%xmm2\n" \
+	"pxor %%xmm7,%%xmm3\n" \
+	"pxor (%[k]),%%xmm0\n" \
+	"pxor (%[k]),%%xmm1\n" \
+	"pxor (%[k]),%%xmm2\n" \
+	"pxor (%[k]),%%xmm3\n" \
+	"add $16,%[k]\n" \
+	"dec %[r]\n" \
+	"1:\n" \
+	op " (%[k]),%%xmm0\n" \
+	op " (%[k]),%%xmm1\n" \
+	op " (%[k]),%%xmm2\n" \
+	op " (%[k]),%%xmm3\n" \
+	"add $16,%[k]\n" \
+	"dec %[r]\n" \
+	"jnz 1b\n" \
+	oplast " (%[k]),%%xmm0\n" \
+	oplast " (%[k]),%%xmm1\n" \
+	oplast " (%[k]),%%xmm2\n" \
+	oplast " (%[k]),%%xmm3\n" \
+	"pxor %%xmm4,%%xmm0\n" \
+	"pxor %%xmm5,%%xmm1\n" \
+	"pxor %%xmm6,%%xmm2\n" \
+	"pxor %%xmm7,%%xmm3\n" \
+	"movdqu %%xmm0,0x00(%[d])\n" \
+	"movdqu %%xmm1,0x10(%[d])\n" \
+	"movdqu %%xmm2,0x20(%[d])\n" \
+	"movdqu %%xmm3,0x30(%[d])\n"
+
+static void
+aesni_encrypt1 (void *dst, void *src, struct aesni_key *key)
+{
+	u8 *k = key->rk;
+	int r = key->rounds;
+
+	asm volatile (AESNI_CRYPT1 ("aesenc", "aesenclast")
+		      : [k] "+r" (k), [r] "+r" (r)
+		      : [s] "r" (src), [d] "r" (dst)
+		      : "cc", "memory");
+}
+
+static void
+aesni_decrypt1 (void *dst, void *src, struct aesni_key *key)
+{
+	u8 *k = key->rk;
+	int r = key->rounds;
+
+	asm volatile (AESNI_CRYPT1 ("aesdec", "aesdeclast")
+		      : [k] "+r" (k), [r] "+r" (r)
+		      : [s] "r" (src), [d] "r" (dst)
+		      : "cc", "memory");
+}
+
+static void
+aesni_xts_encrypt4 (void *dst, void *src, u64 *tweak, struct aesni_key *key)
+{
+	u8 *k = key->rk;
+	int r = key->rounds;
+
+	asm volatile (AESNI_XTS4 ("aesenc", "aesenclast")
+		      : [k] "+r" (k), [r] "+r" (r)
+		      : [s] "r" (src), [d] "r" (dst), [t] "r" (tweak)
+		      : "cc", "memory");
+}
+
+static void
+aesni_xts_decrypt4 (void *dst, void *src, u64 *tweak, struct aesni_key *key)
+{
+	u8 *k = key->rk;
+	int r = key->rounds;
+
+	asm volatile (AESNI_XTS4 ("aesdec", "aesdeclast")
+		      : [k] "+r" (k), [r] "+r" (r)
+		      : [s] "r" (src), [d] "r" (dst), [t] "r" (tweak)
+		      : "cc", "memory");
+}
+
+/* Multiply the tweak by alpha in GF(2^128). */
+static void
+aesni_xts_next (u64 *t)
+{
+	u64 carry = t[1] >> 63;
+
+	t[1] = t[1] << 1 | t[0] >> 63;
+	t[0] = t[0] << 1 ^ (carry ? 0x87 : 0);
+}
+
+static void
+aes_xts_ni_crypt (u8 *dst, u8 *src, struct aesni_key *tk,
+		  struct aesni_key *ck, bool enc, u64 lba, int sector_size)
+{
+	u64 tweak[AESNI_PARALLEL * 2], t[2];
+	u8 buf[AES_BLK_BYTES];
+	int i, j;
+
+	ASSERT (sector_size % AES_BLK_BYTES == 0);
+	t[0] = lba;
+	t[1] = 0;
+	aesni_encrypt1 (t, t, tk);
+	for (i = sector_size / AES_BLK_BYTES; i >= AESNI_PARALLEL;
+	     i -= AESNI_PARALLEL) {
+		for (j = 0; j < AESNI_PARALLEL; j++) {
+			tweak[j * 2] = t[0];
+			tweak[j * 2 + 1] = t[1];
+			aesni_xts_next (t);
+		}
+		if (enc)
+			aesni_xts_encrypt4 (dst, src, tweak, ck);
+		else
+			aesni_xts_decrypt4 (dst, src, tweak, ck);
+		dst += AES_BLK_BYTES * AESNI_PARALLEL;
+		src += AES_BLK_BYTES * AESNI_PARALLEL;
+	}
+	for (; i > 0; i--) {
+		for (j = 0; j < AES_BLK_BYTES; j++)
+			buf[j] = src[j] ^ ((u8 *)t)[j];
+		if (enc)
+			aesni_encrypt1 (buf, buf, ck);
+		else
+			aesni_decrypt1 (buf, buf, ck);
+		for (j = 0; j < AES_BLK_BYTES; j++)
+			dst[j] = buf[j] ^ ((u8 *)t)[j];
+		aesni_xts_next (t);
+		dst += AES_BLK_BYTES;
+		src += AES_BLK_BYTES;
+	}
+}
+
+/* The XMM state is switched once per request rather than once per
+   sector. */
+static void
+aes_xts_ni_crypt_sectors (u8 *dst, u8 *src, struct aesni_key *tk,
+			  struct aesni_key *ck, bool enc, u64 lba, int count,
+			  int sector_size)
+{
+	struct aesni_fpu f;
+
+	aesni_fpu_begin (&f);
+	for (; count > 0; count--) {
+		aes_xts_ni_crypt (dst, src, tk, ck, enc, lba++, sector_size);
+		dst += sector_size;
+		src += sector_size;
+	}
+	aesni_fpu_end (&f);
+}
+
+static void
+aes_xts_ni_encrypt (void *dst, void *src, void *keyctx, lba_t lba,
+		    int sector_size)
+{
+	struct aes_xts_ni_keyctx *k = keyctx;
+
+	aes_xts_ni_crypt_sectors (dst, src, &k->tweak_key, &k->encrypt_key,
+				  true, lba, 1, sector_size);
+}
+
+static void
+aes_xts_ni_decrypt (void *dst, void *src, void *keyctx, lba_t lba,
+		    int sector_size)
+{
+	struct aes_xts_ni_keyctx *k = keyctx;
+
+	aes_xts_ni_crypt_sectors (dst, src, &k->tweak_key, &k->decrypt_key,
+				  false, lba, 1, sector_size);
+}
+
+static void
+aes_xts_ni_encrypt_sectors (void *dst, void *src, void *keyctx, lba_t lba,
+			    int count, int sector_size)
+{
+	struct aes_xts_ni_keyctx *k = keyctx;
+
+	aes_xts_ni_crypt_sectors (dst, src, &k->tweak_key, &k->encrypt_key,
+				  true, lba, count, sector_size);
+}
+
+static void
+aes_xts_ni_decrypt_sectors (void *dst, void *src, void *keyctx, lba_t lba,
+			    int count, int sector_size)
+{
+	struct aes_xts_ni_keyctx *k = keyctx;
+
+	aes_xts_ni_crypt_sectors (dst, src, &k->tweak_key, &k->decrypt_key,
+				  false, lba, count, sector_size);
+}
+
+static void *
+aes_xts_ni_setkey (const u8 *key, int bits)
+{
+	int keybit = bits / 2;
+	int keylen = keybit / 8;
+	struct aes_xts_ni_keyctx *keyctx;
+
+	keyctx = alloc (sizeof *keyctx);
+	ASSERT (((ulong)keyctx & 15) == 0);
+	aesni_expand_key (&keyctx->tweak_key, key + keylen, keybit);
+	aesni_expand_key (&keyctx->encrypt_key, key, keybit);
+	aesni_decrypt_key (&keyctx->decrypt_key, &keyctx->encrypt_key);
+	return keyctx;
+}
+
+#else
+static bool
+aesni_supported (void)
+{
+	/* The storage process runs in user mode and cannot manage the
+	   XMM state; use the table-based implementation there. */
+	return false;
+}
+#endif
+
+void
+aes_xts_ni_init (void)
+{
+	struct crypto *sw;
+
+	if (!aesni_supported ()) {
+		/* Register the software engine under this name so that
+		   configurations selecting aes-ni keep working. */
+		sw = crypto_find ("aes-xts");
+		if (!sw)
+			return;
+		aes_xts_ni_crypto = *sw;
+		aes_xts_ni_crypto.name = "aes-ni";
+		printf ("AES-NI not available, aes-ni uses software AES-XTS\n");
+		crypto_register (&aes_xts_ni_crypto);
+		return;
+	}
+#ifndef STORAGE_PD
+	aes_xts_ni_crypto.name = "aes-ni";
+	aes_xts_ni_crypto.block_size = AES_BLK_BYTES;
+	aes_xts_ni_crypto.keyctx_size = sizeof (struct aes_xts_ni_keyctx);
+	aes_xts_ni_crypto.encrypt = aes_xts_ni_encrypt;
+	aes_xts_ni_crypto.decrypt = aes_xts_ni_decrypt;
+	aes_xts_ni_crypto.setkey = aes_xts_ni_setkey;
+	aes_xts_ni_crypto.encrypt_sectors = aes_xts_ni_encrypt_sectors;
+	aes_xts_ni_crypto.decrypt_sectors = aes_xts_ni_decrypt_sectors;
+	printf ("AES-XTS Encryption Engine initialized (AES=aes-ni)\n");
+	crypto_register (&aes_xts_ni_crypto);
+#endif
+}
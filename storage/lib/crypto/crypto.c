@@ -62,9 +62,11 @@ void
 crypto_init (void)
 {
 	void aes_xts_init (void);
+	void aes_xts_ni_init (void);
 	void crypto_none_init (void);
 
 	crypto_list = NULL;
 	aes_xts_init ();
+	aes_xts_ni_init ();
 	crypto_none_init ();
 }
@@ -41,6 +41,12 @@ struct crypto {
 	void	(*encrypt)(void *dst, void *src, void *keyctx, lba_t lba, int sector_size);
 	void	(*decrypt)(void *dst, void *src, void *keyctx, lba_t lba, int sector_size);
 	void	*(*setkey)(const u8 *key, int bits);
+	/* Optional: process count consecutive sectors starting at lba.
+	   dst may be equal to src. */
+	void	(*encrypt_sectors)(void *dst, void *src, void *keyctx,
+				   lba_t lba, int count, int sector_size);
+	void	(*decrypt_sectors)(void *dst, void *src, void *keyctx,
+				   lba_t lba, int count, int sector_size);
 	int	block_size;
 	int	keyctx_size;
 	char	*name;
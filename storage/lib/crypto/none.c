@@ -51,6 +51,13 @@ crypto_none_decrypt (void *dst, void *src, void *keyctx, lba_t lba,
 	crypto_none_crypt (dst, src, sector_size);
 }
 
+static void
+crypto_none_crypt_sectors (void *dst, void *src, void *keyctx, lba_t lba,
+			   int count, int sector_size)
+{
+	crypto_none_crypt (dst, src, count * sector_size);
+}
+
 static void *
 crypto_none_setkey (const u8 *key, int bits)
 {
@@ -64,6 +71,8 @@ static struct crypto crypto_none_crypto = {
 	.encrypt =	crypto_none_encrypt,
 	.decrypt =	crypto_none_decrypt,
 	.setkey =	crypto_none_setkey,
+	.encrypt_sectors = crypto_none_crypt_sectors,
+	.decrypt_sectors = crypto_none_crypt_sectors,
 };
 
 void
@@ -45,6 +45,7 @@ static struct guid anyguid = STORAGE_GUID_ANY;
 static struct config_data_storage *cfg;
 static int storage_desc;
 
+/* crypto is NULL for a plaintext range */
 struct storage_keys {
 	lba_t		lba_low, lba_high;
 	struct crypto	*crypto;
@@ -60,9 +61,11 @@ typedef	union {
 	} __attribute__ ((packed));
 } storage_busid_t;
 
+/* The ranges in keys[] are sorted, do not overlap and cover every
+   LBA, so that a request needs one binary search. */
 struct storage_device {
 	int keynum;
-	struct storage_keys keys[STORAGE_MAX_KEYS_PER_DEVICE];
+	struct storage_keys keys[STORAGE_MAX_KEYS_PER_DEVICE * 2 + 1];
 };
 
 struct storage_init {
@@ -128,14 +131,42 @@ storage_match_extend (struct storage_init *init,
 	return 1;
 }
 
+static void
+storage_add_keys (struct storage_device *storage, lba_t lba_low,
+		  lba_t lba_high, struct crypto *crypto, void *keyctx)
+{
+	struct storage_keys *k;
+
+	if (storage->keynum > 0) {
+		k = &storage->keys[storage->keynum - 1];
+		if (k->crypto == crypto && k->keyctx == keyctx) {
+			k->lba_high = lba_high;
+			return;
+		}
+	}
+	ASSERT (storage->keynum < sizeof storage->keys / sizeof storage->keys[0]);
+	k = &storage->keys[storage->keynum++];
+	k->lba_low = lba_low;
+	k->lba_high = lba_high;
+	k->crypto = crypto;
+	k->keyctx = keyctx;
+}
+
+/* Matching key configurations are sorted by lba_low and turned into
+   a list of ranges with the gaps filled by plaintext ranges.  Where
+   configurations overlap, the one starting first wins.  Entries with
+   the same key share the key schedule, and adjacent ranges with the
+   same key are merged. */
 static void
 storage_set_keys (struct storage_device *storage, struct storage_init *init)
 {
-	int i, keyindex = 0;
+	int i, j, n = 0;
 	struct crypto *crypto;
-	struct storage_keys_conf *keys_conf;
+	struct storage_keys_conf *keys_conf, *conf[STORAGE_MAX_KEYS_PER_DEVICE];
+	struct storage_keys keys[STORAGE_MAX_KEYS_PER_DEVICE], k;
 	u8 *key;
 	int bits;
+	lba_t lba;
 
 	for (i = 0; i < NUM_OF_STORAGE_KEYS_CONF; i++) {
 		keys_conf = &cfg->keys_conf[i];
@@ -150,67 +181,112 @@ storage_set_keys (struct storage_device *storage, struct storage_init *init)
 		if (crypto == NULL)
 			panic ("unknown crypto name: %s\n",
 			       keys_conf->crypto_name);
-		storage->keys[keyindex].lba_low = keys_conf->lba_low;
-		storage->keys[keyindex].lba_high = keys_conf->lba_high;
-		storage->keys[keyindex].crypto = crypto;
-		storage->keys[keyindex].keyctx = crypto->setkey (key, bits);
-		keyindex++;
+		if (keys_conf->lba_low > keys_conf->lba_high)
+			continue;
+		if (n == STORAGE_MAX_KEYS_PER_DEVICE)
+			panic ("too many keys for a storage device\n");
+		k.lba_low = keys_conf->lba_low;
+		k.lba_high = keys_conf->lba_high;
+		k.crypto = crypto;
+		k.keyctx = NULL;
+		for (j = 0; j < n; j++) {
+			if (keys[j].crypto == crypto &&
+			    conf[j]->keyindex == keys_conf->keyindex &&
+			    conf[j]->keybits == keys_conf->keybits) {
+				k.keyctx = keys[j].keyctx;
+				break;
+			}
+		}
+		if (j == n)
+			k.keyctx = crypto->setkey (key, bits);
+		for (j = n; j > 0 && keys[j - 1].lba_low > k.lba_low; j--) {
+			keys[j] = keys[j - 1];
+			conf[j] = conf[j - 1];
+		}
+		keys[j] = k;
+		conf[j] = keys_conf;
+		n++;
 	}
-	storage->keynum = keyindex;
+	storage->keynum = 0;
+	lba = 0;
+	for (i = 0; i < n; i++) {
+		k = keys[i];
+		if (k.lba_high < lba)
+			continue;
+		if (k.lba_low < lba)
+			k.lba_low = lba;
+		if (k.lba_low > lba)
+			storage_add_keys (storage, lba, k.lba_low - 1, NULL,
+					  NULL);
+		storage_add_keys (storage, k.lba_low, k.lba_high, k.crypto,
+				  k.keyctx);
+		if (k.lba_high == ~0ULL)
+			return;
+		lba = k.lba_high + 1;
+	}
+	storage_add_keys (storage, lba, ~0ULL, NULL, NULL);
+}
+
+static int
+storage_find_keys (struct storage_device *storage, lba_t lba)
+{
+	int low = 0, high = storage->keynum - 1, mid;
+
+	while (low < high) {
+		mid = (low + high + 1) / 2;
+		if (storage->keys[mid].lba_low <= lba)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+	return low;
 }
 
 int
-storage_handle_sectors (struct storage_device *storage,
-			 struct storage_access *access, u8 *src, u8 *dst)
+storage_lib_handle_sectors (struct storage_device *storage,
+			    struct storage_access *access, u8 *src, u8 *dst)
 {
-	int i, sub_count;
-	unsigned long long int sub_count2;
+	int i, j, n;
 	lba_t lba = access->lba;
 	count_t	count = access->count, size;
 	int sector_size = access->sector_size;
+	struct storage_keys *k;
 	struct crypto *crypto;
 	void (*crypt)(void *dst, void *src, void *keyctx, lba_t lba, int sector_size);
-	void *keyctx;
+	void (*crypt_sectors)(void *dst, void *src, void *keyctx, lba_t lba,
+			      int count, int sector_size);
 
-	for (i = 0; count > 0 && i < storage->keynum; i++) {
-		// if lba < low then memcpy
-		while (count > 0 && storage->keys[i].lba_low > lba) {
-			sub_count2 = storage->keys[i].lba_low - lba;
-			if (sub_count2 > 65535)
-				sub_count = 65535;
-			else
-				sub_count = sub_count2;
-			sub_count = min(count, sub_count);
-			count -= sub_count;
-			size = sub_count * sector_size;
+	for (i = storage_find_keys (storage, lba); count > 0; i++) {
+		ASSERT (i < storage->keynum);
+		k = &storage->keys[i];
+		n = count;
+		if (k->lba_high - lba < n)
+			n = k->lba_high - lba + 1;
+		size = n * sector_size;
+		crypto = k->crypto;
+		if (!crypto) {
 			if (dst != src)
 				memcpy(dst, src, size);
-			lba += sub_count;
-			src += size;
-			dst += size;
-		}
-
-		// if low <= lba <= high then crypt
-		while (count > 0 && storage->keys[i].lba_high >= lba) {
-			sub_count2 = storage->keys[i].lba_high - lba;
-			if (sub_count2 >= 65535)
-				sub_count = 65535;
-			else
-				sub_count = sub_count2 + 1;
-			keyctx = storage->keys[i].keyctx;
-			crypto = storage->keys[i].crypto;
+		} else {
 			crypt = (access->rw == STORAGE_READ) ? crypto->decrypt : crypto->encrypt;
-			sub_count = min(count, sub_count);
-			count -= sub_count;
-			while (sub_count-- > 0) {
-				crypt(dst, src, keyctx, lba++, sector_size);
-				src += sector_size;
-				dst += sector_size;
+			crypt_sectors = (access->rw == STORAGE_READ) ?
+				crypto->decrypt_sectors :
+				crypto->encrypt_sectors;
+			if (crypt_sectors) {
+				crypt_sectors(dst, src, k->keyctx, lba, n,
+					      sector_size);
+			} else {
+				for (j = 0; j < n; j++)
+					crypt(dst + j * sector_size,
+					      src + j * sector_size, k->keyctx,
+					      lba + j, sector_size);
 			}
 		}
+		count -= n;
+		lba += n;
+		src += size;
+		dst += size;
 	}
-	if (count > 0 && dst != src)
-		memcpy(dst, src, count * sector_size);
 	return 0;
 }
 
@@ -306,10 +382,10 @@ storage_msghandler (int m, int c, struct msgbuf *buf, int bufcnt)
 		if (buf[0].len != sizeof *arg)
 			return -1;
 		arg = buf[0].base;
-		arg->retval = storage_handle_sectors (arg->storage,
-						      &arg->access,
-						      buf[1].base,
-						      buf[2].base);
+		arg->retval = storage_lib_handle_sectors (arg->storage,
+							  &arg->access,
+							  buf[1].base,
+							  buf[2].base);
 		return 0;
 	} else {
 		return -1;
@@ -51,3 +51,7 @@ struct storage_msg_handle_sectors {
 	struct storage_access access;
 	int retval;
 };
+
+int storage_lib_handle_sectors (struct storage_device *storage,
+				struct storage_access *access, u8 *src,
+				u8 *dst);
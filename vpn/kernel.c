@@ -46,11 +46,27 @@ struct nicdata {
 };
 
 #ifdef VPN_PD
+union nicrecv_arg {
+	struct vpn_msg_physicalnicrecv phys;
+	struct vpn_msg_virtualnicrecv virt;
+};
+
+/* Reused for each batch of received packets so that the receive path
+   does not allocate.  A slot is taken per call; nested or concurrent
+   calls take another one, so the list grows to the maximum depth. */
+struct nicrecv_slot {
+	struct nicrecv_slot *next;
+	union nicrecv_arg *arg;
+	struct msgbuf buf[1 + VPN_NIC_RECV_BATCH];
+};
+
 static struct mempool *mp;
 static int vpnkernel_desc, desc;
 static void *handle[NUM_OF_HANDLE];
 static spinlock_t handle_lock;	/* new only */
 static SE_HANDLE vpn_timer_handle;
+static struct nicrecv_slot *nicrecv_free;
+static spinlock_t nicrecv_lock;
 
 static void
 callsub (int c, struct msgbuf *buf, int bufcnt)
@@ -122,22 +138,45 @@ found:
 	return ret;
 }
 
+static struct nicrecv_slot *
+nicrecv_get_slot (void)
+{
+	struct nicrecv_slot *slot;
+
+	spinlock_lock (&nicrecv_lock);
+	slot = nicrecv_free;
+	if (slot)
+		nicrecv_free = slot->next;
+	spinlock_unlock (&nicrecv_lock);
+	if (!slot) {
+		slot = alloc (sizeof *slot);
+		slot->arg = mempool_allocmem (mp, sizeof *slot->arg);
+	}
+	return slot;
+}
+
 static void
-sendphysicalnicrecv_premap (SE_HANDLE nic_handle, UINT num_packets,
-			    void **packets, UINT *packet_sizes, void *param,
-			    long *premap)
+nicrecv_put_slot (struct nicrecv_slot *slot)
+{
+	spinlock_lock (&nicrecv_lock);
+	slot->next = nicrecv_free;
+	nicrecv_free = slot;
+	spinlock_unlock (&nicrecv_lock);
+}
+
+static struct msgbuf *
+nicrecv_setmsgbuf (struct nicrecv_slot *slot, void *arg, UINT arglen,
+		   UINT num_packets, void **packets, UINT *packet_sizes,
+		   long *premap)
 {
-	struct vpn_msg_physicalnicrecv *arg;
 	struct msgbuf *buf;
 	UINT i;
 
-	arg = mempool_allocmem (mp, sizeof *arg);
-	arg->nic_handle = nic_handle;
-	arg->param = param;
-	arg->num_packets = num_packets;
-	arg->cpu = get_cpu_id ();
-	buf = alloc (sizeof *buf * (1 + num_packets));
-	setmsgbuf (&buf[0], arg, sizeof *arg, 0);
+	if (num_packets <= VPN_NIC_RECV_BATCH)
+		buf = slot->buf;
+	else
+		buf = alloc (sizeof *buf * (1 + num_packets));
+	setmsgbuf (&buf[0], arg, arglen, 0);
 	if (premap) {
 		for (i = 0; i < num_packets; i++)
 			setmsgbuf_premap (&buf[1 + i], packets[i],
@@ -147,9 +186,32 @@ sendphysicalnicrecv_premap (SE_HANDLE nic_handle, UINT num_packets,
 			setmsgbuf (&buf[1 + i], packets[i], packet_sizes[i],
 				   0);
 	}
+	return buf;
+}
+
+static void
+sendphysicalnicrecv_premap (SE_HANDLE nic_handle, UINT num_packets,
+			    void **packets, UINT *packet_sizes, void *param,
+			    long *premap)
+{
+	struct vpn_msg_physicalnicrecv *arg;
+	struct nicrecv_slot *slot;
+	struct msgbuf *buf;
+
+	if (!num_packets)
+		return;
+	slot = nicrecv_get_slot ();
+	arg = &slot->arg->phys;
+	arg->nic_handle = nic_handle;
+	arg->param = param;
+	arg->num_packets = num_packets;
+	arg->cpu = get_cpu_id ();
+	buf = nicrecv_setmsgbuf (slot, arg, sizeof *arg, num_packets, packets,
+				 packet_sizes, premap);
 	callsub (VPN_MSG_PHYSICALNICRECV, buf, num_packets + 1);
-	free (buf);
-	mempool_freemem (mp, arg);
+	if (buf != slot->buf)
+		free (buf);
+	nicrecv_put_slot (slot);
 }
 
 static void
@@ -166,28 +228,23 @@ sendvirtualnicrecv_premap (SE_HANDLE nic_handle, UINT num_packets,
 			   long *premap)
 {
 	struct vpn_msg_virtualnicrecv *arg;
+	struct nicrecv_slot *slot;
 	struct msgbuf *buf;
-	UINT i;
 
-	arg = mempool_allocmem (mp, sizeof *arg);
+	if (!num_packets)
+		return;
+	slot = nicrecv_get_slot ();
+	arg = &slot->arg->virt;
 	arg->nic_handle = nic_handle;
 	arg->param = param;
 	arg->num_packets = num_packets;
 	arg->cpu = get_cpu_id ();
-	buf = alloc (sizeof *buf * (1 + num_packets));
-	setmsgbuf (&buf[0], arg, sizeof *arg, 0);
-	if (premap) {
-		for (i = 0; i < num_packets; i++)
-			setmsgbuf_premap (&buf[1 + i], packets[i],
-					  packet_sizes[i], 0, premap[i]);
-	} else {
-		for (i = 0; i < num_packets; i++)
-			setmsgbuf (&buf[1 + i], packets[i], packet_sizes[i],
-				   0);
-	}
+	buf = nicrecv_setmsgbuf (slot, arg, sizeof *arg, num_packets, packets,
+				 packet_sizes, premap);
 	callsub (VPN_MSG_VIRTUALNICRECV, buf, num_packets + 1);
-	free (buf);
-	mempool_freemem (mp, arg);
+	if (buf != slot->buf)
+		free (buf);
+	nicrecv_put_slot (slot);
 }
 
 static void
@@ -591,6 +648,8 @@ vpn_kernel_init (void)
 	int i;
 
 	spinlock_init (&handle_lock);
+	spinlock_init (&nicrecv_lock);
+	nicrecv_free = NULL;
 	for (i = 0; i < NUM_OF_HANDLE; i++)
 		handle[i] = NULL;
 	vpn_timer_handle = vpn_NewTimer (vpn_timer_callback, NULL);
@@ -88,6 +88,9 @@
 // 暗号化アルゴリズム (抽象化レイヤ)
 #include <Se/SeCrypto.h>
 
+// AES-NI による暗号化処理
+#include <Se/SeAesNi.h>
+
 // 設定ファイル読み込み
 #include <Se/SeConfig.h>
 
@@ -0,0 +1,456 @@
+/*
+ * Copyright (c) 2007, 2008 University of Tsukuba
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the University of Tsukuba nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Secure VM Project
+// VPN Client Module (IPsec Driver) Source Code
+// 
+// Developed by Daiyuu Nobori (dnobori@cs.tsukuba.ac.jp)
+
+// SeAesNi.c
+// 概要: AES-NI / PCLMULQDQ 命令による AES および GHASH の処理
+//
+// VMM は -mno-sse でコンパイルされるため、XMM レジスタは以下のインライン
+// アセンブラの内部でのみ使用する。ゲストの XMM0 - XMM7 は SeAesNiBegin() で
+// 退避し SeAesNiEnd() で復元する。CR0 を操作するため、VPN をプロセスとして
+// 動作させる場合 (VPN_PD) は使用せず、SeCrypto.c のソフトウェア実装を用いる。
+
+#define SE_INTERNAL
+#include <Se/Se.h>
+
+#if !defined(VPN_PD) && (defined(__i386__) || defined(__x86_64__))
+#define SE_AES_NI_ENABLED
+#endif	// !VPN_PD && x86
+
+#ifdef	SE_AES_NI_ENABLED
+
+#define SE_AES_NI_CPUID1_ECX_PCLMULQDQ	0x00000002
+#define SE_AES_NI_CPUID1_ECX_SSSE3		0x00000200
+#define SE_AES_NI_CPUID1_ECX_AES		0x02000000
+#define SE_AES_NI_CPUID1_EDX_SSE2		0x04000000
+#define SE_AES_NI_CR0_EM				0x4
+#define SE_AES_NI_CR0_TS				0x8
+#define SE_AES_NI_CR4_OSFXSR			0x200
+
+// PSHUFB でバイト順を反転するためのマスク
+static const UCHAR SeAesNiByteSwapMask[SE_AES_BLOCK_SIZE] __attribute__ ((aligned (16))) =
+{
+	15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+};
+
+// 1 ブロックの暗号化 / 解読 (XMM0)
+#define SE_AES_NI_CRYPT1(op, oplast) \
+	"movdqu (%[k]),%%xmm4\n" \
+	"pxor %%xmm4,%%xmm0\n" \
+	"add $16,%[k]\n" \
+	"dec %[r]\n" \
+	"1:\n" \
+	"movdqu (%[k]),%%xmm4\n" \
+	op " %%xmm4,%%xmm0\n" \
+	"add $16,%[k]\n" \
+	"dec %[r]\n" \
+	"jnz 1b\n" \
+	"movdqu (%[k]),%%xmm4\n" \
+	oplast " %%xmm4,%%xmm0\n"
+
+// 4 ブロックの暗号化 / 解読 (XMM0 - XMM3)
+#define SE_AES_NI_CRYPT4(op, oplast) \
+	"movdqu (%[k]),%%xmm4\n" \
+	"pxor %%xmm4,%%xmm0\n" \
+	"pxor %%xmm4,%%xmm1\n" \
+	"pxor %%xmm4,%%xmm2\n" \
+	"pxor %%xmm4,%%xmm3\n" \
+	"add $16,%[k]\n" \
+	"dec %[r]\n" \
+	"1:\n" \
+	"movdqu (%[k]),%%xmm4\n" \
+	op " %%xmm4,%%xmm0\n" \
+	op " %%xmm4,%%xmm1\n" \
+	op " %%xmm4,%%xmm2\n" \
+	op " %%xmm4,%%xmm3\n" \
+	"add $16,%[k]\n" \
+	"dec %[r]\n" \
+	"jnz 1b\n" \
+	"movdqu (%[k]),%%xmm4\n" \
+	oplast " %%xmm4,%%xmm0\n" \
+	oplast " %%xmm4,%%xmm1\n" \
+	oplast " %%xmm4,%%xmm2\n" \
+	oplast " %%xmm4,%%xmm3\n"
+
+#define SE_AES_NI_LOAD4 \
+	"movdqu 0x00(%[s]),%%xmm0\n" \
+	"movdqu 0x10(%[s]),%%xmm1\n" \
+	"movdqu 0x20(%[s]),%%xmm2\n" \
+	"movdqu 0x30(%[s]),%%xmm3\n"
+
+#define SE_AES_NI_STORE4 \
+	"movdqu %%xmm0,0x00(%[d])\n" \
+	"movdqu %%xmm1,0x10(%[d])\n" \
+	"movdqu %%xmm2,0x20(%[d])\n" \
+	"movdqu %%xmm3,0x30(%[d])\n"
+
+// GF(2^128) 上の乗算 XMM0 = XMM0 * XMM1 (バイト順反転表現)
+// XMM1 は保存され、XMM2 - XMM7 は破壊される
+#define SE_AES_NI_GFMUL \
+	"movdqa %%xmm0,%%xmm2\n" \
+	"pclmulqdq $0x00,%%xmm1,%%xmm2\n" \
+	"movdqa %%xmm0,%%xmm3\n" \
+	"pclmulqdq $0x10,%%xmm1,%%xmm3\n" \
+	"movdqa %%xmm0,%%xmm4\n" \
+	"pclmulqdq $0x01,%%xmm1,%%xmm4\n" \
+	"pclmulqdq $0x11,%%xmm1,%%xmm0\n" \
+	"pxor %%xmm4,%%xmm3\n" \
+	"movdqa %%xmm3,%%xmm4\n" \
+	"pslldq $8,%%xmm4\n" \
+	"psrldq $8,%%xmm3\n" \
+	"pxor %%xmm4,%%xmm2\n" \
+	"pxor %%xmm3,%%xmm0\n" \
+	"movdqa %%xmm2,%%xmm5\n" \
+	"psrld $31,%%xmm5\n" \
+	"movdqa %%xmm0,%%xmm6\n" \
+	"psrld $31,%%xmm6\n" \
+	"pslld $1,%%xmm2\n" \
+	"pslld $1,%%xmm0\n" \
+	"movdqa %%xmm5,%%xmm7\n" \
+	"psrldq $12,%%xmm7\n" \
+	"pslldq $4,%%xmm6\n" \
+	"pslldq $4,%%xmm5\n" \
+	"por %%xmm5,%%xmm2\n" \
+	"por %%xmm6,%%xmm0\n" \
+	"por %%xmm7,%%xmm0\n" \
+	"movdqa %%xmm2,%%xmm5\n" \
+	"pslld $31,%%xmm5\n" \
+	"movdqa %%xmm2,%%xmm6\n" \
+	"pslld $30,%%xmm6\n" \
+	"movdqa %%xmm2,%%xmm7\n" \
+	"pslld $25,%%xmm7\n" \
+	"pxor %%xmm6,%%xmm5\n" \
+	"pxor %%xmm7,%%xmm5\n" \
+	"movdqa %%xmm5,%%xmm6\n" \
+	"psrldq $4,%%xmm6\n" \
+	"pslldq $12,%%xmm5\n" \
+	"pxor %%xmm5,%%xmm2\n" \
+	"movdqa %%xmm2,%%xmm3\n" \
+	"psrld $1,%%xmm3\n" \
+	"movdqa %%xmm2,%%xmm4\n" \
+	"psrld $2,%%xmm4\n" \
+	"movdqa %%xmm2,%%xmm5\n" \
+	"psrld $7,%%xmm5\n" \
+	"pxor %%xmm4,%%xmm3\n" \
+	"pxor %%xmm5,%%xmm3\n" \
+	"pxor %%xmm6,%%xmm3\n" \
+	"pxor %%xmm3,%%xmm2\n" \
+	"pxor %%xmm2,%%xmm0\n"
+
+// AES-NI および PCLMULQDQ が使用可能かどうか
+bool SeAesNiIsSupported()
+{
+	UINT a, b, c, d;
+
+	asm volatile ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d)
+		: "a" (1), "c" (0));
+
+	if ((c & SE_AES_NI_CPUID1_ECX_AES) == 0 ||
+		(c & SE_AES_NI_CPUID1_ECX_PCLMULQDQ) == 0 ||
+		(c & SE_AES_NI_CPUID1_ECX_SSSE3) == 0 ||
+		(d & SE_AES_NI_CPUID1_EDX_SSE2) == 0)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+// XMM レジスタの使用開始 (ゲストの XMM0 - XMM7 を退避する)
+// ホストの CR4 は VM exit ごとに VMCS から再設定されるため毎回確認する
+void SeAesNiBegin(SE_AES_NI_FPU *f)
+{
+	LONG_PTR cr4;
+
+	asm volatile ("mov %%cr0,%0" : "=r" (f->Cr0));
+	if (f->Cr0 & (SE_AES_NI_CR0_EM | SE_AES_NI_CR0_TS))
+	{
+		asm volatile ("mov %0,%%cr0"
+			: : "r" (f->Cr0 & ~(SE_AES_NI_CR0_EM | SE_AES_NI_CR0_TS)));
+	}
+	asm volatile ("mov %%cr4,%0" : "=r" (cr4));
+	if ((cr4 & SE_AES_NI_CR4_OSFXSR) == 0)
+	{
+		asm volatile ("mov %0,%%cr4" : : "r" (cr4 | SE_AES_NI_CR4_OSFXSR));
+	}
+	asm volatile ("movdqu %%xmm0,0x00(%0)\n"
+		"movdqu %%xmm1,0x10(%0)\n"
+		"movdqu %%xmm2,0x20(%0)\n"
+		"movdqu %%xmm3,0x30(%0)\n"
+		"movdqu %%xmm4,0x40(%0)\n"
+		"movdqu %%xmm5,0x50(%0)\n"
+		"movdqu %%xmm6,0x60(%0)\n"
+		"movdqu %%xmm7,0x70(%0)\n"
+		: : "r" (f->Xmm) : "memory");
+}
+
+// XMM レジスタの使用終了 (ゲストの XMM0 - XMM7 を復元する)
+void SeAesNiEnd(SE_AES_NI_FPU *f)
+{
+	asm volatile ("movdqu 0x00(%0),%%xmm0\n"
+		"movdqu 0x10(%0),%%xmm1\n"
+		"movdqu 0x20(%0),%%xmm2\n"
+		"movdqu 0x30(%0),%%xmm3\n"
+		"movdqu 0x40(%0),%%xmm4\n"
+		"movdqu 0x50(%0),%%xmm5\n"
+		"movdqu 0x60(%0),%%xmm6\n"
+		"movdqu 0x70(%0),%%xmm7\n"
+		: : "r" (f->Xmm) : "memory");
+	if (f->Cr0 & (SE_AES_NI_CR0_EM | SE_AES_NI_CR0_TS))
+	{
+		asm volatile ("mov %0,%%cr0" : : "r" (f->Cr0));
+	}
+}
+
+// ECB 暗号化 (SeAesNiBegin() と SeAesNiEnd() の間で呼び出す)
+void SeAesNiEncrypt(void *dest, void *src, UINT num_blocks, SE_AES_NI_KEY *k)
+{
+	UCHAR *d = (UCHAR *)dest;
+	UCHAR *s = (UCHAR *)src;
+	UCHAR *rk;
+	UINT r;
+
+	while (num_blocks >= SE_AES_NI_PARALLEL)
+	{
+		rk = k->EncryptRoundKey;
+		r = k->Rounds;
+		asm volatile (SE_AES_NI_LOAD4
+			SE_AES_NI_CRYPT4("aesenc", "aesenclast")
+			SE_AES_NI_STORE4
+			: [k] "+r" (rk), [r] "+r" (r)
+			: [s] "r" (s), [d] "r" (d)
+			: "cc", "memory");
+
+		d += SE_AES_BLOCK_SIZE * SE_AES_NI_PARALLEL;
+		s += SE_AES_BLOCK_SIZE * SE_AES_NI_PARALLEL;
+		num_blocks -= SE_AES_NI_PARALLEL;
+	}
+
+	while (num_blocks >= 1)
+	{
+		rk = k->EncryptRoundKey;
+		r = k->Rounds;
+		asm volatile ("movdqu (%[s]),%%xmm0\n"
+			SE_AES_NI_CRYPT1("aesenc", "aesenclast")
+			"movdqu %%xmm0,(%[d])\n"
+			: [k] "+r" (rk), [r] "+r" (r)
+			: [s] "r" (s), [d] "r" (d)
+			: "cc", "memory");
+
+		d += SE_AES_BLOCK_SIZE;
+		s += SE_AES_BLOCK_SIZE;
+		num_blocks--;
+	}
+}
+
+// ECB 解読 (SeAesNiBegin() と SeAesNiEnd() の間で呼び出す)
+void SeAesNiDecrypt(void *dest, void *src, UINT num_blocks, SE_AES_NI_KEY *k)
+{
+	UCHAR *d = (UCHAR *)dest;
+	UCHAR *s = (UCHAR *)src;
+	UCHAR *rk;
+	UINT r;
+
+	while (num_blocks >= SE_AES_NI_PARALLEL)
+	{
+		rk = k->DecryptRoundKey;
+		r = k->Rounds;
+		asm volatile (SE_AES_NI_LOAD4
+			SE_AES_NI_CRYPT4("aesdec", "aesdeclast")
+			SE_AES_NI_STORE4
+			: [k] "+r" (rk), [r] "+r" (r)
+			: [s] "r" (s), [d] "r" (d)
+			: "cc", "memory");
+
+		d += SE_AES_BLOCK_SIZE * SE_AES_NI_PARALLEL;
+		s += SE_AES_BLOCK_SIZE * SE_AES_NI_PARALLEL;
+		num_blocks -= SE_AES_NI_PARALLEL;
+	}
+
+	while (num_blocks >= 1)
+	{
+		rk = k->DecryptRoundKey;
+		r = k->Rounds;
+		asm volatile ("movdqu (%[s]),%%xmm0\n"
+			SE_AES_NI_CRYPT1("aesdec", "aesdeclast")
+			"movdqu %%xmm0,(%[d])\n"
+			: [k] "+r" (rk), [r] "+r" (r)
+			: [s] "r" (s), [d] "r" (d)
+			: "cc", "memory");
+
+		d += SE_AES_BLOCK_SIZE;
+		s += SE_AES_BLOCK_SIZE;
+		num_blocks--;
+	}
+}
+
+// CBC 暗号化 (ivec は最終ブロックで更新される)
+void SeAesNiCbcEncrypt(void *dest, void *src, UINT num_blocks, SE_AES_NI_KEY *k, void *ivec)
+{
+	UCHAR *d = (UCHAR *)dest;
+	UCHAR *s = (UCHAR *)src;
+	UCHAR *v = (UCHAR *)ivec;
+	UCHAR *rk;
+	UINT r;
+
+	if (num_blocks == 0)
+	{
+		return;
+	}
+
+	while (num_blocks >= 1)
+	{
+		rk = k->EncryptRoundKey;
+		r = k->Rounds;
+		asm volatile ("movdqu (%[s]),%%xmm0\n"
+			"movdqu (%[v]),%%xmm1\n"
+			"pxor %%xmm1,%%xmm0\n"
+			SE_AES_NI_CRYPT1("aesenc", "aesenclast")
+			"movdqu %%xmm0,(%[d])\n"
+			: [k] "+r" (rk), [r] "+r" (r)
+			: [s] "r" (s), [d] "r" (d), [v] "r" (v)
+			: "cc", "memory");
+
+		v = d;
+		d += SE_AES_BLOCK_SIZE;
+		s += SE_AES_BLOCK_SIZE;
+		num_blocks--;
+	}
+
+	SeCopy(ivec, v, SE_AES_BLOCK_SIZE);
+}
+
+// GHASH (x = (x ^ data[i]) * H を num_blocks 回繰り返す)
+void SeAesNiGhash(void *x, void *data, UINT num_blocks, SE_AES_NI_KEY *k)
+{
+	UCHAR *p = (UCHAR *)data;
+
+	if (num_blocks == 0)
+	{
+		return;
+	}
+
+	asm volatile ("movdqu (%[x]),%%xmm0\n"
+		"pshufb %[m],%%xmm0\n"
+		"movdqu (%[h]),%%xmm1\n"
+		"1:\n"
+		"movdqu (%[p]),%%xmm2\n"
+		"pshufb %[m],%%xmm2\n"
+		"pxor %%xmm2,%%xmm0\n"
+		SE_AES_NI_GFMUL
+		"add $16,%[p]\n"
+		"dec %[n]\n"
+		"jnz 1b\n"
+		"pshufb %[m],%%xmm0\n"
+		"movdqu %%xmm0,(%[x])\n"
+		: [p] "+r" (p), [n] "+r" (num_blocks)
+		: [x] "r" (x), [h] "r" (k->GhashKey), [m] "m" (SeAesNiByteSwapMask)
+		: "cc", "memory");
+}
+
+#else	// SE_AES_NI_ENABLED
+
+bool SeAesNiIsSupported()
+{
+	return false;
+}
+
+void SeAesNiBegin(SE_AES_NI_FPU *f)
+{
+}
+
+void SeAesNiEnd(SE_AES_NI_FPU *f)
+{
+}
+
+void SeAesNiEncrypt(void *dest, void *src, UINT num_blocks, SE_AES_NI_KEY *k)
+{
+}
+
+void SeAesNiDecrypt(void *dest, void *src, UINT num_blocks, SE_AES_NI_KEY *k)
+{
+}
+
+void SeAesNiCbcEncrypt(void *dest, void *src, UINT num_blocks, SE_AES_NI_KEY *k, void *ivec)
+{
+}
+
+void SeAesNiGhash(void *x, void *data, UINT num_blocks, SE_AES_NI_KEY *k)
+{
+}
+
+#endif	// SE_AES_NI_ENABLED
+
+// AES-NI 用鍵の作成
+// ラウンド鍵はメモリ上のバイト順で渡す。解読ラウンド鍵は AESDEC 用の
+// 逆順かつ InvMixColumns 適用済みのもの (OpenSSL の解読鍵と同じ形式)。
+SE_AES_NI_KEY *SeAesNiNewKey(void *encrypt_round_key, void *decrypt_round_key, UINT rounds,
+							 void *ghash_key)
+{
+	SE_AES_NI_KEY *k;
+	UINT i;
+	// 引数チェック
+	if (encrypt_round_key == NULL || decrypt_round_key == NULL || ghash_key == NULL ||
+		rounds == 0 || rounds > SE_AES_MAX_ROUNDS)
+	{
+		return NULL;
+	}
+
+	k = SeZeroMalloc(sizeof(SE_AES_NI_KEY));
+
+	SeCopy(k->EncryptRoundKey, encrypt_round_key, (rounds + 1) * SE_AES_BLOCK_SIZE);
+	SeCopy(k->DecryptRoundKey, decrypt_round_key, (rounds + 1) * SE_AES_BLOCK_SIZE);
+	k->Rounds = rounds;
+
+	for (i = 0;i < SE_AES_BLOCK_SIZE;i++)
+	{
+		k->GhashKey[i] = ((UCHAR *)ghash_key)[SE_AES_BLOCK_SIZE - 1 - i];
+	}
+
+	return k;
+}
+
+// AES-NI 用鍵の解放
+void SeAesNiFreeKey(SE_AES_NI_KEY *k)
+{
+	// 引数チェック
+	if (k == NULL)
+	{
+		return;
+	}
+
+	SeZero(k, sizeof(SE_AES_NI_KEY));
+
+	SeFree(k);
+}
+
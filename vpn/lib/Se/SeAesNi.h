@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2007, 2008 University of Tsukuba
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the University of Tsukuba nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Secure VM Project
+// VPN Client Module (IPsec Driver) Source Code
+// 
+// Developed by Daiyuu Nobori (dnobori@cs.tsukuba.ac.jp)
+
+// SeAesNi.h
+// 概要: SeAesNi.c のヘッダ
+
+#ifndef	SEAESNI_H
+#define	SEAESNI_H
+
+// 定数
+#define SE_AES_NI_PARALLEL				4			// 並列に処理するブロック数
+
+// AES-NI 用鍵
+struct SE_AES_NI_KEY
+{
+	UCHAR EncryptRoundKey[(SE_AES_MAX_ROUNDS + 1) * SE_AES_BLOCK_SIZE];	// 暗号化ラウンド鍵
+	UCHAR DecryptRoundKey[(SE_AES_MAX_ROUNDS + 1) * SE_AES_BLOCK_SIZE];	// 解読ラウンド鍵 (AESDEC 用)
+	UINT Rounds;							// ラウンド数
+	UCHAR GhashKey[SE_AES_BLOCK_SIZE];		// GHASH 鍵 H (バイト順反転済み)
+};
+
+// XMM レジスタ退避領域
+struct SE_AES_NI_FPU
+{
+	LONG_PTR Cr0;							// 変更前の CR0
+	UCHAR Xmm[8][SE_AES_BLOCK_SIZE];		// XMM0 - XMM7 の退避先
+};
+
+// 関数プロトタイプ
+bool SeAesNiIsSupported();
+SE_AES_NI_KEY *SeAesNiNewKey(void *encrypt_round_key, void *decrypt_round_key, UINT rounds,
+							 void *ghash_key);
+void SeAesNiFreeKey(SE_AES_NI_KEY *k);
+void SeAesNiBegin(SE_AES_NI_FPU *f);
+void SeAesNiEnd(SE_AES_NI_FPU *f);
+void SeAesNiEncrypt(void *dest, void *src, UINT num_blocks, SE_AES_NI_KEY *k);
+void SeAesNiDecrypt(void *dest, void *src, UINT num_blocks, SE_AES_NI_KEY *k);
+void SeAesNiCbcEncrypt(void *dest, void *src, UINT num_blocks, SE_AES_NI_KEY *k, void *ivec);
+void SeAesNiGhash(void *x, void *data, UINT num_blocks, SE_AES_NI_KEY *k);
+
+
+#endif	// SEAESNI_H
+
@@ -53,6 +53,7 @@
 #include <openssl/md5.h>
 #include <openssl/sha.h>
 #include <openssl/des.h>
+#include <openssl/aes.h>
 #include <openssl/dh.h>
 #include <openssl/pem.h>
 #include <Se/Se.h>
@@ -78,27 +79,22 @@ void SeMacSha196(void *dst, void *key, void *data, UINT data_size)
 	SeCopy(dst, tmp, SE_HMAC_SHA1_96_HASH_SIZE);
 }
 
-// HMAC-SHA-1 の計算
-void SeMacSha1(void *dst, void *key, UINT key_size, void *data, UINT data_size)
+// HMAC の ipad / opad 処理後の中間状態の計算
+static void SeHmacInitState(UINT algorithm, void *key, UINT key_size, void *inner, void *outer)
 {
-	UCHAR key_plus[SE_SHA1_BLOCK_SIZE];
-	UCHAR key_plus2[SE_SHA1_BLOCK_SIZE];
-	UCHAR key_plus5[SE_SHA1_BLOCK_SIZE];
-	UCHAR hash4[SE_SHA1_HASH_SIZE];
+	UCHAR key_plus[SE_HMAC_BLOCK_SIZE];
+	UCHAR pad[SE_HMAC_BLOCK_SIZE];
 	UINT i;
-	SE_BUF *buf3;
-	SE_BUF *buf6;
-	// 引数チェック
-	if (dst == NULL || key == NULL || data == NULL)
-	{
-		return;
-	}
 
 	SeZero(key_plus, sizeof(key_plus));
-	if (key_size <= SE_SHA1_BLOCK_SIZE)
+	if (key_size <= SE_HMAC_BLOCK_SIZE)
 	{
 		SeCopy(key_plus, key, key_size);
 	}
+	else if (algorithm == SE_HASH_SHA256)
+	{
+		SeSha256(key_plus, key, key_size);
+	}
 	else
 	{
 		SeSha1(key_plus, key, key_size);
@@ -106,28 +102,199 @@ void SeMacSha1(void *dst, void *key, UINT key_size, void *data, UINT data_size)
 
 	for (i = 0;i < sizeof(key_plus);i++)
 	{
-		key_plus2[i] = key_plus[i] ^ 0x36;
+		pad[i] = key_plus[i] ^ 0x36;
 	}
 
-	buf3 = SeNewBuf();
-	SeWriteBuf(buf3, key_plus2, sizeof(key_plus2));
-	SeWriteBuf(buf3, data, data_size);
-
-	SeSha1(hash4, buf3->Buf, buf3->Size);
+	if (algorithm == SE_HASH_SHA256)
+	{
+		SHA256_Init(inner);
+		SHA256_Update(inner, pad, sizeof(pad));
+	}
+	else
+	{
+		SHA1_Init(inner);
+		SHA1_Update(inner, pad, sizeof(pad));
+	}
 
 	for (i = 0;i < sizeof(key_plus);i++)
 	{
-		key_plus5[i] = key_plus[i] ^ 0x5c;
+		pad[i] = key_plus[i] ^ 0x5c;
+	}
+
+	if (algorithm == SE_HASH_SHA256)
+	{
+		SHA256_Init(outer);
+		SHA256_Update(outer, pad, sizeof(pad));
+	}
+	else
+	{
+		SHA1_Init(outer);
+		SHA1_Update(outer, pad, sizeof(pad));
+	}
+
+	SeZero(key_plus, sizeof(key_plus));
+	SeZero(pad, sizeof(pad));
+}
+
+// HMAC 計算途中の状態
+typedef union SE_HMAC_STATE
+{
+	SHA_CTX Sha1;
+	SHA256_CTX Sha256;
+} SE_HMAC_STATE;
+
+// HMAC 計算途中の状態へのデータの追加
+static void SeHmacUpdateState(UINT algorithm, SE_HMAC_STATE *c, void *data, UINT data_size)
+{
+	if (algorithm == SE_HASH_SHA256)
+	{
+		SHA256_Update(&c->Sha256, data, data_size);
+	}
+	else
+	{
+		SHA1_Update(&c->Sha1, data, data_size);
+	}
+}
+
+// HMAC 計算途中の状態と外側の中間状態からの HMAC の計算
+static void SeHmacFinishState(UINT algorithm, void *dst, SE_HMAC_STATE *c, void *outer)
+{
+	if (algorithm == SE_HASH_SHA256)
+	{
+		UCHAR hash[SE_SHA256_HASH_SIZE];
+
+		SHA256_Final(hash, &c->Sha256);
+
+		SeCopy(&c->Sha256, outer, sizeof(SHA256_CTX));
+		SHA256_Update(&c->Sha256, hash, sizeof(hash));
+		SHA256_Final(dst, &c->Sha256);
+	}
+	else
+	{
+		UCHAR hash[SE_SHA1_HASH_SIZE];
+
+		SHA1_Final(hash, &c->Sha1);
+
+		SeCopy(&c->Sha1, outer, sizeof(SHA_CTX));
+		SHA1_Update(&c->Sha1, hash, sizeof(hash));
+		SHA1_Final(dst, &c->Sha1);
+	}
+}
+
+// 中間状態からの HMAC の計算 (データはコピーせずにそのまま読む)
+static void SeHmacFinal(UINT algorithm, void *dst, void *inner, void *outer, void *data, UINT data_size)
+{
+	SE_HMAC_STATE c;
+
+	SeCopy(&c, inner, (algorithm == SE_HASH_SHA256 ? sizeof(SHA256_CTX) : sizeof(SHA_CTX)));
+	SeHmacUpdateState(algorithm, &c, data, data_size);
+	SeHmacFinishState(algorithm, dst, &c, outer);
+}
+
+// HMAC 鍵の作成
+SE_HMAC_KEY *SeHmacNewKey(UINT algorithm, void *key, UINT key_size)
+{
+	SE_HMAC_KEY *k;
+	UINT state_size;
+	// 引数チェック
+	if (key == NULL)
+	{
+		return NULL;
+	}
+
+	k = SeZeroMalloc(sizeof(SE_HMAC_KEY));
+	k->Algorithm = algorithm;
+
+	if (algorithm == SE_HASH_SHA256)
+	{
+		k->HashSize = SE_SHA256_HASH_SIZE;
+		state_size = sizeof(SHA256_CTX);
+	}
+	else
+	{
+		k->Algorithm = SE_HASH_SHA1;
+		k->HashSize = SE_SHA1_HASH_SIZE;
+		state_size = sizeof(SHA_CTX);
+	}
+
+	k->StateSize = state_size;
+	k->InnerState = SeZeroMalloc(state_size);
+	k->OuterState = SeZeroMalloc(state_size);
+
+	SeHmacInitState(k->Algorithm, key, key_size, k->InnerState, k->OuterState);
+
+	return k;
+}
+
+// HMAC 鍵の解放
+void SeHmacFreeKey(SE_HMAC_KEY *k)
+{
+	// 引数チェック
+	if (k == NULL)
+	{
+		return;
+	}
+
+	SeZero(k->InnerState, k->StateSize);
+	SeZero(k->OuterState, k->StateSize);
+	SeFree(k->InnerState);
+	SeFree(k->OuterState);
+	SeFree(k);
+}
+
+// 作成済みの HMAC 鍵による HMAC の計算
+void SeHmac(void *dst, SE_HMAC_KEY *k, void *data, UINT data_size)
+{
+	// 引数チェック
+	if (dst == NULL || k == NULL || (data == NULL && data_size != 0))
+	{
+		return;
+	}
+
+	SeHmacFinal(k->Algorithm, dst, k->InnerState, k->OuterState, data, data_size);
+}
+
+// HMAC-SHA-1 の計算
+void SeMacSha1(void *dst, void *key, UINT key_size, void *data, UINT data_size)
+{
+	SHA_CTX inner, outer;
+	// 引数チェック
+	if (dst == NULL || key == NULL || data == NULL)
+	{
+		return;
+	}
+
+	SeHmacInitState(SE_HASH_SHA1, key, key_size, &inner, &outer);
+	SeHmacFinal(SE_HASH_SHA1, dst, &inner, &outer, data, data_size);
+}
+
+// HMAC-SHA-256-128 の計算
+void SeMacSha256128(void *dst, void *key, void *data, UINT data_size)
+{
+	UCHAR tmp[SE_SHA256_HASH_SIZE];
+	// 引数チェック
+	if (dst == NULL || key == NULL || data == NULL)
+	{
+		return;
 	}
 
-	buf6 = SeNewBuf();
-	SeWriteBuf(buf6, key_plus5, sizeof(key_plus5));
-	SeWriteBuf(buf6, hash4, sizeof(hash4));
+	SeMacSha256(tmp, key, SE_HMAC_SHA256_128_KEY_SIZE, data, data_size);
 
-	SeSha1(dst, buf6->Buf, buf6->Size);
+	SeCopy(dst, tmp, SE_HMAC_SHA256_128_HASH_SIZE);
+}
 
-	SeFreeBuf(buf3);
-	SeFreeBuf(buf6);
+// HMAC-SHA-256 の計算
+void SeMacSha256(void *dst, void *key, UINT key_size, void *data, UINT data_size)
+{
+	SHA256_CTX inner, outer;
+	// 引数チェック
+	if (dst == NULL || key == NULL || data == NULL)
+	{
+		return;
+	}
+
+	SeHmacInitState(SE_HASH_SHA256, key, key_size, &inner, &outer);
+	SeHmacFinal(SE_HASH_SHA256, dst, &inner, &outer, data, data_size);
 }
 
 // DH 計算
@@ -1573,6 +1740,18 @@ void SeSha1(void *dst, void *src, UINT size)
 	SHA1(src, size, dst);
 }
 
+// SHA-256 ハッシュ
+void SeSha256(void *dst, void *src, UINT size)
+{
+	// 引数チェック
+	if (dst == NULL || src == NULL)
+	{
+		return;
+	}
+
+	SHA256(src, size, dst);
+}
+
 // MD5 ハッシュ
 void SeMd5(void *dst, void *src, UINT size)
 {
@@ -1625,6 +1804,616 @@ void SeDes3Decrypt(void *dest, void *src, UINT size, SE_DES_KEY *key, void *ivec
 		0);
 }
 
+// 3DES-CBC 暗号化と HMAC の計算を一度の走査で行う
+// header と暗号化後のデータを連結したものの HMAC を mac に書き込む。
+// 暗号化したばかりのチャンクがキャッシュに載っている間に HMAC に通す。
+void SeDes3EncryptMac(void *dest, void *src, UINT size, SE_DES_KEY *key, void *ivec,
+					  SE_HMAC_KEY *hmac_key, void *header, UINT header_size, void *mac)
+{
+	UCHAR ivec_copy[SE_DES_IV_SIZE];
+	SE_HMAC_STATE c;
+	UCHAR *d = (UCHAR *)dest;
+	UCHAR *s = (UCHAR *)src;
+	UINT n;
+	// 引数チェック
+	if (dest == NULL || src == NULL || size == 0 || key == NULL || ivec == NULL ||
+		hmac_key == NULL || header == NULL || mac == NULL)
+	{
+		return;
+	}
+
+	SeCopy(ivec_copy, ivec, SE_DES_IV_SIZE);
+	SeCopy(&c, hmac_key->InnerState, hmac_key->StateSize);
+	SeHmacUpdateState(hmac_key->Algorithm, &c, header, header_size);
+
+	while (size != 0)
+	{
+		n = MIN(size, SE_CRYPTO_MAC_CHUNK_SIZE);
+
+		DES_ede3_cbc_encrypt(s, d, n,
+			key->k1->KeySchedule,
+			key->k2->KeySchedule,
+			key->k3->KeySchedule,
+			(DES_cblock *)ivec_copy,
+			1);
+		SeHmacUpdateState(hmac_key->Algorithm, &c, d, n);
+
+		d += n;
+		s += n;
+		size -= n;
+	}
+
+	SeHmacFinishState(hmac_key->Algorithm, mac, &c, hmac_key->OuterState);
+}
+
+// GHASH の 4 ビットシフト時の剰余
+static const UINT64 SeAesGcmRem4Bit[16] =
+{
+	0x0000ULL << 48, 0x1C20ULL << 48, 0x3840ULL << 48, 0x2460ULL << 48,
+	0x7080ULL << 48, 0x6CA0ULL << 48, 0x48C0ULL << 48, 0x54E0ULL << 48,
+	0xE100ULL << 48, 0xFD20ULL << 48, 0xD940ULL << 48, 0xC560ULL << 48,
+	0x9180ULL << 48, 0x8DA0ULL << 48, 0xA9C0ULL << 48, 0xB5E0ULL << 48,
+};
+
+// 128 ビット値の読み込み (ビッグエンディアン)
+static void SeAesGcmLoad(UINT64 *v, UCHAR *p)
+{
+	UINT i;
+
+	v[0] = v[1] = 0;
+	for (i = 0;i < 8;i++)
+	{
+		v[0] = (v[0] << 8) | p[i];
+		v[1] = (v[1] << 8) | p[i + 8];
+	}
+}
+
+// 128 ビット値の書き込み (ビッグエンディアン)
+static void SeAesGcmStore(UCHAR *p, UINT64 *v)
+{
+	UINT i;
+
+	for (i = 0;i < 8;i++)
+	{
+		p[i] = (UCHAR)(v[0] >> (56 - i * 8));
+		p[i + 8] = (UCHAR)(v[1] >> (56 - i * 8));
+	}
+}
+
+// GHASH 乗算テーブルの作成
+static void SeAesGcmInitTable(SE_AES_KEY *k, UCHAR *h)
+{
+	UINT64 v[2];
+	UINT64 r;
+	UINT i, j;
+
+	SeAesGcmLoad(v, h);
+
+	k->GcmTable[0][0] = k->GcmTable[0][1] = 0;
+	k->GcmTable[8][0] = v[0];
+	k->GcmTable[8][1] = v[1];
+
+	for (i = 4;i >= 1;i >>= 1)
+	{
+		// x を乗ずる
+		r = (v[1] & 1) ? 0xE100000000000000ULL : 0;
+		v[1] = (v[1] >> 1) | (v[0] << 63);
+		v[0] = (v[0] >> 1) ^ r;
+
+		k->GcmTable[i][0] = v[0];
+		k->GcmTable[i][1] = v[1];
+	}
+
+	for (i = 2;i < 16;i <<= 1)
+	{
+		for (j = 1;j < i;j++)
+		{
+			k->GcmTable[i + j][0] = k->GcmTable[i][0] ^ k->GcmTable[j][0];
+			k->GcmTable[i + j][1] = k->GcmTable[i][1] ^ k->GcmTable[j][1];
+		}
+	}
+}
+
+// GHASH 乗算 (x = x * H)
+static void SeAesGcmMult(SE_AES_KEY *k, UCHAR *x)
+{
+	UINT64 z[2];
+	UINT rem;
+	UCHAR nlo, nhi;
+	INT i;
+
+	nlo = x[15];
+	nhi = nlo >> 4;
+	nlo &= 0x0f;
+
+	z[0] = k->GcmTable[nlo][0];
+	z[1] = k->GcmTable[nlo][1];
+
+	i = 15;
+	while (true)
+	{
+		rem = (UINT)(z[1] & 0x0f);
+		z[1] = (z[0] << 60) | (z[1] >> 4);
+		z[0] = (z[0] >> 4) ^ SeAesGcmRem4Bit[rem];
+		z[0] ^= k->GcmTable[nhi][0];
+		z[1] ^= k->GcmTable[nhi][1];
+
+		if (--i < 0)
+		{
+			break;
+		}
+
+		nlo = x[i];
+		nhi = nlo >> 4;
+		nlo &= 0x0f;
+
+		rem = (UINT)(z[1] & 0x0f);
+		z[1] = (z[0] << 60) | (z[1] >> 4);
+		z[0] = (z[0] >> 4) ^ SeAesGcmRem4Bit[rem];
+		z[0] ^= k->GcmTable[nlo][0];
+		z[1] ^= k->GcmTable[nlo][1];
+	}
+
+	SeAesGcmStore(x, z);
+}
+
+// GHASH の更新 (最後の端数ブロックは 0 で埋める)
+static void SeAesGcmGhash(SE_AES_KEY *k, UCHAR *x, UCHAR *data, UINT size)
+{
+	UCHAR tmp[SE_AES_BLOCK_SIZE];
+	UINT num_blocks = size / SE_AES_BLOCK_SIZE;
+	UINT i, j;
+
+	if (k->AesNi != NULL)
+	{
+		SeAesNiGhash(x, data, num_blocks, k->AesNi);
+	}
+	else
+	{
+		for (i = 0;i < num_blocks;i++)
+		{
+			for (j = 0;j < SE_AES_BLOCK_SIZE;j++)
+			{
+				x[j] ^= data[i * SE_AES_BLOCK_SIZE + j];
+			}
+			SeAesGcmMult(k, x);
+		}
+	}
+
+	size -= num_blocks * SE_AES_BLOCK_SIZE;
+	if (size != 0)
+	{
+		SeZero(tmp, sizeof(tmp));
+		SeCopy(tmp, data + num_blocks * SE_AES_BLOCK_SIZE, size);
+
+		if (k->AesNi != NULL)
+		{
+			SeAesNiGhash(x, tmp, 1, k->AesNi);
+		}
+		else
+		{
+			for (j = 0;j < SE_AES_BLOCK_SIZE;j++)
+			{
+				x[j] ^= tmp[j];
+			}
+			SeAesGcmMult(k, x);
+		}
+	}
+}
+
+// 複数ブロックの ECB 暗号化 (AES-NI 使用時は SeAesNiBegin() 済みであること)
+static void SeAesEncryptBlocks(SE_AES_KEY *k, UCHAR *dest, UCHAR *src, UINT num_blocks)
+{
+	UINT i;
+
+	if (k->AesNi != NULL)
+	{
+		SeAesNiEncrypt(dest, src, num_blocks, k->AesNi);
+		return;
+	}
+
+	for (i = 0;i < num_blocks;i++)
+	{
+		AES_encrypt(src + i * SE_AES_BLOCK_SIZE, dest + i * SE_AES_BLOCK_SIZE, k->EncryptKey);
+	}
+}
+
+// カウンタブロックの下位 32 ビットを増加させる
+static void SeAesGcmInc32(UCHAR *counter)
+{
+	UINT i;
+
+	for (i = SE_AES_BLOCK_SIZE;i > SE_AES_BLOCK_SIZE - sizeof(UINT);i--)
+	{
+		if (++counter[i - 1] != 0)
+		{
+			break;
+		}
+	}
+}
+
+// CTR モードによる暗号化 / 解読
+static void SeAesGcmCtr(SE_AES_KEY *k, UCHAR *dest, UCHAR *src, UINT size, UCHAR *counter)
+{
+	UCHAR stream[SE_AES_BLOCK_SIZE * SE_AES_NI_PARALLEL];
+	UINT num_blocks;
+	UINT n;
+	UINT i;
+
+	while (size != 0)
+	{
+		n = MIN(size, sizeof(stream));
+		num_blocks = (n + SE_AES_BLOCK_SIZE - 1) / SE_AES_BLOCK_SIZE;
+
+		for (i = 0;i < num_blocks;i++)
+		{
+			SeCopy(stream + i * SE_AES_BLOCK_SIZE, counter, SE_AES_BLOCK_SIZE);
+			SeAesGcmInc32(counter);
+		}
+
+		SeAesEncryptBlocks(k, stream, stream, num_blocks);
+
+		for (i = 0;i < n;i++)
+		{
+			dest[i] = src[i] ^ stream[i];
+		}
+
+		dest += n;
+		src += n;
+		size -= n;
+	}
+}
+
+// GCM 認証タグの計算
+static void SeAesGcmTag(SE_AES_KEY *k, UCHAR *tag, UCHAR *j0, void *aad, UINT aad_size,
+						UCHAR *ciphertext, UINT size)
+{
+	UCHAR x[SE_AES_BLOCK_SIZE];
+	UCHAR len[SE_AES_BLOCK_SIZE];
+	UCHAR ek[SE_AES_BLOCK_SIZE];
+	UINT64 bits[2];
+	UINT i;
+
+	SeZero(x, sizeof(x));
+	SeAesGcmGhash(k, x, aad, aad_size);
+	SeAesGcmGhash(k, x, ciphertext, size);
+
+	bits[0] = (UINT64)aad_size * 8;
+	bits[1] = (UINT64)size * 8;
+	SeAesGcmStore(len, bits);
+	SeAesGcmGhash(k, x, len, sizeof(len));
+
+	SeAesEncryptBlocks(k, ek, j0, 1);
+
+	for (i = 0;i < SE_AES_BLOCK_SIZE;i++)
+	{
+		tag[i] = x[i] ^ ek[i];
+	}
+}
+
+// AES-GCM 暗号化 (nonce は 12 バイト, tag は 16 バイト)
+void SeAesGcmEncrypt(void *dest, void *src, UINT size, SE_AES_KEY *key, void *nonce,
+					 void *aad, UINT aad_size, void *tag)
+{
+	UCHAR j0[SE_AES_BLOCK_SIZE];
+	UCHAR counter[SE_AES_BLOCK_SIZE];
+	SE_AES_NI_FPU fpu;
+	// 引数チェック
+	if (dest == NULL || src == NULL || key == NULL || nonce == NULL || tag == NULL ||
+		(aad == NULL && aad_size != 0))
+	{
+		return;
+	}
+
+	SeZero(j0, sizeof(j0));
+	SeCopy(j0, nonce, SE_AES_GCM_NONCE_SIZE);
+	j0[SE_AES_BLOCK_SIZE - 1] = 1;
+	SeCopy(counter, j0, sizeof(counter));
+	SeAesGcmInc32(counter);
+
+	if (key->AesNi != NULL)
+	{
+		SeAesNiBegin(&fpu);
+	}
+
+	SeAesGcmCtr(key, dest, src, size, counter);
+	SeAesGcmTag(key, tag, j0, aad, aad_size, dest, size);
+
+	if (key->AesNi != NULL)
+	{
+		SeAesNiEnd(&fpu);
+	}
+}
+
+// AES-GCM 解読 (認証タグが一致しない場合は解読せずに false を返す)
+bool SeAesGcmDecrypt(void *dest, void *src, UINT size, SE_AES_KEY *key, void *nonce,
+					 void *aad, UINT aad_size, void *tag)
+{
+	UCHAR j0[SE_AES_BLOCK_SIZE];
+	UCHAR counter[SE_AES_BLOCK_SIZE];
+	UCHAR tag2[SE_AES_GCM_ICV_SIZE];
+	UCHAR diff;
+	SE_AES_NI_FPU fpu;
+	UINT i;
+	// 引数チェック
+	if (dest == NULL || src == NULL || key == NULL || nonce == NULL || tag == NULL ||
+		(aad == NULL && aad_size != 0))
+	{
+		return false;
+	}
+
+	SeZero(j0, sizeof(j0));
+	SeCopy(j0, nonce, SE_AES_GCM_NONCE_SIZE);
+	j0[SE_AES_BLOCK_SIZE - 1] = 1;
+	SeCopy(counter, j0, sizeof(counter));
+	SeAesGcmInc32(counter);
+
+	if (key->AesNi != NULL)
+	{
+		SeAesNiBegin(&fpu);
+	}
+
+	SeAesGcmTag(key, tag2, j0, aad, aad_size, src, size);
+
+	// タグの比較 (比較時間が一致位置に依存しないようにする)
+	diff = 0;
+	for (i = 0;i < SE_AES_GCM_ICV_SIZE;i++)
+	{
+		diff |= tag2[i] ^ ((UCHAR *)tag)[i];
+	}
+
+	if (diff == 0)
+	{
+		SeAesGcmCtr(key, dest, src, size, counter);
+	}
+
+	if (key->AesNi != NULL)
+	{
+		SeAesNiEnd(&fpu);
+	}
+
+	return (diff == 0);
+}
+
+// AES 1 ブロックの暗号化
+void SeAesEncryptBlock(void *dest, void *src, SE_AES_KEY *key)
+{
+	SE_AES_NI_FPU fpu;
+	// 引数チェック
+	if (dest == NULL || src == NULL || key == NULL)
+	{
+		return;
+	}
+
+	if (key->AesNi != NULL)
+	{
+		SeAesNiBegin(&fpu);
+		SeAesNiEncrypt(dest, src, 1, key->AesNi);
+		SeAesNiEnd(&fpu);
+	}
+	else
+	{
+		AES_encrypt(src, dest, key->EncryptKey);
+	}
+}
+
+// AES-CBC 暗号化
+void SeAesCbcEncrypt(void *dest, void *src, UINT size, SE_AES_KEY *key, void *ivec)
+{
+	UCHAR ivec_copy[SE_AES_IV_SIZE];
+	SE_AES_NI_FPU fpu;
+	// 引数チェック
+	if (dest == NULL || src == NULL || size == 0 || key == NULL || ivec == NULL)
+	{
+		return;
+	}
+
+	SeCopy(ivec_copy, ivec, SE_AES_IV_SIZE);
+
+	if (key->AesNi != NULL)
+	{
+		SeAesNiBegin(&fpu);
+		SeAesNiCbcEncrypt(dest, src, size / SE_AES_BLOCK_SIZE, key->AesNi, ivec_copy);
+		SeAesNiEnd(&fpu);
+	}
+	else
+	{
+		AES_cbc_encrypt(src, dest, size, key->EncryptKey, ivec_copy, AES_ENCRYPT);
+	}
+}
+
+// AES-CBC 暗号化と HMAC の計算を一度の走査で行う
+// header と暗号化後のデータを連結したものの HMAC を mac に書き込む。
+// AES-NI の状態の退避は全チャンクを通して一度だけ行う。
+void SeAesCbcEncryptMac(void *dest, void *src, UINT size, SE_AES_KEY *key, void *ivec,
+						SE_HMAC_KEY *hmac_key, void *header, UINT header_size, void *mac)
+{
+	UCHAR ivec_copy[SE_AES_IV_SIZE];
+	SE_HMAC_STATE c;
+	UCHAR *d = (UCHAR *)dest;
+	UCHAR *s = (UCHAR *)src;
+	UINT n;
+	SE_AES_NI_FPU fpu;
+	// 引数チェック
+	if (dest == NULL || src == NULL || size == 0 || key == NULL || ivec == NULL ||
+		hmac_key == NULL || header == NULL || mac == NULL)
+	{
+		return;
+	}
+
+	SeCopy(ivec_copy, ivec, SE_AES_IV_SIZE);
+	SeCopy(&c, hmac_key->InnerState, hmac_key->StateSize);
+	SeHmacUpdateState(hmac_key->Algorithm, &c, header, header_size);
+
+	if (key->AesNi != NULL)
+	{
+		SeAesNiBegin(&fpu);
+	}
+
+	while (size != 0)
+	{
+		n = MIN(size, SE_CRYPTO_MAC_CHUNK_SIZE);
+
+		if (key->AesNi != NULL)
+		{
+			SeAesNiCbcEncrypt(d, s, n / SE_AES_BLOCK_SIZE, key->AesNi, ivec_copy);
+		}
+		else
+		{
+			AES_cbc_encrypt(s, d, n, key->EncryptKey, ivec_copy, AES_ENCRYPT);
+		}
+		SeHmacUpdateState(hmac_key->Algorithm, &c, d, n);
+
+		d += n;
+		s += n;
+		size -= n;
+	}
+
+	if (key->AesNi != NULL)
+	{
+		SeAesNiEnd(&fpu);
+	}
+
+	SeHmacFinishState(hmac_key->Algorithm, mac, &c, hmac_key->OuterState);
+}
+
+// AES-CBC 解読
+void SeAesCbcDecrypt(void *dest, void *src, UINT size, SE_AES_KEY *key, void *ivec)
+{
+	UCHAR ivec_copy[SE_AES_IV_SIZE];
+	UCHAR tmp[SE_AES_BLOCK_SIZE * SE_AES_NI_PARALLEL];
+	UCHAR *d = (UCHAR *)dest;
+	UCHAR *s = (UCHAR *)src;
+	UINT num_blocks;
+	UINT n;
+	UINT i;
+	SE_AES_NI_FPU fpu;
+	// 引数チェック
+	if (dest == NULL || src == NULL || size == 0 || key == NULL || ivec == NULL)
+	{
+		return;
+	}
+
+	SeCopy(ivec_copy, ivec, SE_AES_IV_SIZE);
+
+	if (key->AesNi == NULL)
+	{
+		AES_cbc_encrypt(src, dest, size, key->DecryptKey, ivec_copy, AES_DECRYPT);
+		return;
+	}
+
+	// AES-NI では複数ブロックを並列に解読してから前の暗号文ブロックと XOR する
+	SeAesNiBegin(&fpu);
+
+	num_blocks = size / SE_AES_BLOCK_SIZE;
+	while (num_blocks != 0)
+	{
+		n = MIN(num_blocks, SE_AES_NI_PARALLEL);
+
+		SeCopy(tmp, s, n * SE_AES_BLOCK_SIZE);
+		SeAesNiDecrypt(d, tmp, n, key->AesNi);
+
+		for (i = 0;i < SE_AES_BLOCK_SIZE;i++)
+		{
+			d[i] ^= ivec_copy[i];
+		}
+		for (i = SE_AES_BLOCK_SIZE;i < n * SE_AES_BLOCK_SIZE;i++)
+		{
+			d[i] ^= tmp[i - SE_AES_BLOCK_SIZE];
+		}
+
+		SeCopy(ivec_copy, tmp + (n - 1) * SE_AES_BLOCK_SIZE, SE_AES_IV_SIZE);
+
+		d += n * SE_AES_BLOCK_SIZE;
+		s += n * SE_AES_BLOCK_SIZE;
+		num_blocks -= n;
+	}
+
+	SeAesNiEnd(&fpu);
+}
+
+// OpenSSL の鍵スケジュールをメモリ上のバイト順のラウンド鍵に変換
+static void SeAesRoundKeyToBytes(UCHAR *dest, AES_KEY *k)
+{
+	UINT i;
+	UINT w;
+
+	for (i = 0;i < (UINT)(k->rounds + 1) * 4;i++)
+	{
+		w = (UINT)k->rd_key[i];
+
+		dest[i * 4 + 0] = (UCHAR)(w >> 24);
+		dest[i * 4 + 1] = (UCHAR)(w >> 16);
+		dest[i * 4 + 2] = (UCHAR)(w >> 8);
+		dest[i * 4 + 3] = (UCHAR)w;
+	}
+}
+
+// AES 鍵の作成
+SE_AES_KEY *SeAesNewKey(void *key, UINT key_size)
+{
+	SE_AES_KEY *k;
+	UCHAR h[SE_AES_BLOCK_SIZE];
+	// 引数チェック
+	if (key == NULL || (key_size != SE_AES_128_KEY_SIZE && key_size != SE_AES_256_KEY_SIZE))
+	{
+		return NULL;
+	}
+
+	k = SeZeroMalloc(sizeof(SE_AES_KEY));
+	k->KeySize = key_size;
+
+	k->EncryptKey = SeZeroMalloc(sizeof(AES_KEY));
+	AES_set_encrypt_key(key, key_size * 8, k->EncryptKey);
+
+	k->DecryptKey = SeZeroMalloc(sizeof(AES_KEY));
+	AES_set_decrypt_key(key, key_size * 8, k->DecryptKey);
+
+	// GHASH 鍵 H = E(K, 0^128)
+	SeZero(h, sizeof(h));
+	AES_encrypt(h, h, k->EncryptKey);
+	SeAesGcmInitTable(k, h);
+
+	if (SeAesNiIsSupported())
+	{
+		UCHAR encrypt_round_key[(SE_AES_MAX_ROUNDS + 1) * SE_AES_BLOCK_SIZE];
+		UCHAR decrypt_round_key[(SE_AES_MAX_ROUNDS + 1) * SE_AES_BLOCK_SIZE];
+
+		SeAesRoundKeyToBytes(encrypt_round_key, k->EncryptKey);
+		SeAesRoundKeyToBytes(decrypt_round_key, k->DecryptKey);
+
+		k->AesNi = SeAesNiNewKey(encrypt_round_key, decrypt_round_key,
+			k->EncryptKey->rounds, h);
+
+		SeZero(encrypt_round_key, sizeof(encrypt_round_key));
+		SeZero(decrypt_round_key, sizeof(decrypt_round_key));
+	}
+
+	SeZero(h, sizeof(h));
+
+	return k;
+}
+
+// AES 鍵の解放
+void SeAesFreeKey(SE_AES_KEY *k)
+{
+	// 引数チェック
+	if (k == NULL)
+	{
+		return;
+	}
+
+	SeAesNiFreeKey(k->AesNi);
+
+	SeZero(k->EncryptKey, sizeof(AES_KEY));
+	SeFree(k->EncryptKey);
+	SeZero(k->DecryptKey, sizeof(AES_KEY));
+	SeFree(k->DecryptKey);
+
+	SeZero(k, sizeof(SE_AES_KEY));
+	SeFree(k);
+}
+
 // ランダムな 3DES 鍵の生成
 SE_DES_KEY *SeDes3RandKey()
 {
@@ -55,6 +55,24 @@
 #define SE_HMAC_SHA1_96_KEY_SIZE		20			// HMAC-SHA-1-96 鍵サイズ
 #define SE_HMAC_SHA1_96_HASH_SIZE		12			// HMAC-SHA-1-96 ハッシュサイズ
 #define SE_HMAC_SHA1_SIZE				(SE_SHA1_HASH_SIZE)	// HMAC-SHA-1 ハッシュサイズ
+#define SE_SHA256_HASH_SIZE				32			// SHA-256 ハッシュサイズ
+#define SE_SHA256_BLOCK_SIZE			64			// SHA-256 ブロックサイズ
+#define SE_HMAC_SHA256_128_KEY_SIZE		32			// HMAC-SHA-256-128 鍵サイズ
+#define SE_HMAC_SHA256_128_HASH_SIZE	16			// HMAC-SHA-256-128 ハッシュサイズ
+#define SE_HMAC_BLOCK_SIZE				64			// HMAC ブロックサイズ (SHA-1 / SHA-256 共通)
+#define SE_HMAC_MAX_HASH_SIZE			(SE_SHA256_HASH_SIZE)	// HMAC 最大ハッシュサイズ
+#define SE_HASH_SHA1					1			// SHA-1
+#define SE_HASH_SHA256					2			// SHA-256
+#define SE_CRYPTO_MAC_CHUNK_SIZE		512			// 暗号化と HMAC を交互に行う単位 (ブロックサイズの倍数)
+#define SE_AES_BLOCK_SIZE				16			// AES ブロックサイズ
+#define SE_AES_IV_SIZE					16			// AES-CBC IV サイズ
+#define SE_AES_128_KEY_SIZE				16			// AES-128 鍵サイズ
+#define SE_AES_256_KEY_SIZE				32			// AES-256 鍵サイズ
+#define SE_AES_MAX_ROUNDS				14			// AES 最大ラウンド数
+#define SE_AES_GCM_SALT_SIZE			4			// AES-GCM ソルトサイズ (RFC 4106)
+#define SE_AES_GCM_IV_SIZE				8			// AES-GCM IV サイズ (RFC 4106)
+#define SE_AES_GCM_NONCE_SIZE			(SE_AES_GCM_SALT_SIZE + SE_AES_GCM_IV_SIZE)	// AES-GCM ノンスサイズ
+#define SE_AES_GCM_ICV_SIZE				16			// AES-GCM ICV サイズ
 
 #define SE_DH_GROUP2_PRIME_1024 \
 	"FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD1" \
@@ -95,6 +113,26 @@ struct SE_DES_KEY
 	SE_DES_KEY_VALUE *k1, *k2, *k3;
 };
 
+// AES 鍵
+struct SE_AES_KEY
+{
+	AES_KEY *EncryptKey;					// 暗号化用鍵スケジュール
+	AES_KEY *DecryptKey;					// 解読用鍵スケジュール
+	UINT KeySize;							// 鍵サイズ
+	UINT64 GcmTable[16][2];					// GHASH 乗算テーブル (H の 4 ビット倍数)
+	SE_AES_NI_KEY *AesNi;					// AES-NI 用鍵 (AES-NI が使用できない場合は NULL)
+};
+
+// HMAC 鍵 (ipad / opad 処理後の中間状態)
+struct SE_HMAC_KEY
+{
+	UINT Algorithm;							// ハッシュアルゴリズム (SE_HASH_*)
+	UINT HashSize;							// ハッシュサイズ
+	UINT StateSize;							// 中間状態のサイズ
+	void *InnerState;						// 内側の中間状態 (SHA_CTX または SHA256_CTX)
+	void *OuterState;						// 外側の中間状態 (SHA_CTX または SHA256_CTX)
+};
+
 // DH
 struct SE_DH
 {
@@ -125,11 +163,30 @@ SE_DES_KEY *SeDes3RandKey();
 SE_DES_KEY *SeDesRandKey();
 void SeDes3Encrypt(void *dest, void *src, UINT size, SE_DES_KEY *key, void *ivec);
 void SeDes3Decrypt(void *dest, void *src, UINT size, SE_DES_KEY *key, void *ivec);
+void SeDes3EncryptMac(void *dest, void *src, UINT size, SE_DES_KEY *key, void *ivec,
+					  SE_HMAC_KEY *hmac_key, void *header, UINT header_size, void *mac);
+SE_AES_KEY *SeAesNewKey(void *key, UINT key_size);
+void SeAesFreeKey(SE_AES_KEY *k);
+void SeAesEncryptBlock(void *dest, void *src, SE_AES_KEY *key);
+void SeAesCbcEncrypt(void *dest, void *src, UINT size, SE_AES_KEY *key, void *ivec);
+void SeAesCbcDecrypt(void *dest, void *src, UINT size, SE_AES_KEY *key, void *ivec);
+void SeAesCbcEncryptMac(void *dest, void *src, UINT size, SE_AES_KEY *key, void *ivec,
+						SE_HMAC_KEY *hmac_key, void *header, UINT header_size, void *mac);
+void SeAesGcmEncrypt(void *dest, void *src, UINT size, SE_AES_KEY *key, void *nonce,
+					 void *aad, UINT aad_size, void *tag);
+bool SeAesGcmDecrypt(void *dest, void *src, UINT size, SE_AES_KEY *key, void *nonce,
+					 void *aad, UINT aad_size, void *tag);
 
 void SeSha1(void *dst, void *src, UINT size);
 void SeMd5(void *dst, void *src, UINT size);
 void SeMacSha1(void *dst, void *key, UINT key_size, void *data, UINT data_size);
 void SeMacSha196(void *dst, void *key, void *data, UINT data_size);
+void SeSha256(void *dst, void *src, UINT size);
+void SeMacSha256(void *dst, void *key, UINT key_size, void *data, UINT data_size);
+void SeMacSha256128(void *dst, void *key, void *data, UINT data_size);
+SE_HMAC_KEY *SeHmacNewKey(UINT algorithm, void *key, UINT key_size);
+void SeHmacFreeKey(SE_HMAC_KEY *k);
+void SeHmac(void *dst, SE_HMAC_KEY *k, void *data, UINT data_size);
 
 BIO *SeBufToBio(SE_BUF *b);
 SE_BUF *SeBioToBuf(BIO *bio);
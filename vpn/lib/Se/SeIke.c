@@ -81,7 +81,8 @@ UINT SeIkePhase1CryptIdToKeySize(UCHAR id)
 }
 
 // フェーズ 2 暗号化アルゴリズム名を鍵サイズに変換
-UINT SeIkePhase2CryptIdToKeySize(UCHAR id)
+// (AES-GCM の場合は KEYMAT の末尾から取り出すソルトを含む)
+UINT SeIkePhase2CryptIdToKeySize(UCHAR id, UINT key_bits)
 {
 	switch (id)
 	{
@@ -90,6 +91,27 @@ UINT SeIkePhase2CryptIdToKeySize(UCHAR id)
 
 	case SE_IKE_TRANSFORM_ID_P2_ESP_DES:
 		return SE_DES_KEY_SIZE;
+
+	case SE_IKE_TRANSFORM_ID_P2_ESP_AES:
+		return key_bits / 8;
+
+	case SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16:
+		return key_bits / 8 + SE_AES_GCM_SALT_SIZE;
+	}
+
+	return 0;
+}
+
+// フェーズ 2 HMAC アルゴリズム名を鍵サイズに変換
+UINT SeIkePhase2HashIdToKeySize(UCHAR id)
+{
+	switch (id)
+	{
+	case SE_IKE_P2_HMAC_SHA1:
+		return SE_HMAC_SHA1_96_KEY_SIZE;
+
+	case SE_IKE_P2_HMAC_SHA2_256:
+		return SE_HMAC_SHA256_128_KEY_SIZE;
 	}
 
 	return 0;
@@ -130,6 +152,14 @@ UCHAR SeIkeStrToPhase2CryptId(char *name)
 	{
 		return SE_IKE_TRANSFORM_ID_P2_ESP_DES;
 	}
+	else if (SeStartWith(name, "AES-GCM"))
+	{
+		return SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16;
+	}
+	else if (SeStartWith(name, "AES") || SeStartWith("AES", name))
+	{
+		return SE_IKE_TRANSFORM_ID_P2_ESP_AES;
+	}
 	else
 	{
 		return 0;
@@ -141,6 +171,25 @@ UCHAR SeIkeStrToPhase2HashId(char *name)
 	{
 		return SE_IKE_P2_HMAC_SHA1;
 	}
+	else if (SeStartWith(name, "SHA-256") || SeStartWith("SHA-256", name))
+	{
+		return SE_IKE_P2_HMAC_SHA2_256;
+	}
+
+	return 0;
+}
+UINT SeIkeStrToPhase2KeySize(char *name)
+{
+	// "AES-128", "AES-GCM-256" のように末尾に鍵長 (ビット) を指定する
+	// 実装されていない鍵長の場合は 0 を返す
+	if (SeEndWith(name, "-128"))
+	{
+		return 128;
+	}
+	else if (SeEndWith(name, "-256"))
+	{
+		return 256;
+	}
 
 	return 0;
 }
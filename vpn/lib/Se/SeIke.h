@@ -136,6 +136,8 @@ struct SE_IKE_TRANSFORM_HEADER
 // IKE トランスフォームペイロードヘッダにおけるトランスフォーム ID (フェーズ 2)
 #define SE_IKE_TRANSFORM_ID_P2_ESP_DES			2	// DES-CBC
 #define SE_IKE_TRANSFORM_ID_P2_ESP_3DES			3	// 3DES-CBC
+#define SE_IKE_TRANSFORM_ID_P2_ESP_AES			12	// AES-CBC
+#define SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16	20	// AES-GCM (16 バイト ICV)
 
 // IKE トランスフォーム値 (固定長)
 struct SE_IKE_TRANSFORM_VALUE
@@ -182,6 +184,7 @@ struct SE_IKE_TRANSFORM_VALUE
 
 // フェーズ 2: IKE トランスフォーム値における HMAC アルゴリズム
 #define SE_IKE_P2_HMAC_SHA1						2
+#define SE_IKE_P2_HMAC_SHA2_256					5
 
 // フェーズ 2: IKE トランスフォーム値における DH グループ番号
 #define SE_IKE_P2_DH_GROUP_1024_MODP			2
@@ -477,9 +480,11 @@ UCHAR SeIkeStrToPhase1CryptId(char *name);
 UCHAR SeIkeStrToPhase1HashId(char *name);
 UCHAR SeIkeStrToPhase2CryptId(char *name);
 UCHAR SeIkeStrToPhase2HashId(char *name);
+UINT SeIkeStrToPhase2KeySize(char *name);
 SE_BUF *SeIkeStrToPassword(char *str);
 UINT SeIkePhase1CryptIdToKeySize(UCHAR id);
-UINT SeIkePhase2CryptIdToKeySize(UCHAR id);
+UINT SeIkePhase2CryptIdToKeySize(UCHAR id, UINT key_bits);
+UINT SeIkePhase2HashIdToKeySize(UCHAR id);
 
 
 #endif	// SEIKE_H
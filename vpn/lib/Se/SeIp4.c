@@ -348,6 +348,56 @@ void Se4SendIpFragmentNow(SE_IPV4 *p, UCHAR *dest_mac, void *data, UINT size)
 	Se4SendEthPacket(p, dest_mac, SE_MAC_PROTO_IPV4, data, size);
 }
 
+// 宛先 MAC アドレスの解決
+// ARP テーブルに無い場合は NULL を返し, dest_ip_local に ARP で解決すべき
+// IP アドレスを格納する。経路が無い場合は no_route を true にする。
+UCHAR *Se4ResolveDestMacAddress(SE_IPV4 *p, SE_IPV4_ADDR dest_ip, SE_IPV4_ADDR *dest_ip_local, bool *no_route)
+{
+	SE_ARPV4_ENTRY *e;
+	// 引数チェック
+	if (p == NULL || dest_ip_local == NULL || no_route == NULL)
+	{
+		return NULL;
+	}
+
+	*dest_ip_local = dest_ip;
+	*no_route = false;
+
+	if (Se4IsBroadcastAddress(dest_ip) ||
+		Se4Cmp(Se4GetBroadcastAddress(p->IpAddress, p->SubnetMask), dest_ip) == 0)
+	{
+		// 宛先 IP アドレスはブロードキャストアドレス
+		return Se4BroadcastMacAddress();
+	}
+
+	if (Se4IsInSameNetwork(p->IpAddress, dest_ip, p->SubnetMask) == false)
+	{
+		if (p->UseDefaultGateway)
+		{
+			// ルーティングが必要である。ルータの IP アドレスを解決する
+			*dest_ip_local = p->DefaultGateway;
+		}
+		else
+		{
+			// ルーティングが必要であるがデフォルトゲートウェイが存在しない
+			*no_route = true;
+			return NULL;
+		}
+	}
+
+	// ARP テーブルを検索
+	e = Se4SearchArpEntryList(p->ArpEntryList, *dest_ip_local, Se4Tick(p),
+		p->Vpn->Config->OptionV4ArpExpires,
+		p->Vpn->Config->OptionV4ArpDontUpdateExpires);
+
+	if (e == NULL)
+	{
+		return NULL;
+	}
+
+	return e->MacAddress;
+}
+
 // Raw IP パケットの送信
 void Se4SendRawIp(SE_IPV4 *p, void *data, UINT size, UCHAR *dest_mac)
 {
@@ -376,41 +426,16 @@ void Se4SendRawIp(SE_IPV4 *p, void *data, UINT size, UCHAR *dest_mac)
 	// MAC アドレスの解決
 	if (dest_mac == NULL)
 	{
-		if (Se4IsBroadcastAddress(dest_ip) ||
-			Se4Cmp(Se4GetBroadcastAddress(p->IpAddress, p->SubnetMask), dest_ip) == 0)
-		{
-			// 宛先 IP アドレスはブロードキャストアドレス
-			dest_mac = Se4BroadcastMacAddress();
-		}
-		else
-		{
-			SE_ARPV4_ENTRY *e;
-
-			if (Se4IsInSameNetwork(p->IpAddress, dest_ip, p->SubnetMask) == false)
-			{
-				if (p->UseDefaultGateway)
-				{
-					// ルーティングが必要である。ルータの IP アドレスを解決する
-					dest_ip_local = p->DefaultGateway;
-				}
-				else
-				{
-					// ルーティングが必要であるがデフォルトゲートウェイが存在しない
-					// のでパケットを破棄する
-					SeFree(buf);
-					return;
-				}
-			}
+		bool no_route;
 
-			// ARP テーブルを検索
-			e = Se4SearchArpEntryList(p->ArpEntryList, dest_ip_local, Se4Tick(p),
-				p->Vpn->Config->OptionV4ArpExpires,
-				p->Vpn->Config->OptionV4ArpDontUpdateExpires);
+		dest_mac = Se4ResolveDestMacAddress(p, dest_ip, &dest_ip_local, &no_route);
 
-			if (e != NULL)
-			{
-				dest_mac = e->MacAddress;
-			}
+		if (no_route)
+		{
+			// ルーティングが必要であるがデフォルトゲートウェイが存在しない
+			// のでパケットを破棄する
+			SeFree(buf);
+			return;
 		}
 	}
 
@@ -450,6 +475,28 @@ void Se4SendIpFragment(SE_IPV4 *p, SE_IPV4_ADDR dest_ip, SE_IPV4_ADDR src_ip,
 	ip = (SE_IPV4_HEADER *)buf;
 
 	// IP ヘッダの構築
+	Se4BuildIpHeader(ip, dest_ip, src_ip, id, total_size, offset, protocol, ttl, size);
+
+	// データコピー
+	SeCopy(buf + sizeof(SE_IPV4_HEADER), data, size);
+
+	// Raw IP 送信
+	Se4SendRawIp(p, buf, size + sizeof(SE_IPV4_HEADER), dest_mac);
+}
+
+// IP ヘッダの構築
+void Se4BuildIpHeader(SE_IPV4_HEADER *ip, SE_IPV4_ADDR dest_ip, SE_IPV4_ADDR src_ip,
+					  USHORT id, USHORT total_size, USHORT offset, UCHAR protocol, UCHAR ttl,
+					  UINT size)
+{
+	// 引数チェック
+	if (ip == NULL)
+	{
+		return;
+	}
+
+	SeZero(ip, sizeof(SE_IPV4_HEADER));
+
 	SE_IPV4_SET_VERSION(ip, 4);
 	SE_IPV4_SET_HEADER_LEN(ip, (sizeof(SE_IPV4_HEADER) / 4));
 	ip->TotalLength = SeEndian16((USHORT)(size + sizeof(SE_IPV4_HEADER)));
@@ -470,12 +517,6 @@ void Se4SendIpFragment(SE_IPV4 *p, SE_IPV4_ADDR dest_ip, SE_IPV4_ADDR src_ip,
 
 	// チェックサムの計算
 	ip->Checksum = Se4IpChecksum(ip, sizeof(SE_IPV4_HEADER));
-
-	// データコピー
-	SeCopy(buf + sizeof(SE_IPV4_HEADER), data, size);
-
-	// Raw IP 送信
-	Se4SendRawIp(p, buf, size + sizeof(SE_IPV4_HEADER), dest_mac);
 }
 
 // IP パケットの送信
@@ -531,6 +572,48 @@ void Se4SendIp(SE_IPV4 *p, SE_IPV4_ADDR dest_ip, SE_IPV4_ADDR src_ip, UCHAR prot
 	}
 }
 
+// パケットバッファによる IP パケットの送信
+// 分割不要で宛先 MAC アドレスが既知の場合は IP ヘッダと MAC ヘッダをヘッドルームに
+// 前置し, コピーせずに送信キューに入れる。パケットバッファは本関数内で解放される。
+void Se4SendIpPacketBuf(SE_IPV4 *p, SE_IPV4_ADDR dest_ip, SE_IPV4_ADDR src_ip, UCHAR protocol, UCHAR ttl,
+						SE_PACKET_BUF *b, UCHAR *dest_mac)
+{
+	SE_IPV4_HEADER *ip;
+	SE_IPV4_ADDR dest_ip_local;
+	bool no_route = false;
+	// 引数チェック
+	if (p == NULL || b == NULL || b->Size == 0 || b->Size > SE_IP4_MAX_PAYLOAD_SIZE)
+	{
+		SeFreePacketBuf(b);
+		return;
+	}
+
+	if (dest_mac == NULL)
+	{
+		dest_mac = Se4ResolveDestMacAddress(p, dest_ip, &dest_ip_local, &no_route);
+	}
+
+	if (dest_mac == NULL || (b->Size + sizeof(SE_IPV4_HEADER)) > p->Mtu ||
+		SE_PACKET_BUF_HEADROOM_SIZE(b) < (sizeof(SE_MAC_HEADER) + sizeof(SE_IPV4_HEADER)))
+	{
+		// 分割や ARP 解決が必要な場合は通常の送信処理を行う
+		if (no_route == false)
+		{
+			Se4SendIp(p, dest_ip, src_ip, protocol, ttl, b->Data, b->Size, dest_mac);
+		}
+		SeFreePacketBuf(b);
+		return;
+	}
+
+	// IP ヘッダの構築
+	ip = (SE_IPV4_HEADER *)SePushPacketBuf(b, sizeof(SE_IPV4_HEADER));
+	Se4BuildIpHeader(ip, dest_ip, src_ip, p->IdSeed++, (USHORT)(b->Size - sizeof(SE_IPV4_HEADER)), 0,
+		protocol, ttl, b->Size - sizeof(SE_IPV4_HEADER));
+
+	// 送信
+	Se4SendEthPacketBuf(p, dest_mac, SE_MAC_PROTO_IPV4, b);
+}
+
 // UDP パケットの解析
 bool Se4ParseIpPacketUDPv4(SE_IPV4 *p, SE_IPV4_HEADER_INFO *info, void *data, UINT size)
 {
@@ -1223,6 +1306,39 @@ void Se4SendEthPacket(SE_IPV4 *p, UCHAR *dest_mac, USHORT protocol, void *data,
 	SeFree(buf);
 }
 
+// パケットバッファによる Ethernet パケットの送信 (MAC ヘッダをヘッドルームに前置する)
+void Se4SendEthPacketBuf(SE_IPV4 *p, UCHAR *dest_mac, USHORT protocol, SE_PACKET_BUF *b)
+{
+	SE_MAC_HEADER *mac_header;
+	// 引数チェック
+	if (p == NULL || b == NULL)
+	{
+		SeFreePacketBuf(b);
+		return;
+	}
+	if (dest_mac == NULL)
+	{
+		dest_mac = Se4BroadcastMacAddress();
+	}
+
+	mac_header = (SE_MAC_HEADER *)SePushPacketBuf(b, sizeof(SE_MAC_HEADER));
+	if (mac_header == NULL)
+	{
+		// ヘッドルームが足りない
+		Se4SendEthPacket(p, dest_mac, protocol, b->Data, b->Size);
+		SeFreePacketBuf(b);
+		return;
+	}
+
+	// MAC ヘッダの構築
+	SeCopy(mac_header->DestAddress, dest_mac, SE_ETHERNET_MAC_ADDR_SIZE);
+	SeCopy(mac_header->SrcAddress, p->Eth->MyMacAddress, SE_ETHERNET_MAC_ADDR_SIZE);
+	mac_header->Protocol = SeEndian16(protocol);
+
+	// 送信
+	SeVpnSendEtherPacketBuf(p->Vpn, p->Eth, b);
+}
+
 // Ethernet パケットの受信
 void Se4RecvEthPacket(SE_IPV4 *p, void *packet, UINT packet_size)
 {
@@ -267,6 +267,7 @@ void Se4MacIpRelationKnown(SE_IPV4 *p, SE_IPV4_ADDR ip_addr, UCHAR *mac_addr);
 
 void Se4RecvEthPacket(SE_IPV4 *p, void *packet, UINT packet_size);
 void Se4SendEthPacket(SE_IPV4 *p, UCHAR *dest_mac, USHORT protocol, void *data, UINT data_size);
+void Se4SendEthPacketBuf(SE_IPV4 *p, UCHAR *dest_mac, USHORT protocol, SE_PACKET_BUF *b);
 UCHAR *Se4BroadcastMacAddress();
 
 void Se4RecvArp(SE_IPV4 *p, SE_PACKET *pkt);
@@ -287,6 +288,12 @@ void Se4SendIp(SE_IPV4 *p, SE_IPV4_ADDR dest_ip, SE_IPV4_ADDR src_ip, UCHAR prot
 void Se4SendIpFragment(SE_IPV4 *p, SE_IPV4_ADDR dest_ip, SE_IPV4_ADDR src_ip,
 					   USHORT id, USHORT total_size, USHORT offset, UCHAR protocol, UCHAR ttl,
 					   void *data, UINT size, UCHAR *dest_mac);
+void Se4BuildIpHeader(SE_IPV4_HEADER *ip, SE_IPV4_ADDR dest_ip, SE_IPV4_ADDR src_ip,
+					  USHORT id, USHORT total_size, USHORT offset, UCHAR protocol, UCHAR ttl,
+					  UINT size);
+void Se4SendIpPacketBuf(SE_IPV4 *p, SE_IPV4_ADDR dest_ip, SE_IPV4_ADDR src_ip, UCHAR protocol, UCHAR ttl,
+						SE_PACKET_BUF *b, UCHAR *dest_mac);
+UCHAR *Se4ResolveDestMacAddress(SE_IPV4 *p, SE_IPV4_ADDR dest_ip, SE_IPV4_ADDR *dest_ip_local, bool *no_route);
 void Se4SendRawIp(SE_IPV4 *p, void *data, UINT size, UCHAR *dest_mac);
 void Se4SendIpFragmentNow(SE_IPV4 *p, UCHAR *dest_mac, void *data, UINT size);
 void Se4SendIcmp(SE_IPV4 *p, SE_IPV4_ADDR src_ip, SE_IPV4_ADDR dest_ip, UCHAR type, UCHAR code, void *data, UINT size);
@@ -455,13 +455,69 @@ void Se6SendIpFragmentNow(SE_IPV6 *p, UCHAR *dest_mac, void *data, UINT size)
 	Se6SendEthPacket(p, dest_mac, SE_MAC_PROTO_IPV6, data, size);
 }
 
+// 宛先 MAC アドレスの解決
+// 近隣テーブルに無い場合は NULL を返し, dest_ip_local に近隣要請で解決すべき
+// IP アドレスを格納する。経路が無い場合は no_route を true にする。
+// マルチキャストアドレスの場合は mac_tmp に生成した MAC アドレスを返す。
+UCHAR *Se6ResolveDestMacAddress(SE_IPV6 *p, SE_IPV6_ADDR dest_ip, SE_IPV6_ADDR *dest_ip_local, bool *no_route,
+								UCHAR *mac_tmp)
+{
+	UINT type;
+	SE_IPV6_NEIGHBOR_ENTRY *e;
+	// 引数チェック
+	if (p == NULL || dest_ip_local == NULL || no_route == NULL || mac_tmp == NULL)
+	{
+		return NULL;
+	}
+
+	*dest_ip_local = dest_ip;
+	*no_route = false;
+
+	// 宛先 IP アドレスの種類を確認
+	type = Se6GetIPAddrType(dest_ip);
+
+	if ((type & SE_IPV6_ADDR_UNICAST) == 0)
+	{
+		// マルチキャストアドレスなので宛先 MAC アドレスを生成する
+		Se6GenerateMulticastMacAddress(mac_tmp, dest_ip);
+		return mac_tmp;
+	}
+
+	// ユニキャストアドレス
+	if ((type & SE_IPV6_ADDR_GLOBAL_UNICAST) &&
+		(Se6IsInSameNetwork(p->GlobalIpAddress, dest_ip, p->SubnetMask)) == false)
+	{
+		// ルーティングが必要な IP アドレスである
+		if (p->UseDefaultGateway)
+		{
+			*dest_ip_local = p->DefaultGateway;
+		}
+		else
+		{
+			// デフォルトゲートウェイが存在しない
+			*no_route = true;
+			return NULL;
+		}
+	}
+
+	// 近隣テーブルの検索
+	e = Se6SearchNeighborEntryList(p->NeighborEntryList, *dest_ip_local, Se6Tick(p));
+
+	if (e == NULL)
+	{
+		return NULL;
+	}
+
+	return e->MacAddress;
+}
+
 // Raw IP パケットの送信
 void Se6SendRawIp(SE_IPV6 *p, void *data, UINT size, UCHAR *dest_mac)
 {
 	UCHAR *buf;
 	SE_IPV6_HEADER *ip;
 	SE_IPV6_ADDR dest_ip_local, dest_ip, src_ip;
-	char dest_mac_tmp[6];
+	UCHAR dest_mac_tmp[6];
 	// 引数チェック
 	if (p == NULL || data == NULL || size == 0)
 	{
@@ -484,42 +540,14 @@ void Se6SendRawIp(SE_IPV6 *p, void *data, UINT size, UCHAR *dest_mac)
 	// MAC アドレスの解決
 	if (dest_mac == NULL)
 	{
-		// 宛先 IP アドレスの種類を確認
-		UINT type = Se6GetIPAddrType(dest_ip);
+		bool no_route;
 
-		if (type & SE_IPV6_ADDR_UNICAST)
-		{
-			// ユニキャストアドレス
-			SE_IPV6_NEIGHBOR_ENTRY *e;
+		dest_mac = Se6ResolveDestMacAddress(p, dest_ip, &dest_ip_local, &no_route, dest_mac_tmp);
 
-			if ((type & SE_IPV6_ADDR_GLOBAL_UNICAST) &&
-				(Se6IsInSameNetwork(p->GlobalIpAddress, dest_ip, p->SubnetMask)) == false)
-			{
-				// ルーティングが必要な IP アドレスである
-				if (p->UseDefaultGateway)
-				{
-					dest_ip_local = p->DefaultGateway;
-				}
-				else
-				{
-					// デフォルトゲートウェイが存在しないのでパケットを破棄
-					return;
-				}
-			}
-
-			// 近隣テーブルの検索
-			e = Se6SearchNeighborEntryList(p->NeighborEntryList, dest_ip_local, Se6Tick(p));
-
-			if (e != NULL)
-			{
-				dest_mac = e->MacAddress;
-			}
-		}
-		else
+		if (no_route)
 		{
-			// マルチキャストアドレスなので宛先 MAC アドレスを生成する
-			Se6GenerateMulticastMacAddress(dest_mac_tmp, dest_ip);
-			dest_mac = dest_mac_tmp;
+			// デフォルトゲートウェイが存在しないのでパケットを破棄
+			return;
 		}
 	}
 
@@ -601,6 +629,60 @@ void Se6SendIp(SE_IPV6 *p, SE_IPV6_ADDR dest_ip, SE_IPV6_ADDR src_ip, UCHAR prot
 	SeFreePacketListWithoutBuffer(o);
 }
 
+// パケットバッファによる IP パケットの送信
+// 分割不要で宛先 MAC アドレスが既知の場合は IPv6 ヘッダと MAC ヘッダをヘッドルームに
+// 前置し, コピーせずに送信キューに入れる。パケットバッファは本関数内で解放される。
+void Se6SendIpPacketBuf(SE_IPV6 *p, SE_IPV6_ADDR dest_ip, SE_IPV6_ADDR src_ip, UCHAR protocol, UCHAR hop_limit,
+						SE_PACKET_BUF *b, UCHAR *dest_mac)
+{
+	SE_IPV6_HEADER *ip;
+	SE_IPV6_ADDR dest_ip_local;
+	UCHAR dest_mac_tmp[6];
+	bool no_route = false;
+	// 引数チェック
+	if (p == NULL || b == NULL || b->Size == 0 || b->Size > SE_IP6_MAX_PAYLOAD_SIZE)
+	{
+		SeFreePacketBuf(b);
+		return;
+	}
+
+	if (dest_mac == NULL)
+	{
+		dest_mac = Se6ResolveDestMacAddress(p, dest_ip, &dest_ip_local, &no_route, dest_mac_tmp);
+	}
+
+	if (dest_mac == NULL || (b->Size + sizeof(SE_IPV6_HEADER)) > MAX(SE_V4_MTU_MIN, p->Mtu) ||
+		SE_PACKET_BUF_HEADROOM_SIZE(b) < (sizeof(SE_MAC_HEADER) + sizeof(SE_IPV6_HEADER)))
+	{
+		// 分割や近隣探索が必要な場合は通常の送信処理を行う
+		if (no_route == false)
+		{
+			Se6SendIp(p, dest_ip, src_ip, protocol, hop_limit, b->Data, b->Size, dest_mac);
+		}
+		SeFreePacketBuf(b);
+		return;
+	}
+
+	if (hop_limit == 0)
+	{
+		hop_limit = SE_IPV6_SEND_HOP_LIMIT;
+	}
+
+	// IPv6 ヘッダの構築 (Se6SendIp と同様に ID を消費する)
+	p->IdSeed++;
+	ip = (SE_IPV6_HEADER *)SePushPacketBuf(b, sizeof(SE_IPV6_HEADER));
+	SeZero(ip, sizeof(SE_IPV6_HEADER));
+	SE_IPV6_SET_VERSION(ip, 6);
+	ip->PayloadLength = SeEndian16((USHORT)(b->Size - sizeof(SE_IPV6_HEADER)));
+	ip->NextHeader = protocol;
+	ip->HopLimit = hop_limit;
+	ip->SrcAddress = src_ip;
+	ip->DestAddress = dest_ip;
+
+	// 送信
+	Se6SendEthPacketBuf(p, dest_mac, SE_MAC_PROTO_IPV6, b);
+}
+
 // UDP パケットの解析
 bool Se6ParseIpPacketUDPv6(SE_IPV6 *p, SE_IPV6_HEADER_INFO *info, void *data, UINT size)
 {
@@ -1279,6 +1361,39 @@ void Se6SendEthPacket(SE_IPV6 *p, UCHAR *dest_mac, USHORT protocol, void *data,
 	SeFree(buf);
 }
 
+// パケットバッファによる Ethernet パケットの送信 (MAC ヘッダをヘッドルームに前置する)
+void Se6SendEthPacketBuf(SE_IPV6 *p, UCHAR *dest_mac, USHORT protocol, SE_PACKET_BUF *b)
+{
+	SE_MAC_HEADER *mac_header;
+	// 引数チェック
+	if (p == NULL || b == NULL)
+	{
+		SeFreePacketBuf(b);
+		return;
+	}
+	if (dest_mac == NULL)
+	{
+		dest_mac = Se6BroadcastMacAddress();
+	}
+
+	mac_header = (SE_MAC_HEADER *)SePushPacketBuf(b, sizeof(SE_MAC_HEADER));
+	if (mac_header == NULL)
+	{
+		// ヘッドルームが足りない
+		Se6SendEthPacket(p, dest_mac, protocol, b->Data, b->Size);
+		SeFreePacketBuf(b);
+		return;
+	}
+
+	// MAC ヘッダの構築
+	SeCopy(mac_header->DestAddress, dest_mac, SE_ETHERNET_MAC_ADDR_SIZE);
+	SeCopy(mac_header->SrcAddress, p->Eth->MyMacAddress, SE_ETHERNET_MAC_ADDR_SIZE);
+	mac_header->Protocol = SeEndian16(protocol);
+
+	// 送信
+	SeVpnSendEtherPacketBuf(p->Vpn, p->Eth, b);
+}
+
 // Ethernet パケットの受信
 void Se6RecvEthPacket(SE_IPV6 *p, void *packet, UINT packet_size)
 {
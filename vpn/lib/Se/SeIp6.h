@@ -265,6 +265,7 @@ void Se6FreeNeighborEntryList(SE_LIST *o);
 
 void Se6RecvEthPacket(SE_IPV6 *p, void *packet, UINT packet_size);
 void Se6SendEthPacket(SE_IPV6 *p, UCHAR *dest_mac, USHORT protocol, void *data, UINT data_size);
+void Se6SendEthPacketBuf(SE_IPV6 *p, UCHAR *dest_mac, USHORT protocol, SE_PACKET_BUF *b);
 UCHAR *Se6BroadcastMacAddress();
 
 void Se6MacIpRelationKnown(SE_IPV6 *p, SE_IPV6_ADDR ip_addr, UCHAR *mac_addr);
@@ -290,6 +291,10 @@ USHORT Se6CalcChecksum(SE_IPV6_ADDR src_ip, SE_IPV6_ADDR dest_ip, UCHAR protocol
 void Se6SendIp(SE_IPV6 *p, SE_IPV6_ADDR dest_ip, SE_IPV6_ADDR src_ip, UCHAR protocol, UCHAR hop_limit, void *data,
 			   UINT size, UCHAR *dest_mac);
 void Se6SendIpFragment(SE_IPV6 *p, void *data, UINT size, UCHAR *dest_mac);
+void Se6SendIpPacketBuf(SE_IPV6 *p, SE_IPV6_ADDR dest_ip, SE_IPV6_ADDR src_ip, UCHAR protocol, UCHAR hop_limit,
+						SE_PACKET_BUF *b, UCHAR *dest_mac);
+UCHAR *Se6ResolveDestMacAddress(SE_IPV6 *p, SE_IPV6_ADDR dest_ip, SE_IPV6_ADDR *dest_ip_local, bool *no_route,
+								UCHAR *mac_tmp);
 void Se6SendRawIp(SE_IPV6 *p, void *data, UINT size, UCHAR *dest_mac);
 void Se6SendIpFragmentNow(SE_IPV6 *p, UCHAR *dest_mac, void *data, UINT size);
 void Se6SendUdp(SE_IPV6 *p, SE_IPV6_ADDR dest_ip, UINT dest_port, SE_IPV6_ADDR src_ip, UINT src_port,
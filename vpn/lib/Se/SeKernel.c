@@ -323,7 +323,7 @@ void SeEthFree(SE_ETH *e)
 
 	while ((p = SeGetNext(e->SendQueue)) != NULL)
 	{
-		SeFree(p);
+		SeFreePacketBuf(p);
 	}
 
 	SeFreeQueue(e->RecvQueue);
@@ -471,7 +471,20 @@ void SeEthSendAdd(SE_ETH *e, void *packet, UINT packet_size)
 		return;
 	}
 
-	SeInsertQueue(e->SendQueue, SeClone(packet, packet_size));
+	SeInsertQueue(e->SendQueue, SeMemToPacketBuf(packet, packet_size));
+}
+
+// NIC の送信キューにパケットバッファを追加 (パケットバッファは送信後に解放される)
+void SeEthSendAddPacketBuf(SE_ETH *e, SE_PACKET_BUF *b)
+{
+	// 引数チェック
+	if (e == NULL || b == NULL)
+	{
+		SeFreePacketBuf(b);
+		return;
+	}
+
+	SeInsertQueue(e->SendQueue, b);
 }
 
 // NIC の送信キューに溜まっているパケットを全部送信
@@ -480,8 +493,9 @@ UINT SeEthSendAll(SE_ETH *e)
 	UINT num_packet;
 	UINT *packet_sizes;
 	void **packets;
+	SE_PACKET_BUF **bufs;
 	UINT i;
-	void *p;
+	SE_PACKET_BUF *b;
 	// 引数チェック
 	if (e == NULL)
 	{
@@ -497,14 +511,14 @@ UINT SeEthSendAll(SE_ETH *e)
 
 	packet_sizes = SeMalloc(sizeof(UINT) * num_packet);
 	packets = SeMalloc(sizeof(void *) * num_packet);
+	bufs = SeMalloc(sizeof(SE_PACKET_BUF *) * num_packet);
 
 	i = 0;
-	while ((p = SeGetNext(e->SendQueue)) != NULL)
+	while ((b = SeGetNext(e->SendQueue)) != NULL)
 	{
-		UINT size = SeMemSize(p);
-
-		packets[i] = p;
-		packet_sizes[i] = size;
+		bufs[i] = b;
+		packets[i] = b->Data;
+		packet_sizes[i] = b->Size;
 
 		i++;
 	}
@@ -513,13 +527,12 @@ UINT SeEthSendAll(SE_ETH *e)
 
 	for (i = 0;i < num_packet;i++)
 	{
-		void *p = packets[i];
-
-		SeFree(p);
+		SeFreePacketBuf(bufs[i]);
 	}
 
 	SeFree(packet_sizes);
 	SeFree(packets);
+	SeFree(bufs);
 
 	return num_packet;
 }
@@ -1775,6 +1775,89 @@ SE_BUF *SeNewBuf()
 	return b;
 }
 
+// パケットバッファの作成
+// データの前後に下位層のヘッダやトレーラを書き込むための余白を確保する。
+SE_PACKET_BUF *SeNewPacketBuf(UINT headroom, UINT size, UINT tailroom)
+{
+	SE_PACKET_BUF *b;
+
+	b = SeMalloc(sizeof(SE_PACKET_BUF));
+	b->BufSize = headroom + size + tailroom;
+	b->Buf = SeMalloc(b->BufSize);
+	b->Data = b->Buf + headroom;
+	b->Size = size;
+
+	return b;
+}
+
+// メモリからパケットバッファを作成 (余白無し)
+SE_PACKET_BUF *SeMemToPacketBuf(void *data, UINT size)
+{
+	SE_PACKET_BUF *b;
+	// 引数チェック
+	if (data == NULL && size != 0)
+	{
+		return NULL;
+	}
+
+	b = SeNewPacketBuf(0, size, 0);
+	SeCopy(b->Data, data, size);
+
+	return b;
+}
+
+// パケットバッファの解放
+void SeFreePacketBuf(SE_PACKET_BUF *b)
+{
+	// 引数チェック
+	if (b == NULL)
+	{
+		return;
+	}
+
+	SeFree(b->Buf);
+	SeFree(b);
+}
+
+// パケットバッファの先頭に領域を追加 (ヘッドルームが足りない場合は NULL)
+void *SePushPacketBuf(SE_PACKET_BUF *b, UINT size)
+{
+	// 引数チェック
+	if (b == NULL)
+	{
+		return NULL;
+	}
+	if (SE_PACKET_BUF_HEADROOM_SIZE(b) < size)
+	{
+		return NULL;
+	}
+
+	b->Data -= size;
+	b->Size += size;
+
+	return b->Data;
+}
+
+// パケットバッファの末尾に領域を追加 (テイルルームが足りない場合は NULL)
+void *SePutPacketBuf(SE_PACKET_BUF *b, UINT size)
+{
+	UCHAR *p;
+	// 引数チェック
+	if (b == NULL)
+	{
+		return NULL;
+	}
+	if (SE_PACKET_BUF_TAILROOM_SIZE(b) < size)
+	{
+		return NULL;
+	}
+
+	p = b->Data + b->Size;
+	b->Size += size;
+
+	return p;
+}
+
 // 64 bit エンディアン変換
 UINT64 SeEndian64(UINT64 value)
 {
@@ -45,6 +45,7 @@
 #define	SE_FIFO_INIT_MEM_SIZE		4096
 #define	SE_FIFO_REALLOC_MEM_SIZE	(65536 * 10)	// 絶妙な値
 #define	SE_INIT_NUM_RESERVED		32
+#define	SE_PACKET_BUF_HEADROOM		64			// 下位層ヘッダ用のヘッドルーム (Ethernet + IPv6 ヘッダ)
 
 // バッファ
 struct SE_BUF
@@ -55,6 +56,15 @@ struct SE_BUF
 	UINT Current;
 };
 
+// ヘッドルームおよびテイルルーム付きパケットバッファ
+struct SE_PACKET_BUF
+{
+	UCHAR *Buf;						// 確保したメモリ
+	UINT BufSize;					// 確保したメモリのサイズ
+	UCHAR *Data;					// データの先頭
+	UINT Size;						// データのサイズ
+};
+
 // FIFO
 struct SE_FIFO
 {
@@ -88,6 +98,8 @@ struct SE_STACK
 // マクロ
 #define	SE_LIST_DATA(o, i)		(((o) != NULL) ? ((o)->p[(i)]) : NULL)
 #define	SE_LIST_NUM(o)			(((o) != NULL) ? (o)->num_item : 0)
+#define	SE_PACKET_BUF_HEADROOM_SIZE(b)	((UINT)((b)->Data - (b)->Buf))
+#define	SE_PACKET_BUF_TAILROOM_SIZE(b)	((b)->BufSize - SE_PACKET_BUF_HEADROOM_SIZE(b) - (b)->Size)
 
 #if	0
 #define SE_GETARG(ret, start, index)		\
@@ -155,6 +167,12 @@ bool SeDumpBuf(SE_BUF *b, char *filename);
 SE_BUF *SeReadDump(char *filename);
 bool SeCmpBuf(SE_BUF *b1, SE_BUF *b2);
 
+SE_PACKET_BUF *SeNewPacketBuf(UINT headroom, UINT size, UINT tailroom);
+SE_PACKET_BUF *SeMemToPacketBuf(void *data, UINT size);
+void SeFreePacketBuf(SE_PACKET_BUF *b);
+void *SePushPacketBuf(SE_PACKET_BUF *b, UINT size);
+void *SePutPacketBuf(SE_PACKET_BUF *b, UINT size);
+
 SE_FIFO *SeNewFifo();
 void SeFreeFifo(SE_FIFO *f);
 UINT SePeekFifo(SE_FIFO *f, void *p, UINT size);
@@ -512,14 +512,14 @@ void SeSecProcessIkeSaMsgPhase2(SE_SEC *s, SE_IKE_SA *sa, SE_IKE_PACKET *packet_
 							sa->MySpi,
 							sa->Phase2MyRand,
 							sa->Phase2YourRand,
-							SeIkePhase2CryptIdToKeySize(config->VpnPhase2Crypto) + SE_HMAC_SHA1_96_KEY_SIZE);
+							SeSecCalcIPsecKeymatSize(config));
 
 						sa->YourKEYMAT = SeSecCalcKEYMAT(sa->P1KeySet.SKEYID_d,
 							SE_IKE_PROTOCOL_ID_IPSEC_ESP,
 							sa->YourSpi,
 							sa->Phase2MyRand,
 							sa->Phase2YourRand,
-							SeIkePhase2CryptIdToKeySize(config->VpnPhase2Crypto) + SE_HMAC_SHA1_96_KEY_SIZE);
+							SeSecCalcIPsecKeymatSize(config));
 
 						SeCopy(sa->Phase2Iv, cparam.NextIv, SE_DES_BLOCK_SIZE);
 
@@ -562,8 +562,16 @@ void SeSecFreeIPsecSa(SE_SEC *s, SE_IPSEC_SA *sa)
 	SeFreeBuf(sa->EncryptionKey);
 	SeFreeBuf(sa->HashKey);
 	SeDes3FreeKey(sa->DesKey);
+	SeAesFreeKey(sa->AesKey);
+	SeHmacFreeKey(sa->HmacKey);
 
 	SeDelete(s->IPsecSaList, sa);
+	SeSecDeleteIPsecSaHash(s, sa);
+
+	if (s->CurrentInboundSa == sa || s->CurrentOutboundSa == sa)
+	{
+		SeSecUpdateCurrentIPsecSa(s);
+	}
 
 	SeFree(sa);
 }
@@ -575,6 +583,8 @@ SE_IPSEC_SA *SeSecNewIPsecSa(SE_SEC *s, SE_IKE_SA *ike_sa, bool outgoing, UINT s
 {
 	SE_SEC_CONFIG *config;
 	SE_IPSEC_SA *sa;
+	UINT crypt_key_size;
+	UINT hash_key_size;
 	// 引数チェック
 	if (s == NULL || ike_sa == NULL || keymat == NULL)
 	{
@@ -592,21 +602,62 @@ SE_IPSEC_SA *SeSecNewIPsecSa(SE_SEC *s, SE_IKE_SA *ike_sa, bool outgoing, UINT s
 	sa->SrcAddr = src_addr;
 	sa->DestAddr = dest_addr;
 
-	sa->EncryptionKey = SeMemToBuf(((UCHAR *)keymat->Buf), SeIkePhase2CryptIdToKeySize(config->VpnPhase2Crypto));
-	sa->HashKey = SeMemToBuf(((UCHAR *)keymat->Buf) + SeIkePhase2CryptIdToKeySize(config->VpnPhase2Crypto), SE_HMAC_SHA1_96_KEY_SIZE);
+	sa->CryptId = config->VpnPhase2Crypto;
+	sa->HashId = (sa->CryptId == SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16 ? 0 : config->VpnPhase2Hash);
+	crypt_key_size = SeIkePhase2CryptIdToKeySize(sa->CryptId, config->VpnPhase2KeySize);
+	hash_key_size = SeIkePhase2HashIdToKeySize(sa->HashId);
 
-	if (config->VpnPhase2Crypto == SE_IKE_TRANSFORM_ID_P2_ESP_3DES)
+	sa->EncryptionKey = SeMemToBuf(((UCHAR *)keymat->Buf), crypt_key_size);
+	sa->HashKey = SeMemToBuf(((UCHAR *)keymat->Buf) + crypt_key_size, hash_key_size);
+
+	if (sa->CryptId == SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16)
+	{
+		// AES-GCM (KEYMAT の末尾 4 バイトはソルト)
+		sa->AesKey = SeAesNewKey(sa->EncryptionKey->Buf, crypt_key_size - SE_AES_GCM_SALT_SIZE);
+		SeCopy(sa->Salt, ((UCHAR *)sa->EncryptionKey->Buf) + crypt_key_size - SE_AES_GCM_SALT_SIZE,
+			SE_AES_GCM_SALT_SIZE);
+		sa->BlockSize = sizeof(UINT);
+		sa->IvSize = SE_AES_GCM_IV_SIZE;
+	}
+	else if (sa->CryptId == SE_IKE_TRANSFORM_ID_P2_ESP_AES)
+	{
+		// AES-CBC
+		sa->AesKey = SeAesNewKey(sa->EncryptionKey->Buf, crypt_key_size);
+		sa->BlockSize = SE_AES_BLOCK_SIZE;
+		sa->IvSize = SE_AES_IV_SIZE;
+	}
+	else if (sa->CryptId == SE_IKE_TRANSFORM_ID_P2_ESP_3DES)
 	{
 		// 3DES
 		sa->DesKey = SeDes3NewKey(
 			((UCHAR *)sa->EncryptionKey->Buf) + SE_DES_KEY_SIZE * 0,
 			((UCHAR *)sa->EncryptionKey->Buf) + SE_DES_KEY_SIZE * 1,
 			((UCHAR *)sa->EncryptionKey->Buf) + SE_DES_KEY_SIZE * 2);
+		sa->BlockSize = SE_DES_BLOCK_SIZE;
+		sa->IvSize = SE_DES_IV_SIZE;
 	}
 	else
 	{
 		// DES
 		sa->DesKey = SeDesNewKey(sa->EncryptionKey->Buf);
+		sa->BlockSize = SE_DES_BLOCK_SIZE;
+		sa->IvSize = SE_DES_IV_SIZE;
+	}
+
+	// HMAC の中間状態は SA ごとに一度だけ計算しておく
+	if (sa->CryptId == SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16)
+	{
+		sa->IcvSize = SE_AES_GCM_ICV_SIZE;
+	}
+	else if (sa->HashId == SE_IKE_P2_HMAC_SHA2_256)
+	{
+		sa->HmacKey = SeHmacNewKey(SE_HASH_SHA256, sa->HashKey->Buf, sa->HashKey->Size);
+		sa->IcvSize = SE_HMAC_SHA256_128_HASH_SIZE;
+	}
+	else
+	{
+		sa->HmacKey = SeHmacNewKey(SE_HASH_SHA1, sa->HashKey->Buf, sa->HashKey->Size);
+		sa->IcvSize = SE_HMAC_SHA1_96_HASH_SIZE;
 	}
 
 	sa->EstablishedTick = SeSecTick(s);
@@ -616,6 +667,17 @@ SE_IPSEC_SA *SeSecNewIPsecSa(SE_SEC *s, SE_IKE_SA *ike_sa, bool outgoing, UINT s
 	}
 
 	SeInsert(s->IPsecSaList, sa);
+	SeSecAddIPsecSaHash(s, sa);
+
+	// 新しい SA を以後の送受信に使用する
+	if (outgoing)
+	{
+		s->CurrentOutboundSa = sa;
+	}
+	else
+	{
+		s->CurrentInboundSa = sa;
+	}
 
 	return sa;
 }
@@ -676,7 +738,17 @@ void SeSecSendIkeSaMsgPhase2(SE_SEC *s, SE_IKE_SA *sa)
 
 		// トランスフォーム値リストの作成
 		transform_value_list = SeNewList(NULL);
-		SeAdd(transform_value_list, SeIkeNewTransformValue(SE_IKE_TRANSFORM_VALUE_P2_HMAC, config->VpnPhase2Hash));
+		if (config->VpnPhase2Crypto != SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16)
+		{
+			// AES-GCM は認証を兼ねるため HMAC アルゴリズムを指定しない
+			SeAdd(transform_value_list, SeIkeNewTransformValue(SE_IKE_TRANSFORM_VALUE_P2_HMAC, config->VpnPhase2Hash));
+		}
+		if (config->VpnPhase2Crypto == SE_IKE_TRANSFORM_ID_P2_ESP_AES ||
+			config->VpnPhase2Crypto == SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16)
+		{
+			// AES の場合は鍵長を指定する
+			SeAdd(transform_value_list, SeIkeNewTransformValue(SE_IKE_TRANSFORM_VALUE_P2_KEY_SIZE, config->VpnPhase2KeySize));
+		}
 		SeAdd(transform_value_list, SeIkeNewTransformValue(SE_IKE_TRANSFORM_VALUE_P2_LIFE_TYPE, SE_IKE_P1_LIFE_TYPE_SECONDS));
 		SeAdd(transform_value_list, SeIkeNewTransformValue(SE_IKE_TRANSFORM_VALUE_P2_LIFE, config->VpnPhase2LifeSeconds));
 		if (config->VpnPhase2LifeKilobytes != 0)
@@ -1278,6 +1350,27 @@ void SeSecCalcP1KeySet(SE_IKE_P1_KEYSET *set, void *skeyid, UINT skeyid_size, vo
 	set->SKEYID_e = SeSecCalcKa(hash_e, sizeof(hash_e), request_e_key_size);
 }
 
+// IPsec SA に必要な KEYMAT のサイズの計算
+UINT SeSecCalcIPsecKeymatSize(SE_SEC_CONFIG *config)
+{
+	UINT size;
+	// 引数チェック
+	if (config == NULL)
+	{
+		return 0;
+	}
+
+	size = SeIkePhase2CryptIdToKeySize(config->VpnPhase2Crypto, config->VpnPhase2KeySize);
+
+	// AES-GCM は HMAC を使用しない
+	if (config->VpnPhase2Crypto != SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16)
+	{
+		size += SeIkePhase2HashIdToKeySize(config->VpnPhase2Hash);
+	}
+
+	return size;
+}
+
 // KEYMAT の計算
 SE_BUF *SeSecCalcKEYMAT(SE_BUF *skeyid_d, UCHAR protocol, UINT spi,
 						SE_BUF *my_rand, SE_BUF *your_rand, UINT request_size)
@@ -2056,14 +2149,23 @@ void SeSecEspRecvCallback(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, v
 	SE_SEC *s = (SE_SEC *)param;
 	SE_SEC_CONFIG *config;
 	SE_IPSEC_SA *sa;
+	UINT spi_value;
 	// 引数チェック
-	if (s == NULL || data == NULL)
+	if (s == NULL || dest_addr == NULL || src_addr == NULL || data == NULL)
 	{
 		return;
 	}
 
 	config = &s->Config;
-	sa = SeSecGetIPsecSa(s, false);
+
+	// SPI による受信用 IPsec SA の検索 (鍵更新中は新旧両方の SA で受信する)
+	if (size < sizeof(UINT))
+	{
+		return;
+	}
+	SeCopy(&spi_value, data, sizeof(UINT));
+
+	sa = SeSecSearchInboundIPsecSaBySpi(s, *dest_addr, *src_addr, spi_value);
 	if (sa == NULL)
 	{
 		return;
@@ -2075,9 +2177,9 @@ void SeSecEspRecvCallback(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, v
 	{
 		UCHAR *esp = (UCHAR *)data;
 		UINT esp_size = size;
-		UINT enc_block_size = SE_DES_BLOCK_SIZE;
-		UINT enc_iv_size = SE_DES_IV_SIZE;
-		UINT hash_size = SE_HMAC_SHA1_96_HASH_SIZE;
+		UINT enc_block_size = sa->BlockSize;
+		UINT enc_iv_size = sa->IvSize;
+		UINT hash_size = sa->IcvSize;
 
 		if (esp_size >= sizeof(UINT) + sizeof(UINT) + enc_iv_size + enc_block_size + hash_size)
 		{
@@ -2086,33 +2188,17 @@ void SeSecEspRecvCallback(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, v
 
 			if (*spi == sa->Spi)
 			{
-				// シーケンス番号
-				UINT *seq = (UINT *)(((UCHAR *)esp) + sizeof(UINT));
-
-				// IV
-				UCHAR *iv = (UCHAR *)(((UCHAR *)esp) + sizeof(UINT) + sizeof(UINT));
-
-				// データブロック
-				UCHAR *data_block = (UCHAR *)(((UCHAR *)esp) + sizeof(UINT) + sizeof(UINT) + enc_iv_size);
-
 				// データブロックサイズの計算
 				UINT data_block_size = esp_size - (sizeof(UINT) + sizeof(UINT) + enc_iv_size + hash_size);
 
 				if (data_block_size > 0 && ((data_block_size % enc_block_size) == 0))
 				{
-					// 認証データ
-					UCHAR *hash = (UCHAR *)(((UCHAR *)esp) + sizeof(UINT) + sizeof(UINT) + enc_iv_size + data_block_size);
-					UCHAR hash2[SE_HMAC_SHA1_96_HASH_SIZE];
-
-					// ハッシュの計算
-					SeMacSha196(hash2, sa->HashKey->Buf, esp, esp_size - hash_size);
+					// 解読先バッファの確保
+					UCHAR *payload_data = SeMalloc(data_block_size);
 
-					// ハッシュの比較
-					if (SeCmp(hash, hash2, SE_HMAC_SHA1_96_HASH_SIZE) == 0)
+					// 認証データの検査および解読
+					if (SeSecEspDecrypt(sa, esp, data_block_size, payload_data))
 					{
-						// データ本体の解読
-						UCHAR *payload_data = SeMalloc(data_block_size);
-
 						UINT payload_size;
 
 						UCHAR *padding_size = payload_data + data_block_size - sizeof(UCHAR) * 2;
@@ -2121,9 +2207,6 @@ void SeSecEspRecvCallback(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, v
 
 						UCHAR next_header_2 = s->IPv6 ? 41 : 4;
 
-						SeDes3Decrypt(payload_data, data_block, data_block_size,
-							sa->DesKey, iv);
-
 						if (data_block_size >= (sizeof(UCHAR) * 2 + *padding_size))
 						{
 							// ペイロードサイズの計算
@@ -2139,9 +2222,9 @@ void SeSecEspRecvCallback(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, v
 								sa->IkeSa->LastCommTick = SeSecTick(s);
 							}
 						}
-
-						SeFree(payload_data);
 					}
+
+					SeFree(payload_data);
 				}
 			}
 		}
@@ -2170,16 +2253,16 @@ void SeSecVirtualIpRecvCallback(void *data, UINT size, void *param)
 	// ESP パケットの構築
 	if (true)
 	{
-		UINT enc_block_size = SE_DES_BLOCK_SIZE;
-		UINT enc_iv_size = SE_DES_IV_SIZE;
+		UINT enc_block_size = sa->BlockSize;
+		UINT enc_iv_size = sa->IvSize;
 		UINT data_block_size;
 		UINT esp_size;
-		UINT hash_size = SE_HMAC_SHA1_96_HASH_SIZE;
+		UINT hash_size = sa->IcvSize;
 		UINT padding_size;
-		UCHAR padding_size_char;
+		SE_PACKET_BUF *pb;
 		UCHAR *esp;
+		UCHAR *trailer;
 		UINT i;
-		UCHAR n;
 		UCHAR next_header = (s->IPv6 ? 41 : 4);
 		UINT seq_be;
 
@@ -2194,7 +2277,10 @@ void SeSecVirtualIpRecvCallback(void *data, UINT size, void *param)
 		esp_size = sizeof(UINT) + sizeof(UINT) + enc_iv_size + data_block_size + hash_size;
 
 		// ESP パケットを構築する
-		esp = SeMalloc(esp_size);
+		// 外側の IP ヘッダと MAC ヘッダは下位層がヘッドルームに前置する
+		pb = SeNewPacketBuf(SE_PACKET_BUF_HEADROOM, sizeof(UINT) + sizeof(UINT) + enc_iv_size + size,
+			esp_size - (sizeof(UINT) + sizeof(UINT) + enc_iv_size + size));
+		esp = pb->Data;
 
 		// SPI
 		SeCopy(esp, &sa->Spi, sizeof(UINT));
@@ -2203,52 +2289,27 @@ void SeSecVirtualIpRecvCallback(void *data, UINT size, void *param)
 		seq_be = SeEndian32(++sa->Seq);
 		SeCopy(esp + sizeof(UINT), &seq_be, sizeof(UINT));
 
-		// IV
-		SeCopy(esp + sizeof(UINT) + sizeof(UINT), sa->NextIv, enc_iv_size);
-
 		// ペイロードデータ
 		SeCopy(esp + sizeof(UINT) + sizeof(UINT) + enc_iv_size, data, size);
 
-		// パディング長
+		// パディング, パディング長および次ヘッダ番号
 		padding_size = data_block_size - (size + sizeof(UCHAR) * 2);
-		padding_size_char = (UCHAR)padding_size;
-		SeCopy(esp + sizeof(UINT) + sizeof(UINT) + enc_iv_size + size + padding_size,
-			&padding_size_char, sizeof(UCHAR));
-
-		// 次ヘッダ番号
-		SeCopy(esp + sizeof(UINT) + sizeof(UINT) + enc_iv_size + size + padding_size + sizeof(UCHAR),
-			&next_header, sizeof(UCHAR));
-
-		// パディング
-		n = 0;
-		for (i = sizeof(UINT) + sizeof(UINT) + enc_iv_size + size;
-			i < sizeof(UINT) + sizeof(UINT) + enc_iv_size + size + padding_size;
-			i++)
+		trailer = SePutPacketBuf(pb, padding_size + sizeof(UCHAR) * 2);
+		for (i = 0;i < padding_size;i++)
 		{
-			esp[i] = ++n;
+			trailer[i] = (UCHAR)(i + 1);
 		}
+		trailer[padding_size] = (UCHAR)padding_size;
+		trailer[padding_size + sizeof(UCHAR)] = next_header;
 
-		// 暗号化
-		SeDes3Encrypt(esp + sizeof(UINT) + sizeof(UINT) + enc_iv_size,
-			esp + sizeof(UINT) + sizeof(UINT) + enc_iv_size,
-			data_block_size,
-			sa->DesKey,
-			sa->NextIv);
+		// 認証データの領域
+		SePutPacketBuf(pb, hash_size);
 
-		// 認証
-		SeMacSha196(esp + sizeof(UINT) + sizeof(UINT) + enc_iv_size + data_block_size,
-			sa->HashKey->Buf,
-			esp,
-			sizeof(UINT) + sizeof(UINT) + enc_iv_size + data_block_size);
+		// IV の設定, 暗号化および認証
+		SeSecEspEncrypt(sa, esp, data_block_size);
 
 		// 送信
-		SeSecSendEsp(s, &sa->DestAddr, &sa->SrcAddr, esp, esp_size);
-
-		// 最終ブロックを次の IV として保持
-		SeCopy(sa->NextIv, esp + sizeof(UINT) + sizeof(UINT) + enc_iv_size
-			+ data_block_size - enc_block_size, enc_block_size);
-
-		SeFree(esp);
+		SeSecSendEsp(s, &sa->DestAddr, &sa->SrcAddr, pb);
 
 		sa->TransferBytes += size;
 
@@ -2262,28 +2323,151 @@ void SeSecVirtualIpRecvCallback(void *data, UINT size, void *param)
 	}
 }
 
+// ESP パケットの IV の設定, データブロックの暗号化および認証データの付加
+void SeSecEspEncrypt(SE_IPSEC_SA *sa, UCHAR *esp, UINT data_block_size)
+{
+	UCHAR *iv;
+	UCHAR *data_block;
+	UCHAR *icv;
+	UCHAR hash[SE_HMAC_MAX_HASH_SIZE];
+	// 引数チェック
+	if (sa == NULL || esp == NULL || data_block_size == 0)
+	{
+		return;
+	}
+
+	iv = esp + sizeof(UINT) + sizeof(UINT);
+	data_block = iv + sa->IvSize;
+	icv = data_block + data_block_size;
+
+	if (sa->CryptId == SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16)
+	{
+		UCHAR nonce[SE_AES_GCM_NONCE_SIZE];
+		UINT64 seq64 = SeEndian64((UINT64)sa->Seq);
+
+		// IV は同一鍵で重複しなければよいのでシーケンス番号を用いる
+		SeCopy(iv, &seq64, SE_AES_GCM_IV_SIZE);
+		SeCopy(nonce, sa->Salt, SE_AES_GCM_SALT_SIZE);
+		SeCopy(nonce + SE_AES_GCM_SALT_SIZE, iv, SE_AES_GCM_IV_SIZE);
+
+		// SPI とシーケンス番号を追加認証データとする (RFC 4106)
+		SeAesGcmEncrypt(data_block, data_block, data_block_size, sa->AesKey, nonce,
+			esp, sizeof(UINT) + sizeof(UINT), icv);
+
+		return;
+	}
+
+	SeCopy(iv, sa->NextIv, sa->IvSize);
+
+	// 暗号化と認証 (SPI, シーケンス番号, IV および暗号文が認証の対象)
+	if (sa->CryptId == SE_IKE_TRANSFORM_ID_P2_ESP_AES)
+	{
+		SeAesCbcEncryptMac(data_block, data_block, data_block_size, sa->AesKey, iv,
+			sa->HmacKey, esp, sizeof(UINT) + sizeof(UINT) + sa->IvSize, hash);
+
+		// 最終ブロックを暗号化したものを次の IV とする (IV を予測不能にするため)
+		SeAesEncryptBlock(sa->NextIv, data_block + data_block_size - SE_AES_BLOCK_SIZE, sa->AesKey);
+	}
+	else
+	{
+		SeDes3EncryptMac(data_block, data_block, data_block_size, sa->DesKey, iv,
+			sa->HmacKey, esp, sizeof(UINT) + sizeof(UINT) + sa->IvSize, hash);
+
+		// 最終ブロックを次の IV として保持
+		SeCopy(sa->NextIv, data_block + data_block_size - SE_DES_BLOCK_SIZE, SE_DES_BLOCK_SIZE);
+	}
+
+	SeCopy(icv, hash, sa->IcvSize);
+}
+
+// ESP パケットの認証データの検査およびデータブロックの解読
+bool SeSecEspDecrypt(SE_IPSEC_SA *sa, UCHAR *esp, UINT data_block_size, UCHAR *dest)
+{
+	UCHAR *iv;
+	UCHAR *data_block;
+	UCHAR *icv;
+	UCHAR hash[SE_HMAC_MAX_HASH_SIZE];
+	// 引数チェック
+	if (sa == NULL || esp == NULL || data_block_size == 0 || dest == NULL)
+	{
+		return false;
+	}
+
+	iv = esp + sizeof(UINT) + sizeof(UINT);
+	data_block = iv + sa->IvSize;
+	icv = data_block + data_block_size;
+
+	if (sa->CryptId == SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16)
+	{
+		UCHAR nonce[SE_AES_GCM_NONCE_SIZE];
+
+		SeCopy(nonce, sa->Salt, SE_AES_GCM_SALT_SIZE);
+		SeCopy(nonce + SE_AES_GCM_SALT_SIZE, iv, SE_AES_GCM_IV_SIZE);
+
+		return SeAesGcmDecrypt(dest, data_block, data_block_size, sa->AesKey, nonce,
+			esp, sizeof(UINT) + sizeof(UINT), icv);
+	}
+
+	// ハッシュの計算
+	SeHmac(hash, sa->HmacKey, esp, sizeof(UINT) + sizeof(UINT) + sa->IvSize + data_block_size);
+
+	// ハッシュの比較
+	if (SeCmp(icv, hash, sa->IcvSize) != 0)
+	{
+		return false;
+	}
+
+	// データ本体の解読
+	if (sa->CryptId == SE_IKE_TRANSFORM_ID_P2_ESP_AES)
+	{
+		SeAesCbcDecrypt(dest, data_block, data_block_size, sa->AesKey, iv);
+	}
+	else
+	{
+		SeDes3Decrypt(dest, data_block, data_block_size, sa->DesKey, iv);
+	}
+
+	return true;
+}
+
 // 使用可能な IPsec SA の取得
 SE_IPSEC_SA *SeSecGetIPsecSa(SE_SEC *s, bool outgoing)
 {
-	UINT i;
 	// 引数チェック
 	if (s == NULL)
 	{
 		return NULL;
 	}
 
+	return (outgoing ? s->CurrentOutboundSa : s->CurrentInboundSa);
+}
+
+// 現在使用する IPsec SA の再計算 (各方向で最も新しい SA を使用する)
+void SeSecUpdateCurrentIPsecSa(SE_SEC *s)
+{
+	UINT i;
+	// 引数チェック
+	if (s == NULL)
+	{
+		return;
+	}
+
+	s->CurrentInboundSa = NULL;
+	s->CurrentOutboundSa = NULL;
+
 	for (i = 0;i < SE_LIST_NUM(s->IPsecSaList);i++)
 	{
-		UINT j = SE_LIST_NUM(s->IPsecSaList) - i - 1;
-		SE_IPSEC_SA *sa = SE_LIST_DATA(s->IPsecSaList, j);
+		SE_IPSEC_SA *sa = SE_LIST_DATA(s->IPsecSaList, i);
 
-		if (sa->Outgoing == outgoing)
+		if (sa->Outgoing)
 		{
-			return sa;
+			s->CurrentOutboundSa = sa;
+		}
+		else
+		{
+			s->CurrentInboundSa = sa;
 		}
 	}
-
-	return NULL;
 }
 
 // 初期化メイン
@@ -2595,6 +2779,7 @@ UINT64 SeSecGenIkeSaInitCookie(SE_SEC *s)
 // SA リストの初期化
 void SeSecInitSaList(SE_SEC *s)
 {
+	UINT i;
 	// 引数チェック
 	if (s == NULL)
 	{
@@ -2603,6 +2788,14 @@ void SeSecInitSaList(SE_SEC *s)
 
 	s->IkeSaList = SeNewList(SeSecCmpIkeSa);
 	s->IPsecSaList = SeNewList(NULL);
+
+	for (i = 0;i < SE_SEC_IPSEC_SA_HASH_SIZE;i++)
+	{
+		s->IPsecSaHash[i] = SeNewList(NULL);
+	}
+
+	s->CurrentInboundSa = NULL;
+	s->CurrentOutboundSa = NULL;
 }
 
 // SA リストの解放
@@ -2646,6 +2839,15 @@ void SeSecFreeSaList(SE_SEC *s)
 	SeFree(sa_list);
 
 	SeFreeList(s->IPsecSaList);
+
+	for (i = 0;i < SE_SEC_IPSEC_SA_HASH_SIZE;i++)
+	{
+		SeFreeList(s->IPsecSaHash[i]);
+		s->IPsecSaHash[i] = NULL;
+	}
+
+	s->CurrentInboundSa = NULL;
+	s->CurrentOutboundSa = NULL;
 }
 
 // IKE SA の比較
@@ -2707,30 +2909,92 @@ int SeSecCmpIkeSa(void *p1, void *p2)
 SE_IPSEC_SA *SeSecSearchIPsecSaBySpi(SE_SEC *s, SE_IKE_IP_ADDR src_addr, SE_IKE_IP_ADDR dest_addr,
 									 UINT spi)
 {
-	UINT i;
 	// 引数チェック
 	if (s == NULL)
 	{
 		return NULL;
 	}
 
-	for (i = 0;i < SE_LIST_NUM(s->IPsecSaList);i++)
+	return SeSecSearchIPsecSaHash(s, &src_addr, &dest_addr, spi, false);
+}
+
+// SPI をキーとして受信用 IPsec SA の検索
+SE_IPSEC_SA *SeSecSearchInboundIPsecSaBySpi(SE_SEC *s, SE_IKE_IP_ADDR src_addr, SE_IKE_IP_ADDR dest_addr,
+											UINT spi)
+{
+	// 引数チェック
+	if (s == NULL)
 	{
-		SE_IPSEC_SA *sa = SE_LIST_DATA(s->IPsecSaList, i);
+		return NULL;
+	}
 
-		if (SeCmp(&src_addr, &sa->DestAddr, sizeof(SE_IKE_IP_ADDR)) &&
-			SeCmp(&dest_addr, &sa->SrcAddr, sizeof(SE_IKE_IP_ADDR)))
+	return SeSecSearchIPsecSaHash(s, &src_addr, &dest_addr, spi, true);
+}
+
+// ハッシュテーブルからの IPsec SA の検索
+// src_addr および dest_addr は SA から見たアドレス (SrcAddr が自分側) である。
+SE_IPSEC_SA *SeSecSearchIPsecSaHash(SE_SEC *s, SE_IKE_IP_ADDR *src_addr, SE_IKE_IP_ADDR *dest_addr,
+									UINT spi, bool inbound_only)
+{
+	SE_LIST *o;
+	UINT i;
+	// 引数チェック
+	if (s == NULL || src_addr == NULL || dest_addr == NULL)
+	{
+		return NULL;
+	}
+
+	o = s->IPsecSaHash[SeSecIPsecSaHashIndex(spi)];
+
+	for (i = 0;i < SE_LIST_NUM(o);i++)
+	{
+		SE_IPSEC_SA *sa = SE_LIST_DATA(o, i);
+
+		if (sa->Spi == spi &&
+			(inbound_only == false || sa->Outgoing == false) &&
+			SeCmp(src_addr, &sa->SrcAddr, sizeof(SE_IKE_IP_ADDR)) == 0 &&
+			SeCmp(dest_addr, &sa->DestAddr, sizeof(SE_IKE_IP_ADDR)) == 0)
 		{
-			if (spi == sa->Spi)
-			{
-				return sa;
-			}
+			return sa;
 		}
 	}
 
 	return NULL;
 }
 
+// SPI からハッシュテーブルのバケット番号を計算
+UINT SeSecIPsecSaHashIndex(UINT spi)
+{
+	spi ^= (spi >> 16);
+	spi ^= (spi >> 8);
+
+	return (spi & (SE_SEC_IPSEC_SA_HASH_SIZE - 1));
+}
+
+// IPsec SA をハッシュテーブルに追加
+void SeSecAddIPsecSaHash(SE_SEC *s, SE_IPSEC_SA *sa)
+{
+	// 引数チェック
+	if (s == NULL || sa == NULL)
+	{
+		return;
+	}
+
+	SeAdd(s->IPsecSaHash[SeSecIPsecSaHashIndex(sa->Spi)], sa);
+}
+
+// IPsec SA をハッシュテーブルから削除
+void SeSecDeleteIPsecSaHash(SE_SEC *s, SE_IPSEC_SA *sa)
+{
+	// 引数チェック
+	if (s == NULL || sa == NULL)
+	{
+		return;
+	}
+
+	SeDelete(s->IPsecSaHash[SeSecIPsecSaHashIndex(sa->Spi)], sa);
+}
+
 // SPI をキーとして IKE SA の検索
 SE_IKE_SA *SeSecSearchIkeSaBySpi(SE_SEC *s, SE_IKE_IP_ADDR src_addr, SE_IKE_IP_ADDR dest_addr,
 								 UINT src_port, UINT dest_port, void *spi_buf)
@@ -2994,20 +3258,22 @@ void SeSecSendUdp(SE_SEC *s, SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr
 	s->ClientFunctions.ClientSendUdp(dest_addr, src_addr, dest_port, src_port, data, size, s->Param);
 }
 
-// ESP パケットを送信してもらう
-void SeSecSendEsp(SE_SEC *s, SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, void *data, UINT size)
+// ESP パケットを送信してもらう (パケットバッファは送信後に解放される)
+void SeSecSendEsp(SE_SEC *s, SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, SE_PACKET_BUF *b)
 {
 	// 引数チェック
-	if (s == NULL || dest_addr == NULL || src_addr == NULL || data == NULL)
+	if (s == NULL || dest_addr == NULL || src_addr == NULL || b == NULL)
 	{
+		SeFreePacketBuf(b);
 		return;
 	}
 	if (s->Halting)
 	{
+		SeFreePacketBuf(b);
 		return;
 	}
 
-	s->ClientFunctions.ClientSendEsp(dest_addr, src_addr, data, size, s->Param);
+	s->ClientFunctions.ClientSendEsp(dest_addr, src_addr, b, s->Param);
 }
 
 // 仮想 IP パケットを送信してもらう
@@ -65,6 +65,9 @@
 // 定期的ポーリング間隔
 #define SE_SEC_POLLING_INTERVAL					500
 
+// IPsec SA 検索用ハッシュテーブルのバケット数 (2 のべき乗)
+#define SE_SEC_IPSEC_SA_HASH_SIZE				64
+
 
 //
 // データ構造
@@ -88,6 +91,7 @@ struct SE_SEC_CONFIG
 	UINT VpnPhase1LifeSeconds;		// ISAKMP SA の有効期限の値 (単位: 秒, 0 の場合は無効)
 	UINT VpnWaitPhase2BlankSpan;	// フェーズ 1 完了からフェーズ 2 開始までの間にあける時間 (単位: ミリ秒)
 	UCHAR VpnPhase2Crypto;			// フェーズ 2 における暗号化アルゴリズム
+	UINT VpnPhase2KeySize;			// フェーズ 2 における暗号化鍵長 (単位: ビット, AES の場合のみ)
 	UCHAR VpnPhase2Hash;			// フェーズ 2 における署名アルゴリズム
 	UINT VpnPhase2LifeKilobytes;	// ISAKMP SA の有効期限の値 (単位: キロバイト, 0 の場合は無効)
 	UINT VpnPhase2LifeSeconds;		// ISAKMP SA の有効期限の値 (単位: 秒, 0 の場合は無効)
@@ -117,7 +121,7 @@ struct SE_SEC_CLIENT_FUNCTION_TABLE
 	// UDP パケット送信関数
 	void (*ClientSendUdp)(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, UINT dest_port, UINT src_port, void *data, UINT size, void *param);
 	// ESP パケット送信関数
-	void (*ClientSendEsp)(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, void *data, UINT size, void *param);
+	void (*ClientSendEsp)(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, SE_PACKET_BUF *b, void *param);
 	// 仮想 IP パケット送信関数
 	void (*ClientSendVirtualIp)(void *data, UINT size, void *param);
 };
@@ -171,7 +175,7 @@ struct SE_IPSEC_SA
 	SE_IKE_IP_ADDR SrcAddr, DestAddr;
 	bool Outgoing;										// true のとき送信方向, false のとき受信方向
 	UINT Spi;											// SPI
-	UCHAR NextIv[SE_DES_BLOCK_SIZE];					// 次の IV
+	UCHAR NextIv[SE_AES_BLOCK_SIZE];					// 次の IV
 	SE_IKE_SA *IkeSa;									// IKE SA へのポインタ
 	UINT64 EstablishedTick;								// 確立完了時刻
 	UINT64 TransferBytes;								// 転送バイト数
@@ -179,6 +183,14 @@ struct SE_IPSEC_SA
 	SE_BUF *EncryptionKey;								// 暗号化鍵
 	SE_BUF *HashKey;									// ハッシュ鍵
 	SE_DES_KEY *DesKey;									// DES 鍵
+	SE_AES_KEY *AesKey;									// AES 鍵
+	SE_HMAC_KEY *HmacKey;								// HMAC 鍵 (AES-GCM の場合は NULL)
+	UCHAR Salt[SE_AES_GCM_SALT_SIZE];					// AES-GCM のソルト
+	UCHAR CryptId;										// 暗号化アルゴリズム
+	UCHAR HashId;										// HMAC アルゴリズム (AES-GCM の場合は 0)
+	UINT BlockSize;										// パディングの境界となるブロックサイズ
+	UINT IvSize;										// IV サイズ
+	UINT IcvSize;										// 認証データ (ICV) サイズ
 };
 
 // IPsec 処理構造体
@@ -192,6 +204,9 @@ struct SE_SEC
 	SE_LIST *IkeSaList;									// IKE SA リスト
 	UINT64 NextConnectStartTick;						// 次の接続開始時刻
 	SE_LIST *IPsecSaList;								// IPsec SA リスト
+	SE_LIST *IPsecSaHash[SE_SEC_IPSEC_SA_HASH_SIZE];	// SPI による IPsec SA 検索用ハッシュテーブル
+	SE_IPSEC_SA *CurrentInboundSa;						// 現在使用する受信用 IPsec SA
+	SE_IPSEC_SA *CurrentOutboundSa;						// 現在使用する送信用 IPsec SA
 	bool Halting;										// 停止中
 	UINT64 PoolingVar;									// ポーリング用変数
 	bool StatusChanged;									// 状態変化
@@ -206,7 +221,7 @@ void SeSecSetRecvUdpCallback(SE_SEC *s, SE_SEC_UDP_RECV_CALLBACK *callback);
 void SeSecSetRecvEspCallback(SE_SEC *s, SE_SEC_ESP_RECV_CALLBACK *callback);
 void SeSecSetRecvVirtualIpCallback(SE_SEC *s, SE_SEC_VIRTUAL_IP_RECV_CALLBACK *callback);
 void SeSecSendUdp(SE_SEC *s, SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, UINT dest_port, UINT src_port, void *data, UINT size);
-void SeSecSendEsp(SE_SEC *s, SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, void *data, UINT size);
+void SeSecSendEsp(SE_SEC *s, SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, SE_PACKET_BUF *b);
 void SeSecSendVirtualIp(SE_SEC *s, void *data, UINT size);
 
 UINT SeSecStrToAuthMethod(char *str);
@@ -240,6 +255,14 @@ SE_IKE_SA *SeSecSearchIkeSaBySpi(SE_SEC *s, SE_IKE_IP_ADDR src_addr, SE_IKE_IP_A
 								 UINT src_port, UINT dest_port, void *spi_buf);
 SE_IPSEC_SA *SeSecSearchIPsecSaBySpi(SE_SEC *s, SE_IKE_IP_ADDR src_addr, SE_IKE_IP_ADDR dest_addr,
 									 UINT spi);
+SE_IPSEC_SA *SeSecSearchInboundIPsecSaBySpi(SE_SEC *s, SE_IKE_IP_ADDR src_addr, SE_IKE_IP_ADDR dest_addr,
+											UINT spi);
+SE_IPSEC_SA *SeSecSearchIPsecSaHash(SE_SEC *s, SE_IKE_IP_ADDR *src_addr, SE_IKE_IP_ADDR *dest_addr,
+									UINT spi, bool inbound_only);
+UINT SeSecIPsecSaHashIndex(UINT spi);
+void SeSecAddIPsecSaHash(SE_SEC *s, SE_IPSEC_SA *sa);
+void SeSecDeleteIPsecSaHash(SE_SEC *s, SE_IPSEC_SA *sa);
+void SeSecUpdateCurrentIPsecSa(SE_SEC *s);
 SE_IKE_SA *SeSecNewIkeSa(SE_SEC *s, SE_IKE_IP_ADDR src_addr, SE_IKE_IP_ADDR dest_addr,
 					  UINT src_port, UINT dest_port, UINT64 init_cookie);
 void SeSecFreeIkeSa(SE_SEC *s, SE_IKE_SA *sa);
@@ -266,6 +289,7 @@ void SeSecSendIkeSaMsgInfoSimple(SE_SEC *s, SE_IKE_SA *sa, SE_IKE_PACKET_PAYLOAD
 void SeSecSendIkeSaDeleteMsg(SE_SEC *s, SE_IKE_SA *sa);
 void SeSecSendIPsecSaDeleteMsg(SE_SEC *s, SE_IPSEC_SA *sa, SE_IKE_SA *ike_sa);
 
+UINT SeSecCalcIPsecKeymatSize(SE_SEC_CONFIG *config);
 SE_BUF *SeSecCalcKEYMAT(SE_BUF *skeyid_d, UCHAR protocol, UINT spi,
 						SE_BUF *my_rand, SE_BUF *your_rand, UINT request_size);
 SE_BUF *SeSecCalcKEYMATFull(SE_BUF *skeyid_d, void *keymat_src, UINT keymat_src_size, UINT request_size);
@@ -277,6 +301,8 @@ void SeSecFreeIPsecSa(SE_SEC *s, SE_IPSEC_SA *sa);
 UINT64 SeSecLifeSeconds64bit(UINT value);
 
 SE_IPSEC_SA *SeSecGetIPsecSa(SE_SEC *s, bool outgoing);
+void SeSecEspEncrypt(SE_IPSEC_SA *sa, UCHAR *esp, UINT data_block_size);
+bool SeSecEspDecrypt(SE_IPSEC_SA *sa, UCHAR *esp, UINT data_block_size, UCHAR *dest);
 
 #endif	// SESEC_H
 
@@ -52,6 +52,7 @@ typedef struct X509_req_st X509_REQ;
 //typedef struct PKCS12 PKCS12;
 typedef struct bignum_st BIGNUM;
 typedef struct DES_ks DES_key_schedule;
+typedef struct aes_key_st AES_KEY;
 typedef struct dh_st DH;
 #endif	// ENCRYPT_C
 
@@ -194,6 +195,7 @@ typedef void (SE_TIMER_CALLBACK)(SE_TIMER *t, UINT64 current_tick, void *param);
 
 // SeMemory.h
 typedef struct SE_BUF SE_BUF;
+typedef struct SE_PACKET_BUF SE_PACKET_BUF;
 typedef struct SE_FIFO SE_FIFO;
 typedef struct SE_LIST SE_LIST;
 typedef struct SE_QUEUE SE_QUEUE;
@@ -208,10 +210,16 @@ typedef struct SE_CONFIG_ENTRY SE_CONFIG_ENTRY;
 // SeCrypto.h
 typedef struct SE_DES_KEY SE_DES_KEY;
 typedef struct SE_DES_KEY_VALUE SE_DES_KEY_VALUE;
+typedef struct SE_AES_KEY SE_AES_KEY;
+typedef struct SE_HMAC_KEY SE_HMAC_KEY;
 typedef struct SE_CERT SE_CERT;
 typedef struct SE_KEY SE_KEY;
 typedef struct SE_DH SE_DH;
 
+// SeAesNi.h
+typedef struct SE_AES_NI_KEY SE_AES_NI_KEY;
+typedef struct SE_AES_NI_FPU SE_AES_NI_FPU;
+
 // SePacket.h
 typedef struct SE_MAC_HEADER SE_MAC_HEADER;
 typedef struct SE_ARPV4_HEADER SE_ARPV4_HEADER;
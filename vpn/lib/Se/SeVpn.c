@@ -480,6 +480,19 @@ void SeVpnSendEtherPacket(SE_VPN *v, SE_ETH *e, void *packet, UINT packet_size)
 	SeEthSendAdd(e, packet, packet_size);
 }
 
+// Ethernet パケットの送信 (パケットバッファをそのまま送信キューに入れる)
+void SeVpnSendEtherPacketBuf(SE_VPN *v, SE_ETH *e, SE_PACKET_BUF *b)
+{
+	// 引数チェック
+	if (v == NULL || e == NULL || b == NULL)
+	{
+		SeFreePacketBuf(b);
+		return;
+	}
+
+	SeEthSendAddPacketBuf(e, b);
+}
+
 // メインプロセス内で状態が変化した場合に呼び出す関数
 void SeVpnStatusChanged(SE_VPN *v)
 {
@@ -832,6 +845,7 @@ SE_VPN_CONFIG *SeVpnLoadConfig(SE_LIST *o)
 			c.VpnPhase1LifeSecondsV4 = SE_DEFAULT_VALUE(SeGetConfigInt(o, "VpnPhase1LifeSecondsV4"), SE_SEC_DEFAULT_P1_LIFE_SECONDS);
 			c.VpnWaitPhase2BlankSpanV4 = SE_DEFAULT_VALUE(SeGetConfigInt(o, "VpnWaitPhase2BlankSpanV4"), SE_SEC_DEFAULT_WAIT_P2_BLANK_SPAN);
 			c.VpnPhase2CryptoV4 = SeIkeStrToPhase2CryptId(SeGetConfigStr(o, "VpnPhase2CryptoV4"));
+			c.VpnPhase2KeySizeV4 = SeIkeStrToPhase2KeySize(SeGetConfigStr(o, "VpnPhase2CryptoV4"));
 			c.VpnPhase2HashV4 = SeIkeStrToPhase2HashId(SeGetConfigStr(o, "VpnPhase2HashV4"));
 			c.VpnPhase2LifeKilobytesV4 = SeGetConfigInt(o, "VpnPhase2LifeKilobytesV4");
 			c.VpnPhase2LifeSecondsV4 = SE_DEFAULT_VALUE(SeGetConfigInt(o, "VpnPhase2LifeSecondsV4"), SE_SEC_DEFAULT_P2_LIFE_SECONDS);
@@ -888,7 +902,14 @@ SE_VPN_CONFIG *SeVpnLoadConfig(SE_LIST *o)
 				SeStrCpy(error_str, sizeof(error_str), "VpnPhase2CryptoV4: Invalid Value.");
 				goto LABEL_ERROR;
 			}
-			if (c.VpnPhase2HashV4 == 0)
+			if ((c.VpnPhase2CryptoV4 == SE_IKE_TRANSFORM_ID_P2_ESP_AES ||
+				c.VpnPhase2CryptoV4 == SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16) &&
+				c.VpnPhase2KeySizeV4 == 0)
+			{
+				SeStrCpy(error_str, sizeof(error_str), "VpnPhase2CryptoV4: Invalid Key Size.");
+				goto LABEL_ERROR;
+			}
+			if (c.VpnPhase2HashV4 == 0 && c.VpnPhase2CryptoV4 != SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16)
 			{
 				SeStrCpy(error_str, sizeof(error_str), "VpnPhase2HashV4: Invalid Value.");
 				goto LABEL_ERROR;
@@ -1005,6 +1026,7 @@ SE_VPN_CONFIG *SeVpnLoadConfig(SE_LIST *o)
 			c.VpnPhase1LifeSecondsV6 = SE_DEFAULT_VALUE(SeGetConfigInt(o, "VpnPhase1LifeSecondsV6"), SE_SEC_DEFAULT_P1_LIFE_SECONDS);
 			c.VpnWaitPhase2BlankSpanV6 = SE_DEFAULT_VALUE(SeGetConfigInt(o, "VpnWaitPhase2BlankSpanV6"), SE_SEC_DEFAULT_WAIT_P2_BLANK_SPAN);
 			c.VpnPhase2CryptoV6 = SeIkeStrToPhase2CryptId(SeGetConfigStr(o, "VpnPhase2CryptoV6"));
+			c.VpnPhase2KeySizeV6 = SeIkeStrToPhase2KeySize(SeGetConfigStr(o, "VpnPhase2CryptoV6"));
 			c.VpnPhase2HashV6 = SeIkeStrToPhase2HashId(SeGetConfigStr(o, "VpnPhase2HashV6"));
 			c.VpnPhase2LifeKilobytesV6 = SeGetConfigInt(o, "VpnPhase2LifeKilobytesV6");
 			c.VpnPhase2LifeSecondsV6 = SE_DEFAULT_VALUE(SeGetConfigInt(o, "VpnPhase2LifeSecondsV6"), SE_SEC_DEFAULT_P2_LIFE_SECONDS);
@@ -1062,7 +1084,14 @@ SE_VPN_CONFIG *SeVpnLoadConfig(SE_LIST *o)
 				SeStrCpy(error_str, sizeof(error_str), "VpnPhase2CryptoV6: Invalid Value.");
 				goto LABEL_ERROR;
 			}
-			if (c.VpnPhase2HashV6 == 0)
+			if ((c.VpnPhase2CryptoV6 == SE_IKE_TRANSFORM_ID_P2_ESP_AES ||
+				c.VpnPhase2CryptoV6 == SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16) &&
+				c.VpnPhase2KeySizeV6 == 0)
+			{
+				SeStrCpy(error_str, sizeof(error_str), "VpnPhase2CryptoV6: Invalid Key Size.");
+				goto LABEL_ERROR;
+			}
+			if (c.VpnPhase2HashV6 == 0 && c.VpnPhase2CryptoV6 != SE_IKE_TRANSFORM_ID_P2_ESP_AES_GCM_16)
 			{
 				SeStrCpy(error_str, sizeof(error_str), "VpnPhase2HashV6: Invalid Value.");
 				goto LABEL_ERROR;
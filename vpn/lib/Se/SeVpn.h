@@ -81,6 +81,7 @@ struct SE_VPN_CONFIG
 	UINT VpnPhase1LifeSecondsV4;	// ISAKMP SA の有効期限の値 (単位: 秒, 0 の場合は無効)
 	UINT VpnWaitPhase2BlankSpanV4;	// フェーズ 1 完了からフェーズ 2 開始までの間にあける時間 (単位: ミリ秒)
 	UCHAR VpnPhase2CryptoV4;		// フェーズ 2 における暗号化アルゴリズム
+	UINT VpnPhase2KeySizeV4;		// フェーズ 2 における暗号化鍵長 (単位: ビット, AES の場合のみ)
 	UCHAR VpnPhase2HashV4;			// フェーズ 2 における署名アルゴリズム
 	UINT VpnPhase2LifeKilobytesV4;	// ISAKMP SA の有効期限の値 (単位: キロバイト, 0 の場合は無効)
 	UINT VpnPhase2LifeSecondsV4;	// ISAKMP SA の有効期限の値 (単位: 秒, 0 の場合は無効)
@@ -121,6 +122,7 @@ struct SE_VPN_CONFIG
 	UINT VpnPhase1LifeSecondsV6;	// ISAKMP SA の有効期限の値 (単位: 秒, 0 の場合は無効)
 	UINT VpnWaitPhase2BlankSpanV6;	// フェーズ 1 完了からフェーズ 2 開始までの間にあける時間 (単位: ミリ秒)
 	UCHAR VpnPhase2CryptoV6;		// フェーズ 2 における暗号化アルゴリズム
+	UINT VpnPhase2KeySizeV6;		// フェーズ 2 における暗号化鍵長 (単位: ビット, AES の場合のみ)
 	UCHAR VpnPhase2HashV6;			// フェーズ 2 における署名アルゴリズム
 	UINT VpnPhase2LifeKilobytesV6;	// ISAKMP SA の有効期限の値 (単位: キロバイト, 0 の場合は無効)
 	UINT VpnPhase2LifeSecondsV6;	// ISAKMP SA の有効期限の値 (単位: 秒, 0 の場合は無効)
@@ -175,6 +177,7 @@ void SeVpnMainProcess(SE_VPN *v);
 void SeVpnAddTimer(SE_VPN *v, UINT interval);
 void SeVpnStatusChanged(SE_VPN *v);
 void SeVpnSendEtherPacket(SE_VPN *v, SE_ETH *e, void *packet, UINT packet_size);
+void SeVpnSendEtherPacketBuf(SE_VPN *v, SE_ETH *e, SE_PACKET_BUF *b);
 void *SeVpnRecvEtherPacket(SE_VPN *v, SE_ETH *e);
 void SeVpnMainProcRecvEtherPacket(SE_VPN *v, bool physical, void *packet, UINT packet_size);
 UINT64 SeVpnTick(SE_VPN *v);
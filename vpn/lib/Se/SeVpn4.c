@@ -355,8 +355,8 @@ void SeVpn4ClientSendUdp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, UI
 	Se4SendUdp(ip, SeIkeGetIPv4Address(dest_addr), dest_port, SeIkeGetIPv4Address(src_addr), src_port, data, size, NULL);
 }
 
-// ESP パケット送信
-void SeVpn4ClientSendEsp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, void *data, UINT size, void *param)
+// ESP パケット送信 (パケットバッファは送信後に解放される)
+void SeVpn4ClientSendEsp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, SE_PACKET_BUF *b, void *param)
 {
 	SE_VPN4 *v4 = (SE_VPN4 *)param;
 	SE_VPN *v;
@@ -364,14 +364,15 @@ void SeVpn4ClientSendEsp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, vo
 	// 引数チェック
 	if (v4 == NULL)
 	{
+		SeFreePacketBuf(b);
 		return;
 	}
 
 	v = v4->Vpn;
 	ip = v->IPv4_Physical;
 
-	Se4SendIp(ip, SeIkeGetIPv4Address(dest_addr), SeIkeGetIPv4Address(src_addr),
-		SE_IP_PROTO_ESP, 0, data, size, NULL);
+	Se4SendIpPacketBuf(ip, SeIkeGetIPv4Address(dest_addr), SeIkeGetIPv4Address(src_addr),
+		SE_IP_PROTO_ESP, 0, b, NULL);
 }
 
 // 仮想 IP パケット送信
@@ -423,6 +424,7 @@ void SeVpn4InitSecConfig(SE_VPN4 *v4, SE_SEC_CONFIG *c)
 	c->VpnPhase1LifeSeconds = vc->VpnPhase1LifeSecondsV4;
 	c->VpnWaitPhase2BlankSpan = vc->VpnWaitPhase2BlankSpanV4;
 	c->VpnPhase2Crypto = vc->VpnPhase2CryptoV4;
+	c->VpnPhase2KeySize = vc->VpnPhase2KeySizeV4;
 	c->VpnPhase2Hash = vc->VpnPhase2HashV4;
 	c->VpnPhase2LifeKilobytes = vc->VpnPhase2LifeKilobytesV4;
 	c->VpnPhase2LifeSeconds = vc->VpnPhase2LifeSecondsV4;
@@ -95,7 +95,7 @@ void SeVpn4ClientSetRecvUdpCallback(SE_SEC_UDP_RECV_CALLBACK *callback, void *ca
 void SeVpn4ClientSetRecvEspCallback(SE_SEC_ESP_RECV_CALLBACK *callback, void *callback_param, void *param);
 void SeVpn4ClientSetRecvVirtualIpCallback(SE_SEC_VIRTUAL_IP_RECV_CALLBACK *callback, void *callback_param, void *param);
 void SeVpn4ClientSendUdp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, UINT dest_port, UINT src_port, void *data, UINT size, void *param);
-void SeVpn4ClientSendEsp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, void *data, UINT size, void *param);
+void SeVpn4ClientSendEsp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, SE_PACKET_BUF *b, void *param);
 void SeVpn4ClientSendVirtualIp(void *data, UINT size, void *param);
 
 #endif	// SEVPN4_H
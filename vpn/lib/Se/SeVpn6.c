@@ -284,6 +284,7 @@ void SeVpn6InitSecConfig(SE_VPN6 *v6, SE_SEC_CONFIG *c)
 	c->VpnPhase1LifeSeconds = vc->VpnPhase1LifeSecondsV6;
 	c->VpnWaitPhase2BlankSpan = vc->VpnWaitPhase2BlankSpanV6;
 	c->VpnPhase2Crypto = vc->VpnPhase2CryptoV6;
+	c->VpnPhase2KeySize = vc->VpnPhase2KeySizeV6;
 	c->VpnPhase2Hash = vc->VpnPhase2HashV6;
 	c->VpnPhase2LifeKilobytes = vc->VpnPhase2LifeKilobytesV6;
 	c->VpnPhase2LifeSeconds = vc->VpnPhase2LifeSecondsV6;
@@ -428,8 +429,8 @@ void SeVpn6ClientSendUdp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, UI
 	Se6SendUdp(ip, SeIkeGetIPv6Address(dest_addr), dest_port, SeIkeGetIPv6Address(src_addr), src_port, data, size, NULL);
 }
 
-// ESP パケット送信
-void SeVpn6ClientSendEsp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, void *data, UINT size, void *param)
+// ESP パケット送信 (パケットバッファは送信後に解放される)
+void SeVpn6ClientSendEsp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, SE_PACKET_BUF *b, void *param)
 {
 	SE_VPN6 *v6 = (SE_VPN6 *)param;
 	SE_VPN *v;
@@ -437,14 +438,15 @@ void SeVpn6ClientSendEsp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, vo
 	// 引数チェック
 	if (v6 == NULL)
 	{
+		SeFreePacketBuf(b);
 		return;
 	}
 
 	v = v6->Vpn;
 	ip = v->IPv6_Physical;
 
-	Se6SendIp(ip, SeIkeGetIPv6Address(dest_addr), SeIkeGetIPv6Address(src_addr),
-		SE_IP_PROTO_ESP, 0, data, size, NULL);
+	Se6SendIpPacketBuf(ip, SeIkeGetIPv6Address(dest_addr), SeIkeGetIPv6Address(src_addr),
+		SE_IP_PROTO_ESP, 0, b, NULL);
 }
 
 // 仮想 IP パケット送信
@@ -89,7 +89,7 @@ void SeVpn6ClientSetRecvUdpCallback(SE_SEC_UDP_RECV_CALLBACK *callback, void *ca
 void SeVpn6ClientSetRecvEspCallback(SE_SEC_ESP_RECV_CALLBACK *callback, void *callback_param, void *param);
 void SeVpn6ClientSetRecvVirtualIpCallback(SE_SEC_VIRTUAL_IP_RECV_CALLBACK *callback, void *callback_param, void *param);
 void SeVpn6ClientSendUdp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, UINT dest_port, UINT src_port, void *data, UINT size, void *param);
-void SeVpn6ClientSendEsp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, void *data, UINT size, void *param);
+void SeVpn6ClientSendEsp(SE_IKE_IP_ADDR *dest_addr, SE_IKE_IP_ADDR *src_addr, SE_PACKET_BUF *b, void *param);
 void SeVpn6ClientSendVirtualIp(void *data, UINT size, void *param);
 
 void SeVpn6UpdateGuestOsIpAddress(SE_VPN6 *v6, SE_IPV6_ADDR a);
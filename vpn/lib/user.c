@@ -653,8 +653,8 @@ vpn_msghandler (int m, int c, struct msgbuf *buf, int bufcnt)
 	} else if (c == VPN_MSG_PHYSICALNICRECV) {
 		struct vpn_msg_physicalnicrecv *arg;
 		struct vpnhandle *p;
-		void **packets;
-		UINT *packet_sizes;
+		void *packets_batch[VPN_NIC_RECV_BATCH], **packets;
+		UINT packet_sizes_batch[VPN_NIC_RECV_BATCH], *packet_sizes;
 		int i;
 
 		if (bufcnt < 1)
@@ -668,22 +668,30 @@ vpn_msghandler (int m, int c, struct msgbuf *buf, int bufcnt)
 		if (arg->num_packets == 0)
 			return 0;
 		p = arg->param;
-		packets = alloc (sizeof *packets * arg->num_packets);
-		packet_sizes = alloc (sizeof *packet_sizes * arg->num_packets);
+		if (arg->num_packets <= VPN_NIC_RECV_BATCH) {
+			packets = packets_batch;
+			packet_sizes = packet_sizes_batch;
+		} else {
+			packets = alloc (sizeof *packets * arg->num_packets);
+			packet_sizes = alloc (sizeof *packet_sizes *
+					      arg->num_packets);
+		}
 		for (i = 0; i < arg->num_packets; i++) {
 			packets[i] = buf[i + 1].base;
 			packet_sizes[i] = buf[i + 1].len;
 		}
 		p->recvphys_func (arg->nic_handle, arg->num_packets,
 				  packets, packet_sizes, p->recvphys_param);
-		free (packets);
-		free (packet_sizes);
+		if (packets != packets_batch) {
+			free (packets);
+			free (packet_sizes);
+		}
 		return 0;
 	} else if (c == VPN_MSG_VIRTUALNICRECV) {
 		struct vpn_msg_virtualnicrecv *arg;
 		struct vpnhandle *p;
-		void **packets;
-		UINT *packet_sizes;
+		void *packets_batch[VPN_NIC_RECV_BATCH], **packets;
+		UINT packet_sizes_batch[VPN_NIC_RECV_BATCH], *packet_sizes;
 		int i;
 
 		if (bufcnt < 1)
@@ -697,16 +705,24 @@ vpn_msghandler (int m, int c, struct msgbuf *buf, int bufcnt)
 		if (arg->num_packets == 0)
 			return 0;
 		p = arg->param;
-		packets = alloc (sizeof *packets * arg->num_packets);
-		packet_sizes = alloc (sizeof *packet_sizes * arg->num_packets);
+		if (arg->num_packets <= VPN_NIC_RECV_BATCH) {
+			packets = packets_batch;
+			packet_sizes = packet_sizes_batch;
+		} else {
+			packets = alloc (sizeof *packets * arg->num_packets);
+			packet_sizes = alloc (sizeof *packet_sizes *
+					      arg->num_packets);
+		}
 		for (i = 0; i < arg->num_packets; i++) {
 			packets[i] = buf[i + 1].base;
 			packet_sizes[i] = buf[i + 1].len;
 		}
 		p->recvvirt_func (arg->nic_handle, arg->num_packets,
 				  packets, packet_sizes, p->recvvirt_param);
-		free (packets);
-		free (packet_sizes);
+		if (packets != packets_batch) {
+			free (packets);
+			free (packet_sizes);
+		}
 		return 0;
 	} else if (c == VPN_MSG_TIMER) {
 		struct vpn_msg_timer *arg;